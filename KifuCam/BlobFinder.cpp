@@ -32,11 +32,9 @@
 
 extern cv::Mat mat_dbg;
 
-cv::Mat BlobFinder::m_matchRes;
-
 // Find empty intersections in a thresholded, dilated image
 //------------------------------------------------------------------------------
-void BlobFinder::find_empty_places( const cv::Mat &threshed, Points &result)
+void BlobFinder::find_empty_places( const cv::Mat &threshed, Points &result, Workspace &ws)
 {
     // Define the templates
     const int tsz = 15;
@@ -61,12 +59,12 @@ void BlobFinder::find_empty_places( const cv::Mat &threshed, Points &result)
     
     // Match
     double thresh = 75; //90;
-    matchTemplate( threshed, mcross, result, thresh);
+    matchTemplate( threshed, mcross, result, thresh, ws, WS_MATCH_CROSS);
 } // find_empty_places()
 
 // Find empty intersections after dewarp
-//-----------------------------------------------------------------------------------
-void BlobFinder::find_empty_places_perp( const cv::Mat &threshed, Points &result)
+//-------------------------------------------------------------------------------------------------
+void BlobFinder::find_empty_places_perp( const cv::Mat &threshed, Points &result, Workspace &ws)
 {
     // Define the templates
     const int tsz = 21;
@@ -97,7 +95,7 @@ void BlobFinder::find_empty_places_perp( const cv::Mat &threshed, Points &result
     
     // Match
     double thresh = 70; // smaller => more dots
-    matchTemplate( threshed, mcross, result, thresh);
+    matchTemplate( threshed, mcross, result, thresh, ws, WS_MATCH_CROSS_PERP);
 } // find_empty_places_perp()
 
 // Find stones in a grayscale image
@@ -160,20 +158,26 @@ void BlobFinder::find_stones_perp( const cv::Mat &img, Points &result)
 } // find_stones_perp()
 
 // Template maching for empty intersections
-//--------------------------------------------------------------------------------------------------------
-void BlobFinder::matchTemplate( const cv::Mat &img, const cv::Mat &templ, Points &result, double thresh)
+//---------------------------------------------------------------------------------------------
+void BlobFinder::matchTemplate( const cv::Mat &img, const cv::Mat &templ, Points &result, double thresh,
+                               Workspace &ws, int slot)
 {
-    //cv::Mat matchRes;
-    cv::Mat mtmp;
+    // One set of buffers per caller, since the image sizes differ.
+    // Normalize into a separate 8 bit buffer; in place it would reallocate every time.
     int tsz = templ.rows;
-    cv::copyMakeBorder( img, mtmp, tsz/2, tsz/2, tsz/2, tsz/2, cv::BORDER_REPLICATE, cv::Scalar(0));
-    cv::matchTemplate( mtmp, templ, m_matchRes, cv::TM_SQDIFF);
-    cv::normalize( m_matchRes, m_matchRes, 0 , 255, cv::NORM_MINMAX, CV_8UC1);
-    cv::adaptiveThreshold( m_matchRes, mtmp, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
+    const cv::Size padsz( img.cols + 2*(tsz/2), img.rows + 2*(tsz/2));
+    cv::Mat padded = ws.get_view( slot, padsz, CV_8UC1);
+    cv::Mat sqdiff = ws.get_view( slot + 1, img.size(), CV_32FC1);
+    cv::Mat matchRes = ws.get_view( slot + 2, img.size(), CV_8UC1);
+    cv::Mat threshed = ws.get_view( slot + 3, img.size(), CV_8UC1);
+    cv::copyMakeBorder( img, padded, tsz/2, tsz/2, tsz/2, tsz/2, cv::BORDER_REPLICATE, cv::Scalar(0));
+    cv::matchTemplate( padded, templ, sqdiff, cv::TM_SQDIFF);
+    cv::normalize( sqdiff, matchRes, 0 , 255, cv::NORM_MINMAX, CV_8UC1);
+    cv::adaptiveThreshold( matchRes, threshed, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
                           11,  // neighborhood_size
                           thresh); // threshold; less is more
     
-    //mat_dbg = mtmp.clone();
+    //mat_dbg = threshed.clone();
     // Find the blobs. They are the empty places.
     cv::SimpleBlobDetector::Params params;
     params.filterByColor = true;
@@ -188,7 +192,7 @@ void BlobFinder::matchTemplate( const cv::Mat &img, const cv::Mat &templ, Points
     params.maxArea = 100;
     cv::Ptr<cv::SimpleBlobDetector> d = cv::SimpleBlobDetector::create(params);
     std::vector<cv::KeyPoint> keypoints;
-    d->detect( mtmp, keypoints);
+    d->detect( threshed, keypoints);
     //result = Points();
     ILOOP (keypoints.size()) { result.push_back(keypoints[i].pt); }
 } // matchTemplate()
@@ -33,15 +33,18 @@
 #include <iostream>
 #include "Common.hpp"
 #include "Ocv.hpp"
+#include "Workspace.hpp"
 
+// Each engine owns its own BlobFinder, so several can run on different threads.
+// The template match buffers come from the engine's workspace.
 class BlobFinder
 //=================
 {
 public:
     // Find empty intersections in a grayscale image
-    static void find_empty_places( const cv::Mat &img, Points &result);
+    void find_empty_places( const cv::Mat &img, Points &result, Workspace &ws);
     // Find empty intersections after dewarp
-    static void find_empty_places_perp( const cv::Mat &img, Points &result);
+    void find_empty_places_perp( const cv::Mat &img, Points &result, Workspace &ws);
     // Find stones in a grayscale image
     static void find_stones( const cv::Mat &img, Points &result);
     // Find stones after dewarp
@@ -49,10 +52,10 @@ public:
     // Clean outliers
     static Points clean(  Points &pts);
     
-    // Data
-    static cv::Mat m_matchRes;
 private:
-    static void matchTemplate( const cv::Mat &img, const cv::Mat &templ, Points &result, double thresh);
+    // Buffers come from four workspace slots, starting at slot
+    void matchTemplate( const cv::Mat &img, const cv::Mat &templ, Points &result, double thresh,
+                       Workspace &ws, int slot);
 }; // class BlobFinder
 
 #endif /* BlobFinder_hpp */
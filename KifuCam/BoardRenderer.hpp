@@ -0,0 +1,384 @@
+//
+//  BoardRenderer.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Draw Go diagrams fast.
+// The empty board for a given width and board size gets drawn once and cached.
+// Stones are rendered once per size as anti-aliased sprites, and blended onto the
+// board at each intersection. update() touches only the intersections that changed.
+// Score overlays go into one alpha plane and get blended in a single pass.
+// Move letters come from an atlas of pre-rendered tiles.
+
+#ifndef BoardRenderer_hpp
+#define BoardRenderer_hpp
+
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include "Globals.h"
+#include "Common.hpp"
+#include "BoardSize.hpp"
+
+class BoardRenderer
+//=====================
+{
+public:
+    static constexpr int MAX_LAYOUTS = 8; // widths times board sizes we keep around
+    
+    // One renderer per thread, so callers need no locks
+    //------------------------------------------------------
+    inline static BoardRenderer& instance()
+    {
+        static thread_local BoardRenderer renderer;
+        return renderer;
+    }
+    
+    // Board with stones, width x width, CV_8UC3
+    //-----------------------------------------------------------------------------------------
+    inline void render( const std::vector<int> &diagram, int boardsz, int width, cv::Mat &dst)
+    {
+        const Layout &lay = layout( boardsz, width);
+        lay.board.copyTo( dst);
+        const cv::Rect all( 0, 0, width, width);
+        ISLOOP (diagram) {
+            if (i >= boardsz * boardsz) break;
+            blit( lay, diagram[i], i, dst, all);
+        }
+    } // render()
+    
+    // dst shows prev, from render() or update(). Make it show next.
+    // Only the intersections that differ get drawn again.
+    // Returns the number of intersections redrawn.
+    //--------------------------------------------------------------------------------
+    inline int update( const std::vector<int> &prev, const std::vector<int> &next,
+                      int boardsz, cv::Mat &dst)
+    {
+        const int npoints = boardsz * boardsz;
+        if (SZ(prev) != npoints || SZ(next) != npoints || dst.rows != dst.cols || dst.type() != CV_8UC3) {
+            render( next, boardsz, dst.cols, dst);
+            return npoints;
+        }
+        const Layout &lay = layout( boardsz, dst.cols);
+        const cv::Rect all( 0, 0, dst.cols, dst.rows);
+        int nchanged = 0;
+        ILOOP (npoints) {
+            if (stone( prev[i]) == stone( next[i])) continue;
+            nchanged++;
+            // Back to the empty board around i, then every stone reaching in there, in order
+            cv::Rect patch = sprite_rect( lay, i) & all;
+            lay.board( patch).copyTo( dst( patch));
+            // Row major, the order render() uses.
+            const int r = i / boardsz, c = i % boardsz;
+            for (int rr = std::max( 0, r - lay.reach); rr <= std::min( boardsz - 1, r + lay.reach); rr++) {
+                for (int cc = std::max( 0, c - lay.reach); cc <= std::min( boardsz - 1, c + lay.reach); cc++) {
+                    blit( lay, next[rr * boardsz + cc], rr * boardsz + cc, dst, patch);
+                }
+            }
+        } // ILOOP
+        return nchanged;
+    } // update()
+    
+    // Territory overlay. A square per point, black where terrmap > 0, white where < 0,
+    // with opacity |terrmap|. dst must come from render() at the same board size.
+    //-------------------------------------------------------------------------------------
+    inline void draw_score( const double *terrmap, int boardsz, cv::Mat &dst)
+    {
+        const Layout &lay = layout( boardsz, dst.cols);
+        const int npoints = boardsz * boardsz;
+        // Build the overlay: alpha and target gray per pixel
+        m_alpha.create( dst.size(), CV_8UC1);
+        m_value.create( dst.size(), CV_8UC1);
+        m_alpha.setTo( 0);
+        const cv::Rect all( 0, 0, dst.cols, dst.rows);
+        ILOOP (npoints) {
+            double prob = terrmap[i];
+            cv::Point p = center( lay.width, boardsz, i / boardsz, i % boardsz);
+            const int r = lay.score_rad;
+            cv::Rect rect = cv::Rect( p.x - r, p.y - r, 2*r + 1, 2*r + 1) & all;
+            m_alpha( rect).setTo( ROUND( std::min( 1.0, fabs( prob)) * 255));
+            m_value( rect).setTo( prob < 0 ? 255 : 0);
+        }
+        // Blend, one pass over the image
+        cv::parallel_for_( cv::Range( 0, dst.rows), [&](const cv::Range &rows) {
+            for (int y = rows.start; y < rows.end; y++) {
+                blend_row( dst.ptr<uint8_t>( y), m_alpha.ptr<uint8_t>( y), m_value.ptr<uint8_t>( y), dst.cols);
+            }
+        });
+    } // draw_score()
+    
+    // Put a letter on intersection row, col, on an opaque board colored square
+    //--------------------------------------------------------------------------------
+    inline void draw_letter( char letter, int row, int col, int boardsz, cv::Mat &dst)
+    {
+        const Layout &lay = layout( boardsz, dst.cols);
+        if (letter < 'a' || letter > 'z') return;
+        if (row < 0 || row >= boardsz || col < 0 || col >= boardsz) return;
+        const cv::Mat &tile = lay.glyphs[letter - 'a'];
+        const int r = tile.rows / 2;
+        cv::Point p = center( lay.width, boardsz, row, col);
+        const cv::Rect full( p.x - r, p.y - r, tile.cols, tile.rows);
+        const cv::Rect rect = full & cv::Rect( 0, 0, dst.cols, dst.rows);
+        if (rect.empty()) return;
+        tile( rect - full.tl()).copyTo( dst( rect));
+    } // draw_letter()
+    
+    // Center of intersection row, col, in image coordinates.
+    // Same as rc2p() in Helpers.hpp.
+    //------------------------------------------------------------------------
+    inline static cv::Point center( int width, int boardsz, int row, int col)
+    {
+        int marg = width * 0.05;
+        int innerwidth = width - 2*marg;
+        float d = innerwidth / (boardsz-1.0);
+        return cv::Point( ROUND( marg + d*col), ROUND( marg + d*row));
+    } // center()
+    
+    // Stone radius in pixels
+    //-----------------------------------------------------
+    inline static int stone_radius( int width, int boardsz)
+    {
+        int marg = width * 0.05;
+        int innerwidth = width - 2*marg;
+        return ROUND( 0.5 * innerwidth / (boardsz-1.0)) - 1;
+    } // stone_radius()
+    
+    inline int nlayouts() const { return SZ(m_layouts); }
+    
+    static int test();
+    
+private:
+    // A stone sprite. Blending is out = bg * weight + value, per pixel.
+    struct Sprite {
+        cv::Mat weight; // CV_32FC1
+        cv::Mat value;  // CV_32FC1
+    };
+    struct Layout {
+        int boardsz = 0, width = 0, half = 0;
+        int reach = 0; // sprites this many lines apart can overlap
+        int score_rad = 0; // half side of the territory squares
+        cv::Mat board; // empty board, CV_8UC3
+        Sprite black, white;
+        std::vector<cv::Mat> glyphs; // 'a' to 'z' on a board colored square
+    };
+    
+    // dst = dst + (value - dst) * alpha / 255, per channel.
+    // Plain integer loop, the compiler vectorizes it.
+    //------------------------------------------------------------------------------------------------
+    inline static void blend_row( uint8_t *d, const uint8_t *alpha, const uint8_t *value, int n)
+    {
+        for (int x = 0; x < n; x++) {
+            const int a = alpha[x];
+            const int va = value[x] * a;
+            const int na = 255 - a;
+            for (int ch = 0; ch < 3; ch++) {
+                int t = d[3*x + ch] * na + va + 128;
+                d[3*x + ch] = (uint8_t)((t + (t >> 8)) >> 8); // t / 255, rounded
+            }
+        }
+    } // blend_row()
+    
+    //-----------------------------------------
+    inline static bool stone( int v) { return v == BBLACK || v == WWHITE; }
+    
+    // Square around intersection i that a stone can touch
+    //------------------------------------------------------------------
+    inline static cv::Rect sprite_rect( const Layout &lay, int i)
+    {
+        cv::Point p = center( lay.width, lay.boardsz, i / lay.boardsz, i % lay.boardsz);
+        return cv::Rect( p.x - lay.half, p.y - lay.half, 2*lay.half + 1, 2*lay.half + 1);
+    } // sprite_rect()
+    
+    // Blend the stone at i into dst, only inside clip
+    //-----------------------------------------------------------------------------------------
+    inline static void blit( const Layout &lay, int color, int i, cv::Mat &dst, const cv::Rect &clip)
+    {
+        if (!stone( color)) return;
+        const Sprite &spr = (color == BBLACK) ? lay.black : lay.white;
+        const cv::Rect full = sprite_rect( lay, i);
+        const cv::Rect rect = full & clip;
+        if (rect.empty()) return;
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            const float *w = spr.weight.ptr<float>( y - full.y) + (rect.x - full.x);
+            const float *v = spr.value.ptr<float>( y - full.y) + (rect.x - full.x);
+            uint8_t *d = dst.ptr<uint8_t>( y) + 3 * rect.x;
+            for (int x = 0; x < rect.width; x++) {
+                if (w[x] >= 1.0f) { d += 3; continue; } // outside the stone
+                for (int ch = 0; ch < 3; ch++, d++) {
+                    *d = cv::saturate_cast<uint8_t>( *d * w[x] + v[x]);
+                }
+            }
+        }
+    } // blit()
+    
+    // Anti-aliased coverage of a circle, 0 to 1
+    //------------------------------------------------------------------------------
+    inline static cv::Mat coverage( int half, int rad, int thickness)
+    {
+        cv::Mat m = cv::Mat::zeros( 2*half + 1, 2*half + 1, CV_8UC1);
+        cv::circle( m, cv::Point( half, half), rad, cv::Scalar(255), thickness, cv::LINE_AA);
+        cv::Mat res;
+        m.convertTo( res, CV_32F, 1.0 / 255);
+        return res;
+    } // coverage()
+    
+    // Empty board and stone sprites for one width and board size
+    //--------------------------------------------------------------------
+    inline const Layout& layout( int boardsz, int width)
+    {
+        auto key = std::make_pair( boardsz, width);
+        auto it = m_layouts.find( key);
+        if (it != m_layouts.end()) return it->second;
+        if (SZ(m_layouts) >= MAX_LAYOUTS) { m_layouts.clear(); }
+        
+        Layout &lay = m_layouts[key];
+        lay.boardsz = boardsz;
+        lay.width = width;
+        const int rad = stone_radius( width, boardsz);
+        lay.half = rad + 2; // room for the anti-aliased rim
+        // On small boards the spacing gets close to the sprite size, and diagonal
+        // neighbors reach in too. One more line for rounding of the centers.
+        while (lay.reach < boardsz - 1 &&
+               center( width, boardsz, 0, lay.reach + 1).x - center( width, boardsz, 0, 0).x <= 2 * lay.half) {
+            lay.reach++;
+        }
+        lay.reach++;
+        
+        // The board: lines and hoshis
+        lay.board = cv::Mat( width, width, CV_8UC3, cv::Scalar::all( BOARD_GRAY));
+        int marg = width * 0.05;
+        int innerwidth = width - 2*marg;
+        ILOOP (boardsz) {
+            cv::line( lay.board, center( width, boardsz, i, 0), center( width, boardsz, i, boardsz-1),
+                     cv::Scalar(0,0,0), 1, cv::LINE_AA);
+            cv::line( lay.board, center( width, boardsz, 0, i), center( width, boardsz, boardsz-1, i),
+                     cv::Scalar(0,0,0), 1, cv::LINE_AA);
+        }
+        int r = ROUND( 0.15 * innerwidth / (boardsz-1.0));
+        with_board_size( boardsz, [&](auto bs) {
+            for (auto rc : decltype(bs)::hoshis()) {
+                cv::circle( lay.board, center( width, boardsz, rc.first, rc.second), r, 0, -1);
+            }
+        });
+        
+        // Black stone: filled black disk
+        cv::Mat a = coverage( lay.half, rad, -1);
+        cv::Mat not_a = 1.0 - a;
+        lay.black.weight = not_a;
+        lay.black.value = cv::Mat::zeros( a.size(), CV_32F);
+        // White stone: white disk, then a black rim on top
+        cv::Mat not_rim = 1.0 - coverage( lay.half, rad, 1);
+        lay.white.weight = not_a.mul( not_rim);
+        lay.white.value = a.mul( not_rim) * 255.0;
+        
+        // Territory squares
+        lay.score_rad = ROUND( 0.3 * innerwidth / (boardsz-1.0)) - 1;
+        
+        // Letters for candidate moves, centered on a board colored square
+        const int fontFace = cv::FONT_HERSHEY_DUPLEX;
+        const double fontScale = 0.8;
+        const int thickness = 1;
+        lay.glyphs.resize( 26);
+        ILOOP (26) {
+            std::string txt( 1, char('a' + i));
+            int baseline = 0;
+            auto textSize = cv::getTextSize( txt, fontFace, fontScale, thickness, &baseline);
+            cv::Mat &tile = lay.glyphs[i];
+            tile = cv::Mat( 2*rad + 1, 2*rad + 1, CV_8UC3, cv::Scalar::all( BOARD_GRAY));
+            cv::Point org( rad - textSize.width / 2, rad + textSize.height / 2);
+            cv::putText( tile, txt, org, fontFace, fontScale, cv::Scalar( 0xe0,0,0), thickness, cv::LINE_AA);
+        }
+        return lay;
+    } // layout()
+    
+    // Data
+    std::map<std::pair<int,int>, Layout> m_layouts;
+    cv::Mat m_alpha, m_value; // score overlay, reused
+
+}; // class BoardRenderer
+
+// Examples and checks. Returns the number of failures.
+//--------------------------------------------------------------
+inline int BoardRenderer::test()
+{
+    TestCheck check( "BoardRenderer::test");
+    BoardRenderer br;
+    const int boardsz = 9, width = 300;
+    std::vector<int> a( boardsz*boardsz, EEMPTY), b;
+    a[0] = BBLACK; a[1] = WWHITE; a[10] = BBLACK; a[40] = WWHITE;
+    b = a;
+    b[1] = EEMPTY; b[2] = BBLACK; b[11] = WWHITE; b[40] = BBLACK; b[80] = WWHITE;
+    
+    cv::Mat full, incr;
+    br.render( b, boardsz, width, full);
+    br.render( a, boardsz, width, incr);
+    int n = br.update( a, b, boardsz, incr);
+    check( n == 5, "changed count");
+    check( cv::norm( full, incr, cv::NORM_INF) == 0, "update matches render");
+    
+    // Taking all stones off gives the empty board back
+    std::vector<int> empty( boardsz*boardsz, EEMPTY);
+    br.update( b, empty, boardsz, incr);
+    cv::Mat board;
+    br.render( empty, boardsz, width, board);
+    check( cv::norm( board, incr, cv::NORM_INF) == 0, "back to empty");
+    check( br.nlayouts() == 1, "one layout cached");
+    
+    // Small and crowded: at 100 pixels for 19x19, diagonal neighbors overlap the sprite
+    {
+        const int sz = 19;
+        std::vector<int> c( sz*sz, EEMPTY), d;
+        ILOOP (sz*sz) { c[i] = (i * 7919) % 3 == 0 ? BBLACK : (i * 7919) % 3 == 1 ? WWHITE : EEMPTY; }
+        d = c;
+        for (int i = 0; i < sz*sz; i += 13) { d[i] = (d[i] == EEMPTY) ? WWHITE : EEMPTY; }
+        for (int w : { 100, 120, 150 }) {
+            cv::Mat ref, upd;
+            br.render( d, sz, w, ref);
+            br.render( c, sz, w, upd);
+            br.update( c, d, sz, upd);
+            check( cv::norm( ref, upd, cv::NORM_INF) == 0, "update matches render at small width");
+        }
+    }
+    
+    // Score overlay: full opacity squares come out solid, zero leaves the board alone
+    std::vector<double> terrmap( boardsz*boardsz, 0.0);
+    terrmap[0] = 1.0; terrmap[1] = -1.0;
+    br.draw_score( terrmap.data(), boardsz, board);
+    cv::Point p0 = center( width, boardsz, 0, 0), p1 = center( width, boardsz, 0, 1), p4 = center( width, boardsz, 4, 4);
+    check( board.at<cv::Vec3b>( p0) == cv::Vec3b( 0,0,0), "black square");
+    check( board.at<cv::Vec3b>( p1) == cv::Vec3b( 255,255,255), "white square");
+    check( cv::norm( board( cv::Rect( p4.x - 3, p4.y - 3, 7, 7)), incr( cv::Rect( p4.x - 3, p4.y - 3, 7, 7)),
+                    cv::NORM_INF) == 0, "untouched where terrmap is 0");
+    
+    // Letters
+    br.draw_letter( 'a', 4, 4, boardsz, board);
+    check( board.at<cv::Vec3b>( p4.y - stone_radius( width, boardsz), p4.x) == cv::Vec3b::all( BOARD_GRAY),
+          "glyph tile is board colored");
+    return check.nfails();
+} // test()
+
+#endif /* BoardRenderer_hpp */
@@ -0,0 +1,109 @@
+//
+//  BoardSize.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Everything that depends on the board size, as compile time constants.
+// 9x9, 13x13 and 19x19 exist. with_board_size() picks one at runtime.
+
+#ifndef BoardSize_hpp
+#define BoardSize_hpp
+
+#include <array>
+#include <utility>
+
+template <int N>
+struct BoardSize
+//===================
+{
+    static_assert( N == 9 || N == 13 || N == 19, "BoardSize: only 9, 13, 19");
+    static constexpr int DIM = N;
+    static constexpr int NPOINTS = N * N;
+    // Line count gates. A photo shows at least the board lines, and never
+    // more than about three times as many.
+    static constexpr int MIN_LINES = N;
+    static constexpr int MAX_LINES = (55 * N) / 19;
+    // Stones or empty places we need to see after dewarp
+    static constexpr int MIN_BLOBS = NPOINTS / 2;
+    // Star points. Third line on 13x13 and 19x19, fifth line on 9x9 is tengen.
+    static constexpr int HOSHI_EDGE = N < 13 ? 2 : 3;
+    static constexpr int NHOSHI = N < 19 ? 5 : 9;
+    
+    typedef std::array<int, NPOINTS> Diagram;
+    
+    // Row and column of each star point
+    //-------------------------------------------------------------------
+    static std::array<std::pair<int,int>, NHOSHI> hoshis()
+    {
+        const int lo = HOSHI_EDGE, mid = N / 2, hi = N - 1 - HOSHI_EDGE;
+        if constexpr (NHOSHI == 5) {
+            return {{ {lo,lo}, {lo,hi}, {mid,mid}, {hi,lo}, {hi,hi} }};
+        }
+        else {
+            return {{ {lo,lo}, {lo,mid}, {lo,hi}, {mid,lo}, {mid,mid}, {mid,hi}, {hi,lo}, {hi,mid}, {hi,hi} }};
+        }
+    } // hoshis()
+}; // struct BoardSize
+
+// One of the sizes we support
+//------------------------------------------
+inline bool board_size_ok( int boardsz)
+{
+    return boardsz == 9 || boardsz == 13 || boardsz == 19;
+}
+
+// Call f with the BoardSize<N> matching boardsz. Unknown sizes get 19x19.
+// f must return the same type for all sizes.
+//   int n = with_board_size( 13, [](auto bs) { return decltype(bs)::NPOINTS; });
+//------------------------------------------------------------------------------------
+template <typename F>
+inline auto with_board_size( int boardsz, F &&f)
+{
+    switch (boardsz) {
+        case 9:  return f( BoardSize<9>());
+        case 13: return f( BoardSize<13>());
+        default: return f( BoardSize<19>());
+    }
+} // with_board_size()
+
+// The sanity gates of BoardSize<N>, for code that only knows the size at runtime
+//=====================================================================================
+struct BoardGates
+{
+    int min_lines;
+    int max_lines;
+    int min_blobs;
+};
+
+//------------------------------------------------
+inline BoardGates board_gates( int boardsz)
+{
+    return with_board_size( boardsz, [](auto bs) {
+        typedef decltype(bs) B;
+        return BoardGates{ B::MIN_LINES, B::MAX_LINES, B::MIN_BLOBS };
+    });
+} // board_gates()
+
+#endif /* BoardSize_hpp */
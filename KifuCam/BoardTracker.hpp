@@ -0,0 +1,148 @@
+//
+//  BoardTracker.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Follow a locked board from frame to frame in video mode.
+// The intersections are moved with pyramidal Lucas-Kanade flow, and a homography
+// fitted to the moved points carries the whole grid and the corners along.
+// If the points do not agree with the homography, the board is lost and the caller
+// runs the full find_board pipeline again.
+
+#ifndef BoardTracker_hpp
+#define BoardTracker_hpp
+
+#include <iostream>
+#include "Common.hpp"
+#include "Ocv.hpp"
+
+class BoardTracker
+//===================
+{
+public:
+    static constexpr double MAX_RESIDUAL = 1.5; // median reprojection error in pixels
+    static constexpr double MIN_TRACKED  = 0.6; // fraction of points the flow must find
+    static constexpr int MAX_FRAMES      = 60;  // relock after this many frames, against drift
+
+    // Start tracking from a full detection. Points in image coordinates.
+    //----------------------------------------------------------------------------------------
+    inline void lock( const cv::Mat &img, const Points2f &corners, const Points2f &intersections)
+    {
+        to_gray( img, m_prev_gray);
+        m_corners = corners;
+        m_intersections = intersections;
+        m_nframes = 0;
+        m_locked = true;
+    } // lock()
+
+    // Forget the board. Next track() call fails.
+    //----------------------------
+    inline void reset()
+    {
+        m_locked = false;
+        m_corners.clear();
+        m_intersections.clear();
+    } // reset()
+
+    inline bool locked() const { return m_locked; }
+
+    // Move corners and intersections from the previous frame into img.
+    // Returns false if we lost the board. Then the caller must detect and lock() again.
+    //--------------------------------------------------------------------------------------
+    inline bool track( const cv::Mat &img, Points2f &corners, Points2f &intersections)
+    {
+        bool success = false;
+        do {
+            if (!m_locked) break;
+            if (++m_nframes > MAX_FRAMES) break;
+            to_gray( img, m_gray);
+            if (m_gray.size() != m_prev_gray.size()) break;
+
+            // Sparse optical flow on the intersections
+            cv::calcOpticalFlowPyrLK( m_prev_gray, m_gray, m_intersections, m_next, m_status, m_err,
+                                     cv::Size( 15,15), 2);
+            m_from.clear(); m_to.clear();
+            ISLOOP (m_status) {
+                if (!m_status[i]) continue;
+                m_from.push_back( m_intersections[i]);
+                m_to.push_back( m_next[i]);
+            }
+            if (SZ(m_from) < MIN_TRACKED * SZ(m_intersections)) break;
+
+            // The grid is planar, so one homography has to explain all of it
+            cv::Mat H = cv::findHomography( m_from, m_to, cv::RANSAC, 2.0);
+            if (H.empty()) break;
+            cv::perspectiveTransform( m_from, m_pred, H);
+            m_resid.clear();
+            ISLOOP (m_pred) {
+                m_resid.push_back( cv::norm( m_pred[i] - m_to[i]));
+            }
+            if (vec_median( m_resid) > MAX_RESIDUAL) break;
+
+            // Move the whole grid, including points the flow lost
+            cv::perspectiveTransform( m_intersections, m_intersections, H);
+            cv::perspectiveTransform( m_corners, m_corners, H);
+            if (!inside( m_corners, m_gray)) break;
+
+            cv::swap( m_gray, m_prev_gray);
+            corners = m_corners;
+            intersections = m_intersections;
+            success = true;
+        } while(0);
+        if (!success) { reset(); }
+        return success;
+    } // track()
+
+private:
+    //----------------------------------------------------------
+    inline static void to_gray( const cv::Mat &img, cv::Mat &dst)
+    {
+        if (img.channels() == 1) { img.copyTo( dst); }
+        else if (img.channels() == 4) { cv::cvtColor( img, dst, cv::COLOR_RGBA2GRAY); }
+        else { cv::cvtColor( img, dst, cv::COLOR_RGB2GRAY); }
+    } // to_gray()
+
+    //-------------------------------------------------------------------
+    inline static bool inside( const Points2f &pts, const cv::Mat &img)
+    {
+        for (const auto &p : pts) {
+            if (p.x < 0 || p.x >= img.cols || p.y < 0 || p.y >= img.rows) return false;
+        }
+        return true;
+    } // inside()
+
+    // Data
+    bool m_locked = false;
+    int m_nframes = 0;
+    cv::Mat m_gray, m_prev_gray;
+    Points2f m_corners, m_intersections;
+    // Scratch, kept to avoid allocations per frame
+    Points2f m_next, m_from, m_to, m_pred;
+    std::vector<uchar> m_status;
+    std::vector<float> m_err;
+    std::vector<double> m_resid;
+}; // class BoardTracker
+
+#endif /* BoardTracker_hpp */
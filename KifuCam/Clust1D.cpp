@@ -0,0 +1,125 @@
+//
+//  Clust1D.cpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Reference version and tests for Clust1D
+
+#include <random>
+#include "Globals.h"
+#include "Clust1D.hpp"
+
+// The straightforward version of cluster(), bell summed over all pairs.
+// test() checks that cluster() splits the samples the same way, most of the time.
+//------------------------------------------------------------------------------------
+std::vector<double> Clust1D::cluster_ref( std::vector<double> vals, double width)
+{
+    std::vector<double> cuts;
+    if (SZ(vals) == 0) return cuts;
+    auto minval = vec_min( vals);
+    ISLOOP (vals) { vals[i] -= minval; }
+    std::sort( vals.begin(), vals.end());
+    std::vector<double> freq( vals.size());
+    ISLOOP (vals) {
+        double sum = 0; int j;
+        for (j = i; j < SZ(vals) && bell( vals[j], vals[i], width) > 0; j++) { sum += bell( vals[j], vals[i], width); }
+        for (j = i; j >= 0 && bell( vals[j], vals[i], width) > 0; j--) { sum += bell( vals[j], vals[i], width); }
+        freq[i] = sum;
+    }
+    int mmax = ROUND( vec_max( vals)) + 1 + 10;
+    std::vector<double> pdf( mmax, -1), spdf( mmax);
+    ISLOOP (freq) { pdf[ROUND(vals[i])] = freq[i]; }
+    ISLOOP (pdf) {
+        double ssum = 0;
+        for (int k = i-SMOOTH; k <= i+SMOOTH; k++) {
+            if (k < 0 || k >= SZ(pdf)) continue;
+            ssum += pdf[k] * triang( i, k, SMOOTH);
+        }
+        spdf[i] = ssum;
+    }
+    std::vector<double> maxes;
+    for (int i = 1; i < SZ(spdf) - 1; i++) {
+        if (spdf[i] >= spdf[i-1] && spdf[i] > spdf[i+1]) { maxes.push_back( i); }
+    }
+    for (int i = 1; i < SZ(maxes); i++) { cuts.push_back( (maxes[i] + maxes[i-1]) / 2.0 + minval); }
+    return cuts;
+} // cluster_ref()
+
+// Split the samples at the cuts. One vector per cluster.
+//-----------------------------------------------------------------------------------------------
+static std::vector<std::vector<double> > split( const std::vector<double> &vals, const std::vector<double> &cuts)
+{
+    std::vector<std::vector<double> > parts;
+    Clust1D::classify( vals, cuts, 0, [](double v) { return v; }, parts);
+    return parts;
+} // split()
+
+// Compare cluster() with cluster_ref() on jittered line positions. The histogram bins
+// move samples by up to half a pixel, so cuts may shift a bit, but the clusters should
+// mostly be the same. Then check a range too wide for 1 pixel bins.
+// Returns the number of failures.
+//-----------------------------------------------------------------------------------------
+int Clust1D::test()
+{
+    TestCheck check( "Clust1D::test");
+    std::mt19937 rng( 42);
+    std::normal_distribution<double> jitter( 0, 1.5);
+    std::uniform_real_distribution<double> unif( 0, 1);
+    const int NTRIES = 1000;
+    int nsame = 0;
+    ILOOP (NTRIES) {
+        // Lines of a board, some missing, some doubled, plus clutter
+        const double spacing = 12 + 8 * unif( rng);
+        const double offset = 100 * unif( rng);
+        const int nlines = 9 + ROUND( 10 * unif( rng));
+        std::vector<double> vals;
+        for (int l = 0; l < nlines; l++) {
+            int ncopies = ROUND( 3 * unif( rng));
+            for (int k = 0; k < ncopies; k++) { vals.push_back( offset + l * spacing + jitter( rng)); }
+        }
+        for (int k = 0; k < 3; k++) { vals.push_back( offset + nlines * spacing * unif( rng)); }
+        const double width = 23; // what dedup_verticals() uses
+        auto cuts = cluster( vals, width, [](double v) { return v; });
+        if (split( vals, cuts) == split( vals, cluster_ref( vals, width))) { nsame++; }
+    }
+    check( nsame >= 0.9 * NTRIES, "clusters differ from cluster_ref too often");
+    
+    // Far apart lines, more than MAX_BINS pixels in all
+    const double spacing = 5000;
+    const int nlines = 19;
+    std::vector<double> vals;
+    ILOOP (nlines) { vals.push_back( i * spacing); vals.push_back( i * spacing + 3); }
+    auto cuts = cluster( vals, 23.0, [](double v) { return v; });
+    // Bin 0 never counts as a peak, so the first gap may go without a cut
+    std::vector<int> ncuts( nlines - 1, 0);
+    for (double cut : cuts) {
+        int gap = (int)(cut / spacing);
+        bool between = gap < nlines - 1 && cut > gap * spacing + 3;
+        check( between, "wide range cut between lines");
+        if (between) { ncuts[gap]++; }
+    }
+    for (int gap = 1; gap < nlines - 1; gap++) { check( ncuts[gap] == 1, "wide range one cut per gap"); }
+    return check.nfails();
+} // test()
@@ -31,6 +31,8 @@
 #define Clust1D_hpp
 
 #include <iostream>
+#include <array>
+#include <algorithm>
 #include "Common.hpp"
 
 class Clust1D
@@ -38,76 +40,76 @@ class Clust1D
 {
 public:
     // One dim clustering. Return the cluster borders aka cuts.
+    // Samples are counted in a histogram of 1 pixel bins, or wider bins if the range
+    // needs more than MAX_BINS. The density of an occupied bin is the count histogram
+    // weighted with a bell of the given width, from a table made once per width.
+    // Empty bins get -1. The histogram gets smoothed with a triangle, and cuts are
+    // halfway between neighboring peaks. The buffers are reused, so no allocation
+    // in steady state.
     //---------------------------------------------------------------------------
     template <typename T, typename G>
     static inline std::vector<double> cluster( const std::vector<T> &seq_, double width, G getter)
     {
         std::vector<double> cuts;
-        const double SMOOTH = 3.0;
-        typedef double(*WinFunc)(double,double,double);
-        WinFunc winf = bell;
-        
-        std::vector<double> vals;
+        if (SZ(seq_) == 0) return cuts;
+        std::vector<double> &vals = scratch_vals();
+        vals.resize( SZ(seq_));
         // A line is represented by the middle x(for horiz) or middle y(for vert).
         ISLOOP (seq_) {
-                vals.push_back( getter(seq_[i] ));
+            vals[i] = getter( seq_[i]);
         }
         // Make sure they are all positive. Crash fix.
-        auto minval = vec_min(vals);
+        const double minval = vec_min( vals);
+        const double range = vec_max( vals) - minval;
+        const double binw = std::max( 1.0, range / (MAX_BINS - 1));
+        
+        // Count per bin, with padding to find the rightmost cluster
+        const int nbins = ROUND( range / binw) + 1 + 10;
+        std::vector<double> &cnt = scratch_cnt();
+        cnt.assign( nbins + 2 * MAX_REACH, 0);
         ISLOOP (vals) {
-            vals[i] -= minval;
+            cnt[MAX_REACH + ROUND( (vals[i] - minval) / binw)] += 1;
         }
         
-        std::sort( vals.begin(), vals.end(), [](double a, double b) { return a<b; });
-        std::vector<double> freq(vals.size());
+        // Discrete pdf, missing values set to -1.
+        // A sample counts twice against itself, like a bell summed from both sides.
+        const std::vector<double> &kern = kernel( width, binw);
+        const int reach = SZ(kern) - 1;
+        std::vector<double> &hist = scratch_hist();
+        hist.assign( nbins + 2 * SMOOTH, 0);
+        ILOOP (nbins) {
+            const double *c = &cnt[MAX_REACH + i];
+            if (c[0] == 0) { hist[SMOOTH + i] = -1; continue; }
+            double sum = c[0] * (1 + kern[0]);
+            for (int d = 1; d <= reach; d++) { sum += (c[d] + c[-d]) * kern[d]; }
+            hist[SMOOTH + i] = sum;
+        }
         
-        do {
-            // Distance weighted sum of number of samples to the left and to the right
-            ISLOOP (vals) {
-                double sum = 0; int j;
-                j=i;
-                while( j < vals.size() && winf( vals[j], vals[i], width) > 0) {
-                    sum += winf( vals[j], vals[i], width);
-                    j++;
-                }
-                j=i;
-                while( j >= 0 && winf( vals[j], vals[i], width) > 0) {
-                    sum += winf( vals[j], vals[i], width);
-                    j--;
-                }
-                freq[i] = sum;
-            } // ISLOOP
-            if (SZ(vals) == 0) break;
-            
-            // Convert to discrete pdf, missing values set to -1
-            int mmax = ROUND( vec_max( vals)) + 1;
-            mmax += 10; // Padding to find the rightmost cluster
-            std::vector<double> pdf(mmax,-1);
-            ISLOOP (freq) {
-                pdf[ROUND(vals[i])] = freq[i];
-            }
-            pdf = smooth( pdf,SMOOTH);
-            
-            std::vector<double> maxes;
-            ISLOOP (pdf) {
-                if (i < 1) continue;
-                if (i >= pdf.size()-1) continue;
-                if (pdf[i] >= pdf[i-1] && pdf[i] > pdf[i+1]) {
-                    maxes.push_back( i);
+        // Smooth with triang( SMOOTH)
+        static const std::array<double, 2*SMOOTH+1> taps = smooth_taps();
+        std::vector<double> &pdf = scratch_pdf();
+        pdf.resize( nbins);
+        ILOOP (nbins) {
+            double ssum = 0;
+            for (int k = 0; k <= 2*SMOOTH; k++) { ssum += hist[i + k] * taps[k]; }
+            pdf[i] = ssum;
+        }
+        
+        // Local maxima, and cuts between them
+        int prevmax = -1;
+        for (int i = 1; i < nbins - 1; i++) {
+            if (pdf[i] >= pdf[i-1] && pdf[i] > pdf[i+1]) {
+                if (prevmax >= 0) {
+                    cuts.push_back( (i + prevmax) / 2.0 * binw + minval);
                 }
+                prevmax = i;
             }
-            ISLOOP (maxes) {
-                if (i==0) continue;
-                cuts.push_back( (maxes[i] + maxes[i-1]) / 2.0);
-            }
-        } while(0);
-        // Move back to original position.
-        ISLOOP (cuts) {
-            cuts[i] += minval;
         }
         return cuts;
     } // cluster()
     
+    static int test();
+    
     // Use the cuts returned by cluster() to classify new samples
     //---------------------------------------------------------------------------
     template <typename T, typename G>
@@ -147,23 +149,43 @@ public:
     
     
 private:
-    // Smoothe
-    //-----------------------------------------------------------------------------------------
-    static inline std::vector<double> smooth( const std::vector<double> &seq, double width = 3)
+    static constexpr int SMOOTH = 3;           // smoothing half width in bins
+    static constexpr int MAX_BINS = 1024;      // histogram resolution drops past that
+    static constexpr int MAX_REACH = 64;       // bell table length limit, in bins
+    static constexpr double BELL_CUTOFF = 40;  // bell below exp(-40) does not change a sum >= 1
+    
+    // Reusable buffers, one set per thread
+    static inline std::vector<double> &scratch_vals() { static thread_local std::vector<double> v; return v; }
+    static inline std::vector<double> &scratch_cnt() { static thread_local std::vector<double> v; return v; }
+    static inline std::vector<double> &scratch_hist() { static thread_local std::vector<double> v; return v; }
+    static inline std::vector<double> &scratch_pdf() { static thread_local std::vector<double> v; return v; }
+    
+    // Weights of the smoothing triangle, left to right
+    //-------------------------------------------------------------------
+    static inline std::array<double, 2*SMOOTH+1> smooth_taps()
     {
-        std::vector<double> res( seq.size());
-        ISLOOP (seq) {
-            double ssum = 0;
-            for (int k = i-width; k <= i+width; k++) {
-                if (k < 0) continue;
-                if (k >= seq.size()) continue;
-                double weight = triang( i, k, width);
-                ssum += seq[k] * weight;
-            }
-            res[i] = ssum;
-        }
+        std::array<double, 2*SMOOTH+1> res;
+        for (int k = -SMOOTH; k <= SMOOTH; k++) { res[k + SMOOTH] = triang( 0, k, SMOOTH); }
         return res;
-    }
+    } // smooth_taps()
+    
+    // Bell of the given width at 0, 1, 2, ... bins, out to where it drops below
+    // exp(-BELL_CUTOFF). Made again only when width or bin size change.
+    //-----------------------------------------------------------------------------------
+    static inline const std::vector<double> &kernel( double width, double binw)
+    {
+        static thread_local std::vector<double> kern;
+        static thread_local double kwidth = -1, kbinw = -1;
+        if (width == kwidth && binw == kbinw) return kern;
+        kwidth = width; kbinw = binw;
+        const double reach = sqrt( 2 * BELL_CUTOFF / width);
+        const int nk = std::min( MAX_REACH, (int)(reach / binw)) + 1;
+        kern.resize( nk);
+        ILOOP (nk) { kern[i] = bell( i * binw, 0, width); }
+        return kern;
+    } // kernel()
+    
+    static std::vector<double> cluster_ref( std::vector<double> vals, double width);
     
     // Various window funcs. Bell works best.
     //=========================================
@@ -29,11 +29,28 @@
 // All other files are either pure Obj-C or pure C++.
 
 #import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
 
 typedef void (^CICompletionHandler)(UIImage *img);
 
+// A camera frame at working size, RGB and gray. Opaque outside of CppInterface.
+//==================================================================================
+@interface CameraFrame : NSObject
+@end
+
 @interface CppInterface : NSObject
 
+// Run the geometry steps f00-f05 on the gray image only, and warp
+// the color image once in f06. Default on.
+@property bool lumaOnly;
+// Get rotation and perspective in f02 from the vanishing points of the rough
+// lines instead of the angle sweeps. Default off.
+@property bool vanishingPoints;
+// Lines on the board. 9, 13, or 19. Default 19.
+@property int boardSize;
+// Frames, crops classified, moves, and time of the last record_video
+@property (readonly) NSString *recordStats;
+
 // Individual steps for debugging
 //---------------------------------
 - (UIImage *) f00_dots_and_verticals_dbg;
@@ -57,17 +74,37 @@ typedef void (^CICompletionHandler)(UIImage *img);
 - (UIImage *) video_mode;
 - (UIImage *) get_best_frame;
 
+// Threaded video mode. Frames go in with video_push, overlays come out in show.
+// Stop the pipeline before using the engine for anything else.
+- (void) video_push:(CameraFrame *)frame show:(CICompletionHandler)show;
+- (void) video_stop;
+
 // Methods for the Obj-C View Controllers
 //=============================================
-// Detect position on img and count the errors
+// Detect position on img and count the errors.
+// Switches the engine to the board size of the sgf, so do not run it on the main engine.
 - (int) runTestImg:(UIImage *)img withSgf:(NSString *)sgf;
+// Image buffer allocations in the last frame. 0 once frames have the same size.
+- (int) frame_allocs;
+// Image buffer allocations since the engine was made
+- (long) total_allocs;
+// Check that each frame gets color clahe with luma only off. Returns failures.
+- (int) test_equalize:(UIImage *)img;
 // Put an image into a buffer q. We pick the best one later.
 - (void) qImg:(UIImage *)img;
+// Same for a camera frame
+- (void) qFrame:(CameraFrame *)frame;
+// Downsample and convert a camera buffer in one pass. Safe on any thread.
++ (CameraFrame *) ingest:(CVPixelBufferRef)pixbuf;
+// The RGB image of a frame, for display
++ (UIImage *) frameImage:(CameraFrame *)frame;
 // Clear the image q.
 - (void) clearImgQ;
 
 // Check for the debug mode trigger position to show right menu.
 - (bool) check_debug_trigger;
+// Hash of the current diagram. Differs for rotations.
+- (uint64_t) diagram_hash;
 
 // Save current diagram to file as sgf
 - (void) save_current_sgf:(NSString *)fname overwrite:(bool)overwrite;
@@ -79,6 +116,8 @@ typedef void (^CICompletionHandler)(UIImage *img);
 - (NSString *) get_sgf_for_img: (UIImage *)img;
 // Get an empty sgf
 - (NSString *) empty_sgf;
+// Game record from a video file, or nil
+- (NSString *) record_video:(NSString *)fname;
 
 // Make a diagram from sgf
 + (UIImage *) sgf2img:(NSString *)sgf;
@@ -86,6 +125,18 @@ typedef void (^CICompletionHandler)(UIImage *img);
 + (UIImage *) nextmove2img:(NSString *)sgf coords:(NSArray *)coords color:(int)color terrmap:(double *)terrmap;
 // Draw scoring map on sgf img
 + (UIImage *) scoreimg:(NSString *)sgf terrmap:(double *)terrmap;
+// Hash of the stones in an sgf, same for rotations and reflections. 0 if no stones.
++ (uint64_t) position_hash:(NSString *)sgf;
+// Check position_hash. Returns the number of failures.
++ (int) test_position_hash;
+// Run the C++ unit tests. Returns pairs of test name and number of failures.
++ (NSArray *) unit_tests;
+// Random games on a 19x19 GoBoard. Returns moves per second.
++ (double) bench_goboard;
+// Synthetic frames through a 19x19 GameRecorder. Returns frames per second.
++ (double) bench_game_recorder;
+// Territory map and score without network. Returns B - W - komi.
++ (double) estimate_score:(NSString *)sgf komi:(double)komi terrmap:(double *)terrmap;
 // Extract an sgf tag
 + (NSString *) get_sgf_tag:(NSString *)tag sgf:(NSString *)sgf;
 // Set an sgf tag. Do not try to set the SZ tag.
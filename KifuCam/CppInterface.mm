@@ -37,20 +37,41 @@
 #import "Common.h"
 #import "Globals.h"
 #import "Helpers.hpp"
+#import "Ingest.hpp"
 
 #import "AppDelegate.h"
 #import "BlobFinder.hpp"
+#import "BoardTracker.hpp"
+#import "Clahe.hpp"
 #import "Clust1D.hpp"
+#import "GameRecorder.hpp"
 #import "CppInterface.h"
 #import "KerasBoardModel.h"
 #import "KerasStoneModel.h"
 #import "Perspective.hpp"
+#import "Territory.hpp"
+#import "VideoPipeline.hpp"
+#import "Workspace.hpp"
+#import "Zobrist.hpp"
 
 extern cv::Mat mat_dbg;
 
+// A camera frame at working size
+//==================================
+@interface CameraFrame()
+{
+@public
+    cv::Mat rgb;
+    cv::Mat gray;
+}
+@end
+
+@implementation CameraFrame
+@end
+
 @interface CppInterface()
 //=======================
-@property float phi; // projection angle in degrees
+@property float phi; // projection angle in degrees. 0 with vanishing points.
 @property cv::Mat Mp, invProj; // Projection matrix and inverse
 @property float theta; // rotation angle in degrees
 @property cv::Mat Ms, invRot;  // Rotation matrix and inverse
@@ -67,6 +88,7 @@ extern cv::Mat mat_dbg;
 @property std::vector<cv::Vec2f> horizontal_lines;
 @property std::vector<cv::Vec2f> vertical_lines;
 @property std::vector<int> diagram; // The position we detected
+@property uint64_t diagramHash; // Zobrist hash of diagram
 @property Points2f corners;
 @property Points2f corners_zoomed;
 @property Points2f intersections;
@@ -78,6 +100,19 @@ extern cv::Mat mat_dbg;
 @property KerasBoardModel *boardModel; // wrapper around iomodel
 @property nn_bew *bewmodel; // Keras model to classify intersections int B,W,E
 @property KerasStoneModel *stoneModel; // wrapper around bewmodel
+// Scratch state. Per engine, so engines can run concurrently on different threads.
+@property BlobFinder blobFinder; // finds intersections and stones
+@property BoardTracker tracker;  // follows the board between video frames
+@property std::shared_ptr<VideoPipeline> pipeline; // threaded video mode
+@property std::map<std::string, std::vector<Float32> > nnmem; // NN input memory by memId
+@property Workspace ws; // image buffers, reused from frame to frame
+@property Clahe clahe; // contrast equalizer, keeps its tables between video frames
+@property bool colorEqualized; // orig_small went through clahe already
+@property NSString *recordStats; // of the last record_video
+@property cv::Mat ingestGray; // gray of the frame, from ingest. Empty if we have none.
+@property long nequalized; // color clahe runs since the engine was made
+@property bool videoFrame; // working on a video frame. Clahe may reuse tables.
+@property SgfWriter sgfWriter; // sgf output buffer, reused between exports
 
 @end
 
@@ -98,6 +133,8 @@ extern cv::Mat mat_dbg;
         // The stone model
         _bewmodel = [nn_bew new];
         _stoneModel = [[KerasStoneModel alloc] initWithModel:_bewmodel];
+        _lumaOnly = true;
+        _boardSize = BOARD_SZ;
     }
     return self;
 } // init()
@@ -105,6 +142,59 @@ extern cv::Mat mat_dbg;
 //=== Misc Public ===
 //===================
 
+// Downsample and convert a camera buffer in one pass. Safe on any thread.
+//---------------------------------------------------------------------------
++ (CameraFrame *) ingest:(CVPixelBufferRef)pixbuf
+{
+    IngestPlanes src;
+    switch (CVPixelBufferGetPixelFormatType( pixbuf)) {
+        case kCVPixelFormatType_32BGRA:
+            src.fmt = INGEST_BGRA; break;
+        case kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange:
+            src.fmt = INGEST_NV12_VIDEO; break;
+        case kCVPixelFormatType_420YpCbCr8BiPlanarFullRange:
+            src.fmt = INGEST_NV12_FULL; break;
+        default:
+            return nil;
+    }
+    CameraFrame *frame = [CameraFrame new];
+    CVPixelBufferLockBaseAddress( pixbuf, kCVPixelBufferLock_ReadOnly);
+    src.width  = (int)CVPixelBufferGetWidth( pixbuf);
+    src.height = (int)CVPixelBufferGetHeight( pixbuf);
+    if (src.fmt == INGEST_BGRA) {
+        src.plane0  = (const uint8_t *)CVPixelBufferGetBaseAddress( pixbuf);
+        src.stride0 = CVPixelBufferGetBytesPerRow( pixbuf);
+        src.plane1  = NULL; src.stride1 = 0;
+    }
+    else {
+        src.plane0  = (const uint8_t *)CVPixelBufferGetBaseAddressOfPlane( pixbuf, 0);
+        src.stride0 = CVPixelBufferGetBytesPerRowOfPlane( pixbuf, 0);
+        src.plane1  = (const uint8_t *)CVPixelBufferGetBaseAddressOfPlane( pixbuf, 1);
+        src.stride1 = CVPixelBufferGetBytesPerRowOfPlane( pixbuf, 1);
+    }
+    int width, height;
+    ingest_size( src.width, src.height, IMG_WIDTH, width, height);
+    frame->rgb.create( height, width, CV_8UC3);
+    frame->gray.create( height, width, CV_8UC1);
+    ingest_frame( src, width, height, frame->rgb.data, frame->rgb.step, frame->gray.data, frame->gray.step);
+    CVPixelBufferUnlockBaseAddress( pixbuf, kCVPixelBufferLock_ReadOnly);
+    return frame;
+} // ingest()
+
+// The RGB image of a frame, for display
+//---------------------------------------------
++ (UIImage *) frameImage:(CameraFrame *)frame
+{
+    return MatToUIImage( frame->rgb);
+} // frameImage()
+
+// Put a camera frame into the image queue
+//--------------------------------------------
+- (void)qFrame:(CameraFrame *)frame
+{
+    [self qMat:frame->rgb];
+} // qFrame()
+
 // Put a video frame into the image queue. The newest one is often shaky.
 //-------------------------------------------------------------------------
 - (void)qImg:(UIImage *)img
@@ -113,6 +203,13 @@ extern cv::Mat mat_dbg;
     UIImageToMat( img, m);
     resize( m, m, IMG_WIDTH);
     cv::cvtColor( m, m, cv::COLOR_RGBA2RGB);
+    [self qMat:m];
+}
+
+// Put an already resized RGB image into the q
+//------------------------------------------------
+- (void)qMat:(cv::Mat)m
+{
     int keep_n_frames = 4;
     ringpush( _imgQ , m, keep_n_frames);
 }
@@ -131,6 +228,7 @@ extern cv::Mat mat_dbg;
     UIImageToMat( img, m);
     //resize( m, m, IMG_WIDTH);
     cv::cvtColor( m, m, cv::COLOR_RGBA2RGB);
+    _boardSize = sgf_board_size( [sgf UTF8String]);
     if (![self recognize_position:m breakIfBad:NO]) {
         return -1;
     }
@@ -146,17 +244,62 @@ extern cv::Mat mat_dbg;
     return errcount;
 } // runTestImg()
 
+// Image buffer allocations in the last frame
+//----------------------------------------------
+- (int) frame_allocs
+{
+    return _ws.frame_allocs();
+}
+
+// Image buffer allocations since the engine was made
+//------------------------------------------------------
+- (long) total_allocs
+{
+    return _ws.total_allocs();
+}
+
+// Without luma only, every frame has to get color clahe in f00.
+// Feed img twice and count. Returns the number of frames that missed it.
+//------------------------------------------------------------------------------
+- (int) test_equalize:(UIImage *)img
+{
+    cv::Mat m;
+    UIImageToMat( img, m);
+    const bool luma = _lumaOnly;
+    _lumaOnly = false;
+    int nfails = 0;
+    ILOOP (2) {
+        const long before = _nequalized;
+        _ws.begin_frame();
+        _orig_small = m.clone();
+        [self f00_dots_and_verticals];
+        _ws.end_frame();
+        if (_nequalized != before + 1) { nfails++; }
+    }
+    _lumaOnly = luma;
+    return nfails;
+} // test_equalize()
+
 // Check for the debug mode trigger position to show right menu.
 // A clump of 4 black stones in the top left corner.
 //----------------------------------------------------------------
 - (bool) check_debug_trigger
 {
-    std::vector<int> templ( SQR(BOARD_SZ), EEMPTY);
-    templ[0] = BBLACK;
-    templ[1] = BBLACK;
-    templ[BOARD_SZ] = BBLACK;
-    templ[BOARD_SZ+1] = BBLACK;
-    bool res = templ == _diagram;
+    // Four black stones in the top left corner. Hash computed once per board size.
+    uint64_t trigger = with_board_size( _boardSize, [](auto bs) {
+        typedef decltype(bs) B;
+        static const uint64_t h = [] {
+            typename B::Diagram templ;
+            templ.fill( EEMPTY);
+            templ[0] = BBLACK;
+            templ[1] = BBLACK;
+            templ[B::DIM] = BBLACK;
+            templ[B::DIM+1] = BBLACK;
+            return Zobrist<B::DIM>::hash( templ);
+        }();
+        return h;
+    });
+    bool res = _diagramHash == trigger;
     return res;
 } // check_debug_trigger()
 
@@ -167,32 +310,76 @@ extern cv::Mat mat_dbg;
 //--------------------------------------------------
 - (void) f00_dots_and_verticals
 {
-    // Normalize image
-    //clahe( _orig_small, _orig_small, 2.0);
-    clahe( _orig_small, _orig_small, 0.5);
-
     _vertical_lines.clear();
     _horizontal_lines.clear();
+    _colorEqualized = false; // new frame
     // Find Blobs
     if (_orig_small.cols != IMG_WIDTH) {
         resize( _orig_small, _orig_small, IMG_WIDTH);
     }
     const cv::Size sz( _orig_small.cols, _orig_small.rows);
-    cv::cvtColor( _orig_small, _orig_small, cv::COLOR_RGBA2RGB);
-    _small_img = _orig_small.clone();
-    cv::cvtColor( _small_img, _gray, cv::COLOR_RGB2GRAY);
+    // Stage outputs live in the workspace. Bind them before writing.
+    cv::Mat &rgb = _ws.get( WS_ORIG_SMALL, sz, CV_8UC3);
+    cv::cvtColor( _orig_small, rgb, cv::COLOR_RGBA2RGB);
+    _orig_small = rgb;
+    _gray = _ws.get( WS_GRAY, sz, CV_8UC1);
+    _gray_threshed = _ws.get( WS_GRAY_THRESHED, sz, CV_8UC1);
+    // Normalize image
+    if (_lumaOnly) {
+        // Geometry only needs gray. Color gets equalized in f06, if we get that far.
+        _small_img.release(); // made in f06
+        if (_ingestGray.size() == sz) {
+            // Ingest made it in the same pass as the color image
+            _clahe.apply_gray( _ingestGray, _gray, _videoFrame);
+        }
+        else {
+            cv::cvtColor( _orig_small, _gray, cv::COLOR_RGB2GRAY);
+            _clahe.apply_gray( _gray, _gray, _videoFrame);
+        }
+    }
+    else {
+        [self equalize_color];
+        _small_img = _ws.get( WS_SMALL_IMG, sz, CV_8UC3);
+        _orig_small.copyTo( _small_img);
+        cv::cvtColor( _orig_small, _gray, cv::COLOR_RGB2GRAY);
+    }
     thresh_dilate( _gray, _gray_threshed, 10 /*14*/);
     _stone_or_empty.clear();
-    BlobFinder::find_empty_places( _gray_threshed, _stone_or_empty); // has to be first
+    _blobFinder.find_empty_places( _gray_threshed, _stone_or_empty, _ws); // has to be first
     BlobFinder::find_stones( _gray, _stone_or_empty);
     //_stone_or_empty = BlobFinder::clean( _stone_or_empty);
     
     // Find lines
-    rough_houghlines( _small_img, _stone_or_empty,
-                     _vertical_lines, _horizontal_lines);
+    rough_houghlines( _gray, _stone_or_empty,
+                     _vertical_lines, _horizontal_lines, 10, &_ws.get( WS_HOUGH_ROUGH));
 
 } // f00_dots_and_verticals()
 
+// Run clahe on the color image, once per frame
+//------------------------------------------------
+- (void) equalize_color
+{
+    if (_colorEqualized) return;
+    _clahe.apply_color( _orig_small, _orig_small, _videoFrame);
+    _colorEqualized = true;
+    _nequalized++;
+} // equalize_color()
+
+// Something to draw debug output on. In luma only mode there is
+// no color image before f06, so use the gray one.
+//---------------------------------------------------------------
+- (cv::Mat) stage_canvas
+{
+    cv::Mat res;
+    if (_small_img.empty()) {
+        cv::cvtColor( _gray, res, cv::COLOR_GRAY2RGB);
+    }
+    else {
+        res = _small_img.clone();
+    }
+    return res;
+} // stage_canvas()
+
 // Debug wrapper for f00_dots_and_verticals
 //--------------------------------------------
 - (UIImage *) f00_dots_and_verticals_dbg
@@ -211,7 +398,7 @@ extern cv::Mat mat_dbg;
     [self f00_dots_and_verticals];
     
     cv::Mat drawing;
-    drawing = _small_img.clone();
+    drawing = [self stage_canvas];
     // cv::cvtColor( _gray_threshed, drawing, cv::COLOR_GRAY2RGB);
     draw_points( _stone_or_empty, drawing, 2, cv::Scalar( 255,0,0));
     get_color(true);
@@ -228,28 +415,59 @@ extern cv::Mat mat_dbg;
 {
     //NSLog(@"f02");
     const cv::Size sz( _orig_small.cols, _orig_small.rows);
+    // In luma only mode, we warp the gray image and leave color for f06
+    cv::Mat &img = _lumaOnly ? _gray : _small_img;
     
-    // Straighten horizontals
-    straight_rotation( sz, _horizontal_lines, _theta, _Ms, _invRot);
-    cv::warpAffine( _small_img, _small_img, _Ms, sz);
-    warp_plines( _vertical_lines, _Ms, _vertical_lines);
-    
-    // Unwarp verticals
-    parallel_projection( sz, _vertical_lines, _phi, _Mp, _invProj);
-    cv::warpPerspective( _small_img, _small_img, _Mp, sz);
+    if (_vanishingPoints &&
+        vanishing_projection( sz, _horizontal_lines, _vertical_lines, _stone_or_empty, _theta, _Mp, _invProj)) {
+        // One homography does it all. No separate rotation.
+        _Ms = cv::getRotationMatrix2D( cv::Point2f( sz.width/2.0, sz.height/2.0), 0, 1.0);
+        _invRot = _Ms.clone();
+        _phi = 0;
+    }
+    else {
+        // Straighten horizontals
+        straight_rotation( sz, _horizontal_lines, _theta, _Ms, _invRot);
+        // Warping in place would copy the source first, so go through workspace buffers
+        cv::Mat &rotated = _ws.get_like( WS_ROTATED, img);
+        cv::warpAffine( img, rotated, _Ms, sz);
+        img = rotated;
+        warp_plines( _vertical_lines, _Ms, _vertical_lines);
+        
+        // Unwarp verticals
+        parallel_projection( sz, _vertical_lines, _phi, _Mp, _invProj);
+    }
+    cv::Mat &projected = _ws.get_like( WS_PROJECTED, img);
+    cv::warpPerspective( img, projected, _Mp, sz);
+    img = projected;
     warp_plines( _vertical_lines, _Mp, _vertical_lines);
 
-    // Find lines
-    std::vector<cv::Vec2f> hlines, vlines;
-    perp_houghlines( _small_img, _stone_or_empty,
-                    vlines, hlines);
-    dedup_verticals( vlines, _small_img);
-    
-    // Scale so line distance is CROPSIZE
-    fix_vertical_distance( vlines, _small_img, _scale, _Md, _invMd);
+    // Scale so line distance is CROPSIZE. Get the pitch from the spectrum
+    // of the blob x coordinates. If that fails, from the verticals.
+    Points pts;
+    warp_points( _stone_or_empty, _Ms, pts);
+    warp_points( pts, _Mp, pts);
+    double pitch;
+    if (fft_pitch( vec_extract( pts, [](cv::Point p) { return p.x; }), 8, 20, pitch)) {
+        // The scaled size changes with the pitch. A growing buffer avoids reallocations.
+        cv::Mat scaled = _ws.get_view( WS_SCALED, pitch_scaled_size( pitch, sz), img.type());
+        pitch_scale( pitch, img, scaled, _scale, _Md, _invMd);
+        img = scaled;
+    }
+    else {
+        std::vector<cv::Vec2f> hlines, vlines;
+        perp_houghlines( img, pts, vlines, hlines, 10, &_ws.get( WS_HOUGH_FALLBACK));
+        dedup_verticals( vlines, img);
+        cv::Mat &scaled = _ws.get( WS_SCALED_FALLBACK);
+        fix_vertical_distance( vlines, img, scaled, _scale, _Md, _invMd);
+        img = scaled;
+    }
     warp_plines( _vertical_lines, _Md, _vertical_lines);
     
-    cv::cvtColor( _small_img, _gray, cv::COLOR_RGB2GRAY);
+    if (!_lumaOnly) {
+        _gray = _ws.get_view( WS_GRAY_SCALED, _small_img.size(), CV_8UC1);
+        cv::cvtColor( _small_img, _gray, cv::COLOR_RGB2GRAY);
+    }
 } // f02_warp()
 
 // Debug wrapper for f02_warp
@@ -259,7 +477,7 @@ extern cv::Mat mat_dbg;
     g_app.mainVC.lbBottom.text = @"Unwarp";
     [self f02_warp];
 
-    cv::Mat drawing = _small_img.clone();
+    cv::Mat drawing = [self stage_canvas];
     get_color(true);
     ISLOOP( _vertical_lines) {
         draw_polar_line( _vertical_lines[i], drawing, get_color());
@@ -288,16 +506,17 @@ extern cv::Mat mat_dbg;
     _stone_or_empty.clear();
     _vertical_lines.clear();
     _horizontal_lines.clear();
-    cv::cvtColor( _small_img, _gray, cv::COLOR_RGB2GRAY);
+    _gray_threshed = _ws.get_view( WS_GRAY_THRESHED_SCALED, _gray.size(), CV_8UC1);
     thresh_dilate( _gray, _gray_threshed, 3);
-    BlobFinder::find_empty_places_perp ( _gray_threshed, _stone_or_empty); // has to be first
+    _blobFinder.find_empty_places_perp( _gray_threshed, _stone_or_empty, _ws); // has to be first
     BlobFinder::find_stones_perp( _gray, _stone_or_empty);
     vapp( _stone_or_empty, old_points);
     //_stone_or_empty = BlobFinder::clean( _stone_or_empty);
 
     // Find lines
-    perp_houghlines( _small_img, _stone_or_empty,
-                    _vertical_lines, _horizontal_lines);
+    cv::Mat canvas = _ws.get_view( WS_HOUGH_PERP, _gray.size(), CV_8UC1);
+    perp_houghlines( _gray, _stone_or_empty,
+                    _vertical_lines, _horizontal_lines, 10, &canvas);
 } // f03_houghlines()
 
 // Debug wrapper for f03_blobs
@@ -309,7 +528,7 @@ extern cv::Mat mat_dbg;
     
     // Show results
     cv::Mat drawing;
-    drawing = _small_img.clone();
+    drawing = [self stage_canvas];
     //cv::cvtColor( _gray_threshed, drawing, cv::COLOR_GRAY2RGB);
     draw_points( _stone_or_empty, drawing, 3, cv::Scalar( 255,0,0));
     UIImage *res = MatToUIImage( drawing);
@@ -322,11 +541,10 @@ extern cv::Mat mat_dbg;
 - (void) f04_vert_lines:(int)state
 {
     //NSLog(@"f04");
-    static std::vector<cv::Vec2f> all_vert_lines;
     switch (state) {
         case 0:
         {
-            all_vert_lines = _vertical_lines;
+            // Verticals as they come from f03_houghlines
             break;
         }
         case 1:
@@ -343,7 +561,7 @@ extern cv::Mat mat_dbg;
         case 2:
         {
             const double x_thresh = CROPSIZE * 0.2; // small values prefer synthesized lines over real ones
-            fix_vertical_lines( _vertical_lines, all_vert_lines, _gray, x_thresh);
+            fix_vertical_lines( _vertical_lines, _gray, x_thresh, _boardSize);
             break;
         }
         default:
@@ -407,11 +625,10 @@ extern cv::Mat mat_dbg;
 - (void) f05_horiz_lines:(int)state
 {
     //NSLog(@"f05");
-    static std::vector<cv::Vec2f> all_horiz_lines;
     switch (state) {
         case 0:
         {
-            all_horiz_lines = _horizontal_lines;
+            // Horizontals as they come from f03_houghlines
             break;
         }
         case 1:
@@ -427,7 +644,7 @@ extern cv::Mat mat_dbg;
         case 2:
         {
             const double y_thresh = CROPSIZE * 0.2; // small values prefer synthesized lines over real ones
-            fix_horizontal_lines( _horizontal_lines, all_horiz_lines, _gray, y_thresh);
+            fix_horizontal_lines( _horizontal_lines, _gray, y_thresh, _boardSize);
             break;
         }
         default:
@@ -493,16 +710,24 @@ extern cv::Mat mat_dbg;
     //NSLog(@"f06");
     _intersections = get_intersections( _horizontal_lines, _vertical_lines);
     _corners.clear();
-    cv::Mat boardness;
+    cv::Mat &boardness = _ws.get( WS_BOARDNESS);
+    const BoardGates gates = board_gates( _boardSize);
     do {
-        if (SZ( _horizontal_lines) > 55) break;
-        if (SZ( _horizontal_lines) < 19) break; // @change
-        if (SZ( _vertical_lines) > 55) break;
-        if (SZ( _vertical_lines) < 19) break; // @change
+        if (SZ( _horizontal_lines) > gates.max_lines) break;
+        if (SZ( _horizontal_lines) < gates.min_lines) break; // @change
+        if (SZ( _vertical_lines) > gates.max_lines) break;
+        if (SZ( _vertical_lines) < gates.min_lines) break; // @change
+        if (_lumaOnly) {
+            // The only color warp in luma only mode, straight from the source
+            [self equalize_color];
+            cv::Mat M = compose_warps( _Ms, _Mp, _Md);
+            _small_img = _ws.get_view( WS_SMALL_IMG_SCALED, _gray.size(), CV_8UC3);
+            cv::warpPerspective( _orig_small, _small_img, M, _gray.size());
+        }
         // Get boardness per pixel
         [self nn_boardness:_small_img dst:boardness];
         // Corners maximize boardness
-        _corners = find_corners_from_score( _horizontal_lines, _vertical_lines, _intersections, boardness);
+        _corners = find_corners_from_score( _horizontal_lines, _vertical_lines, _intersections, boardness, _boardSize);
         // Intersections for only the board lines
         _intersections = get_intersections( _horizontal_lines, _vertical_lines);
     } while(0);
@@ -514,7 +739,7 @@ extern cv::Mat mat_dbg;
 {
     g_app.mainVC.lbBottom.text = @"Find corners";
     [self f06_corners];
-    cv::Mat disp = _small_img.clone();
+    cv::Mat disp = [self stage_canvas];
     if (SZ( _corners) == 4) {
         int rad = 3;
         draw_point( _corners[0], disp, rad, cv::Scalar(255,0,0));
@@ -531,18 +756,19 @@ extern cv::Mat mat_dbg;
 - (void) f07_zoom_in
 {
     NSLog(@"f07");
-    cv::Mat threshed;
-    cv::Mat dst;
     if (SZ(_corners) == 4) {
         cv::Size sz( _orig_small.cols, _orig_small.rows);
         cv::Mat M;
-        zoom_in( _corners, M);
+        zoom_in( _corners, M, _boardSize);
         cv::perspectiveTransform( _corners, _corners_zoomed, M);
         cv::perspectiveTransform( _intersections, _intersections_zoomed, M);
         // Do the image zoom directly from source, to reduce loss through repeated transforms
         Points2f orig_corners;
         unwarp_points( _invProj, _invRot, _invMd, _corners, orig_corners);
         M = cv::getPerspectiveTransform( orig_corners, _corners_zoomed);
+        [self equalize_color];
+        _small_zoomed = _ws.get( WS_SMALL_ZOOMED, sz, CV_8UC3);
+        _gray_zoomed = _ws.get( WS_GRAY_ZOOMED, sz, CV_8UC1);
         cv::warpPerspective( _orig_small, _small_zoomed, M, sz);
         cv::cvtColor( _small_zoomed, _gray_zoomed, cv::COLOR_RGB2GRAY);
     }
@@ -577,6 +803,7 @@ extern cv::Mat mat_dbg;
     NSLog(@"f08 after unwarp");
     fix_diagram( _diagram, orig_intersections, _orig_small); //_small_img);
     NSLog(@"f08 after fix");
+    [self diagram_changed];
 } // f08_classify()
 
 // Debug wrapper for f08_classify
@@ -593,7 +820,7 @@ extern cv::Mat mat_dbg;
     
     Points2f dummy;
     double dxd, dyd;
-    get_intersections_from_corners( _corners_zoomed, BOARD_SZ, dummy, dxd, dyd);
+    get_intersections_from_corners( _corners_zoomed, _boardSize, dummy, dxd, dyd);
     //int dx = ROUND( dxd/4.0);
     //int dy = ROUND( dyd/4.0);
     ISLOOP (_diagram) {
@@ -620,33 +847,27 @@ extern cv::Mat mat_dbg;
 {
     int turn = BBLACK;
     g_app.mainVC.lbBottom.text = @"";
-    [g_app.saveDiscardVC askRemoteBotTerr:turn
-                                     komi:7.5
-                                 handicap:0
-                               completion:^{
-        // Get next move and score from remote bot
-        [g_app.saveDiscardVC askRemoteBotMove:turn
-                          komi:7.5
-                      handicap:0
-                    completion:^{
-            NSString *tstr = nsprintf( @"P(B wins)=%.2f", g_app.saveDiscardVC.winprob);
-            double score = g_app.saveDiscardVC.score;
-             if (score > 0) {
-                 tstr = nsprintf( @" %@ B+%.1f", tstr, fabs( score));
-             } else {
-                 tstr = nsprintf( @" %@ W+%.1f", tstr, fabs( score));
-             }
-            g_app.mainVC.lbBottom.text = tstr;
-            double *terrmap = cterrmap( g_app.saveDiscardVC.terrmap);
-            NSString *sgf = [self get_sgf];
-            UIImage *scoreImg = [CppInterface nextmove2img:sgf
-                                            coords:g_app.saveDiscardVC.best_ten_moves
-                                             color:turn
-                                           terrmap:terrmap
-                         ];
-            completion( scoreImg);
-        }]; // askRemoteBotMove
-    }]; // askRemoteBotTerr
+    [g_app.saveDiscardVC askRemoteBot:turn
+                                 komi:7.5
+                             handicap:0
+                           completion:^{
+        NSString *tstr = nsprintf( @"P(B wins)=%.2f", g_app.saveDiscardVC.winprob);
+        double score = g_app.saveDiscardVC.score;
+        if (score > 0) {
+            tstr = nsprintf( @" %@ B+%.1f", tstr, fabs( score));
+        } else {
+            tstr = nsprintf( @" %@ W+%.1f", tstr, fabs( score));
+        }
+        g_app.mainVC.lbBottom.text = tstr;
+        double *terrmap = cterrmap( g_app.saveDiscardVC.terrmap);
+        NSString *sgf = [self get_sgf];
+        UIImage *scoreImg = [CppInterface nextmove2img:sgf
+                                                coords:g_app.saveDiscardVC.best_ten_moves
+                                                 color:turn
+                                               terrmap:terrmap
+                             ];
+        completion( scoreImg);
+    }]; // askRemoteBot
 } // f09_score_dbg()
 
 //=== Production Flow ===
@@ -658,26 +879,25 @@ extern cv::Mat mat_dbg;
 - (bool)find_board:(cv::Mat)small_img breakIfBad:(bool)breakIfBad
 {
     bool success = false;
+    const BoardGates gates = board_gates( _boardSize);
     do {
         _orig_small = small_img;
         [self f00_dots_and_verticals];
-        if (breakIfBad && SZ( _vertical_lines) < 19) break;
-        if (breakIfBad && SZ( _horizontal_lines) < 19) break;
+        if (breakIfBad && SZ( _vertical_lines) < gates.min_lines) break;
+        if (breakIfBad && SZ( _horizontal_lines) < gates.min_lines) break;
         [self f02_warp];
         [self f03_houghlines];
-        if (breakIfBad && SZ(_stone_or_empty) < 0.5 * SQR(BOARD_SZ)) break;
-        [self f04_vert_lines:0];
+        if (breakIfBad && SZ(_stone_or_empty) < gates.min_blobs) break;
         [self f04_vert_lines:1];
         [self f04_vert_lines:2];
         //[self f04_vert_lines:3];
-        if (breakIfBad && SZ( _vertical_lines) > 55) break;
-        if (breakIfBad && SZ( _vertical_lines) < 19) break;
-        [self f05_horiz_lines:0];
+        if (breakIfBad && SZ( _vertical_lines) > gates.max_lines) break;
+        if (breakIfBad && SZ( _vertical_lines) < gates.min_lines) break;
         [self f05_horiz_lines:1];
         [self f05_horiz_lines:2];
         //[self f05_horiz_lines:3];
-        if (breakIfBad && SZ( _horizontal_lines) > 55) break;
-        if (breakIfBad && SZ( _horizontal_lines) < 19) break;
+        if (breakIfBad && SZ( _horizontal_lines) > gates.max_lines) break;
+        if (breakIfBad && SZ( _horizontal_lines) < gates.min_lines) break;
         [self f06_corners];
 //        if (SZ(_corners) == 4) {
 //            NSLog( @"---------------------------------");
@@ -691,6 +911,20 @@ extern cv::Mat mat_dbg;
     return success;
 } // find_board()
 
+// Update the hashes after _diagram changed
+//---------------------------------------------
+- (void) diagram_changed
+{
+    _diagramHash = diagram_hash( _diagram, _boardSize);
+} // diagram_changed()
+
+// Hash of the current diagram, as is
+//--------------------------------------
+- (uint64_t) diagram_hash
+{
+    return _diagramHash;
+} // diagram_hash()
+
 // Recognize position in image. Result goes into _diagram.
 // Returns true on success.
 //---------------------------------------------------------------------------
@@ -700,7 +934,9 @@ extern cv::Mat mat_dbg;
     if (small_img.rows == 0 || small_img.cols == 0) {
         return false;
     }
-    _diagram = std::vector<int> ( BOARD_SZ * BOARD_SZ, EEMPTY);
+    _diagram = std::vector<int> ( _boardSize * _boardSize, EEMPTY);
+    [self diagram_changed];
+    _ws.begin_frame();
     do {
         success = [self find_board:small_img breakIfBad:breakIfBad];
         if (breakIfBad && !success) break;
@@ -708,6 +944,7 @@ extern cv::Mat mat_dbg;
         [self f08_classify];
         success = true;
     } while(0);
+    _ws.end_frame();
     return success;
 } // recognize_position()
 
@@ -716,40 +953,116 @@ extern cv::Mat mat_dbg;
 //--------------------------------------------------------
 - (UIImage *) video_mode
 {
-    cv::Mat _small_img = _imgQ.back().clone();
-    bool success = [self find_board:_small_img breakIfBad:YES];
+    cv::Mat small_img = _imgQ.back().clone();
+    Points2f my_corners, my_intersections;
+    bool success = [self board_in_frame:small_img gray:cv::Mat() corners:my_corners intersections:my_intersections];
 
     // Draw real time results on screen
     //------------------------------------
     cv::Mat canvas;
     canvas = _orig_small;
-    
     if (success) {
-        Points2f my_corners, my_intersections;
-        unwarp_points( _invProj, _invRot, _invMd, _corners, my_corners);
-        unwarp_points( _invProj, _invRot, _invMd, _intersections, my_intersections);
-        if (SZ(my_corners) == 4) {
-            if (corners_on_image(my_corners, _orig_small)) {
-                draw_line( cv::Vec4f( my_corners[0].x, my_corners[0].y, my_corners[1].x, my_corners[1].y),
-                          canvas, cv::Scalar( 255,0,0,255));
-                draw_line( cv::Vec4f( my_corners[1].x, my_corners[1].y, my_corners[2].x, my_corners[2].y),
-                          canvas, cv::Scalar( 255,0,0,255));
-                draw_line( cv::Vec4f( my_corners[2].x, my_corners[2].y, my_corners[3].x, my_corners[3].y),
-                          canvas, cv::Scalar( 255,0,0,255));
-                draw_line( cv::Vec4f( my_corners[3].x, my_corners[3].y, my_corners[0].x, my_corners[0].y),
-                          canvas, cv::Scalar( 255,0,0,255));
-                
-                ISLOOP (my_intersections) {
-                    draw_point( my_intersections[i], canvas, 2, cv::Scalar(0,0,255,255));
-                }
-            }
-        } // if (SZ(my_corners) == 4)
+        draw_board_overlay( canvas, my_corners, my_intersections);
     }
-    
     UIImage *res = MatToUIImage( canvas);
     return res;
 } // video_mode()
 
+// Find the board in a video frame. Corners and intersections in frame coordinates.
+// Cheap: follow the board from the last frame. Expensive: detect from scratch.
+// gray is small_img in gray, if we have it from ingest. Else pass an empty Mat.
+//------------------------------------------------------------------------------------------------
+- (bool) board_in_frame:(cv::Mat)small_img gray:(cv::Mat)gray
+                corners:(Points2f &)corners intersections:(Points2f &)intersections
+{
+    _ws.begin_frame();
+    _videoFrame = true;
+    _ingestGray = (gray.size() == small_img.size()) ? gray : cv::Mat();
+    const cv::Mat &track_img = _ingestGray.empty() ? small_img : _ingestGray;
+    bool success = _tracker.track( track_img, corners, intersections);
+    if (success) {
+        _orig_small = small_img;
+        _colorEqualized = false;
+    }
+    else {
+        success = [self find_board:small_img breakIfBad:YES];
+        if (success) {
+            unwarp_points( _invProj, _invRot, _invMd, _corners, corners);
+            unwarp_points( _invProj, _invRot, _invMd, _intersections, intersections);
+            // Lock on the raw frame. _orig_small went through clahe by now, and the
+            // next track() gets a raw frame. Flow needs the same brightness in both.
+            if (SZ(corners) == 4 && SZ(intersections) == SQR(_boardSize) &&
+                corners_on_image( corners, small_img))
+            {
+                _tracker.lock( track_img, corners, intersections);
+            }
+        }
+    }
+    _ingestGray.release();
+    _videoFrame = false;
+    _ws.end_frame();
+    return success;
+} // board_in_frame()
+
+// Feed a video frame into the threaded pipeline. Starts the pipeline if needed.
+// Stages: preprocess -> find board -> draw overlay. Each on its own thread.
+// Video mode does not classify stones, so there is no classification stage.
+//--------------------------------------------------------------------------------
+- (void) video_push:(CameraFrame *)cframe show:(CICompletionHandler)show
+{
+    if (!_pipeline) {
+        _pipeline = std::make_shared<VideoPipeline>();
+    }
+    if (!_pipeline->running()) {
+        __weak CppInterface *wself = self;
+        std::vector<VideoPipeline::Stage> stages = {
+            // Preprocess. Resize and color conversion already happened in ingest.
+            // Feeds the image q for the camera button.
+            [wself](VideoFrame &f) {
+                CppInterface *sself = wself;
+                if (!sself) return false;
+                [sself qMat:f.img.clone()];
+                return true;
+            },
+            // Find board. Only this thread touches the engine state.
+            [wself](VideoFrame &f) {
+                CppInterface *sself = wself;
+                if (!sself) return false;
+                @autoreleasepool {
+                    f.found = [sself board_in_frame:f.img gray:f.gray corners:f.corners intersections:f.intersections];
+                }
+                return true;
+            },
+            // Overlay
+            [](VideoFrame &f) {
+                if (f.found) {
+                    draw_board_overlay( f.img, f.corners, f.intersections);
+                }
+                return true;
+            }
+        };
+        _pipeline->start( stages, [show](VideoFrame &f) {
+            @autoreleasepool {
+                UIImage *res = MatToUIImage( f.img);
+                dispatch_async( dispatch_get_main_queue(), ^{ show( res); });
+            }
+        });
+    }
+    VideoFrame frame;
+    frame.img = cframe->rgb;
+    frame.gray = cframe->gray;
+    _pipeline->push( std::move( frame));
+} // video_push()
+
+// Stop the video pipeline and wait for its threads
+//----------------------------------------------------
+- (void) video_stop
+{
+    if (_pipeline) {
+        _pipeline->stop();
+    }
+} // video_stop()
+
 // Find the best frame in the queue and process it.
 // Called when the camera button is pressed.
 //----------------------------------------------------
@@ -765,7 +1078,7 @@ extern cv::Mat mat_dbg;
         cv::cvtColor( _small_img, _gray, cv::COLOR_RGB2GRAY);
         thresh_dilate( _gray, _gray_threshed, 10);
         _stone_or_empty.clear();
-        BlobFinder::find_empty_places( _gray_threshed, _stone_or_empty); // has to be first
+        _blobFinder.find_empty_places( _gray_threshed, _stone_or_empty, _ws); // has to be first
         BlobFinder::find_stones( _gray, _stone_or_empty);
         //_stone_or_empty = BlobFinder::clean( _stone_or_empty);
         if (SZ(_stone_or_empty) > maxBlobs) {
@@ -790,27 +1103,19 @@ extern cv::Mat mat_dbg;
 //----------------------------------------------------------------------------------
 - (MLMultiArray *) MultiArrayFromCVMat:(cv::Mat)cvMat memId:(NSString *)memId
 {
-    // Get target memory
-    static NSMutableDictionary *memDict = [NSMutableDictionary new];
-    if (memDict[memId] == nil) {
-        int size = 3 * cvMat.rows * cvMat.cols * sizeof(Float32);
+    // Get target memory. The models keep pointing at it, so it never moves.
+    std::vector<Float32> &buf = _nnmem[[memId UTF8String]];
+    if (buf.empty()) {
+        int size = 3 * cvMat.rows * cvMat.cols;
         size *= 2; // paranoia
-        void *mem = malloc(size);
-        memDict[memId] = [NSValue valueWithPointer:mem];
+        buf.resize( size);
     }
+    void *mem = buf.data();
+
+    // Normalize (x - 128) / 128 straight into the network memory, in float32
+    to_nn_input( cvMat, (float *)mem);
 
-    // Split and normalize
-    cv::Mat channels[3];
-    cv::split( cvMat, channels);
-    channels[0].convertTo( channels[0], CV_64FC1);
-    channels[0] -= 128.0; channels[0] /= 128.0;
-    channels[1].convertTo( channels[1], CV_64FC1);
-    channels[1] -= 128.0; channels[1] /= 128.0;
-    channels[2].convertTo( channels[2], CV_64FC1);
-    channels[2] -= 128.0; channels[2] /= 128.0;
-    
     // Make MLMultiArray
-    void *mem = [memDict[memId] pointerValue];
     NSArray *shape = @[@(1),@(cvMat.rows), @(cvMat.cols), @(3)];
     NSArray *strides = @[@(cvMat.cols*cvMat.rows*3), @(cvMat.cols*3), @(3), @(1)];
     MLMultiArray *res = [[MLMultiArray alloc] initWithDataPointer:mem
@@ -820,34 +1125,21 @@ extern cv::Mat mat_dbg;
                                                       deallocator:^(void * _Nonnull bytes) {}
                                                             error:nil];
     
-    // Copy data over from cvMat
-    Float32 *dmem = (Float32 *)mem;
-    double *chan0 = channels[0].ptr<double>(0);
-    double *chan1 = channels[1].ptr<double>(0);
-    double *chan2 = channels[2].ptr<double>(0);
-    RLOOP(cvMat.rows) {
-        CLOOP(cvMat.cols) {
-            Float32 *p = dmem + r*cvMat.cols*3 + c*3;
-            *p++ = chan0[r*cvMat.cols + c];
-            *p++ = chan1[r*cvMat.cols + c];
-            *p++ = chan2[r*cvMat.cols + c];
-        } // cols
-    } // rows
     return res;
 } // MultiArrayFromCVMat()
 
 // Get one channel out of a MultiArray into a single channel float32 cv::Mat.
-// Only used on nn_io model output, therefore fixed mem size.
-// src has 2 channels of float32.
+// Only used on nn_io model output. src has 2 channels of float32.
 //----------------------------------------------------------------------------------------
 - (void) CVMatFromMultiArray:(MLMultiArray *)src channel:(int)channel dst:(cv::Mat &)dst
 {
-    static Float32 mem[IMG_WIDTH * IMG_HEIGHT]; // way too large, but hey
     const int channels = 2;
 
     int rows = [src.shape[1] intValue]; // 116
     int cols = [src.shape[2] intValue]; // 87
     
+    dst.create( rows, cols, CV_32FC1);
+    Float32 *mem = dst.ptr<Float32>(0);
     Float32 *data = (Float32 *)src.dataPointer;
     int i = 0;
     RLOOP( rows) {
@@ -856,8 +1148,6 @@ extern cv::Mat mat_dbg;
             mem[i++] = *p;
         }
     }
-    dst = cv::Mat( rows, cols, CV_32FC1, (char*)mem);
-    dst = dst.clone();
 } // CVMatFromMultiArray()
 
 // Classify intersections with Keras Model
@@ -897,16 +1187,18 @@ extern cv::Mat mat_dbg;
 - (void) nn_boardness: (const cv::Mat&)src dst:(cv::Mat&)dst
 {
     // Rescale img to 350x466
-    cv::Mat src_resized;
+    cv::Mat &src_resized = _ws.get( WS_NN_INPUT, IMG_HEIGHT, IMG_WIDTH, src.type());
     resize_transform( src, src_resized, IMG_WIDTH, IMG_HEIGHT);
     //  Feed it to the model
     MLMultiArray *nn_io_input = [self MultiArrayFromCVMat:src_resized memId:@"io_input"];
     MLMultiArray *featMap = [_boardModel featureMap:nn_io_input];
     // Back to cv::Mat
-    cv::Mat feat_on, feat_off, feat;
+    cv::Mat &feat_on = _ws.get( WS_FEAT_ON);
+    cv::Mat &feat_off = _ws.get( WS_FEAT_OFF);
+    cv::Mat &feat = _ws.get( WS_FEAT);
     [self CVMatFromMultiArray:featMap channel:0 dst:feat_on];
     [self CVMatFromMultiArray:featMap channel:1 dst:feat_off];
-    feat = feat_on - feat_off;
+    cv::subtract( feat_on, feat_off, feat);
     //feat = feat_on; // prob to be inside the board
     // Scale to [0..255]
     double mmin, mmax;
@@ -914,9 +1206,10 @@ extern cv::Mat mat_dbg;
     feat -= mmin;
     feat *= 255.0 / (mmax - mmin);
     // Resize to original size
-    resize_transform( feat, dst, src.cols, src.rows);
-    // Back to uint8
-    dst.convertTo( dst, CV_8UC1);
+    cv::Mat &feat_resized = _ws.get( WS_FEAT_RESIZED);
+    resize_transform( feat, feat_resized, src.cols, src.rows);
+    // Back to uint8. Not in place, that would reallocate.
+    feat_resized.convertTo( dst, CV_8UC1);
 } // nn_boardness()
 
 //=== Sgf ===
@@ -928,18 +1221,22 @@ extern cv::Mat mat_dbg;
 {
     Points2f unwarped_intersections;
     unwarp_points( _invProj, _invRot, _invMd, _intersections, unwarped_intersections);
-    std::string sgf_ = generate_sgf( "", _diagram, unwarped_intersections, _phi, _theta);
-    NSString *sgf = [NSString stringWithUTF8String:sgf_.c_str()];
+    _sgfWriter.clear();
+    generate_sgf( _sgfWriter, "", _diagram, unwarped_intersections, _phi, _theta, _boardSize);
     
-    NSString *oldsgf = [NSString stringWithContentsOfFile:fname encoding:NSUTF8StringEncoding error:NULL];
-    // Just use the new GC tag, keep the old sgf
-    if (oldsgf && !overwrite) {
-        NSString *gc = [CppInterface get_sgf_tag:@"GC" sgf:sgf];
-        sgf = [CppInterface set_sgf_tag:@"GC" sgf:oldsgf val:gc];
+    NSString *oldsgf = overwrite ? nil :
+    [NSString stringWithContentsOfFile:fname encoding:NSUTF8StringEncoding error:NULL];
+    if (!oldsgf) {
+        // Straight from the buffer to the file
+        _sgfWriter.write_file( [fname UTF8String]);
+        return;
     }
-    NSError *error;
-    [sgf writeToFile:fname
-          atomically:YES encoding:NSUTF8StringEncoding error:&error];
+    // Just use the new GC tag, keep the old sgf
+    std::string gc = get_sgf_tag( _sgfWriter.str(), "GC");
+    std::string sgf = set_sgf_tag( [oldsgf UTF8String], "GC", gc);
+    _sgfWriter.clear();
+    _sgfWriter.raw( sgf);
+    _sgfWriter.write_file( [fname UTF8String]);
 } // save_current_sgf()
 
 // Get current diagram as sgf
@@ -948,7 +1245,9 @@ extern cv::Mat mat_dbg;
 {
     Points2f unwarped_intersections;
     unwarp_points( _invProj, _invRot, _invMd, _intersections, unwarped_intersections);
-    return @(generate_sgf( "", _diagram, unwarped_intersections, _phi, _theta).c_str());
+    _sgfWriter.clear();
+    generate_sgf( _sgfWriter, "", _diagram, unwarped_intersections, _phi, _theta, _boardSize);
+    return @(_sgfWriter.c_str());
 } // get_sgf()
 
 // Convert current diagram to a sequence of moves I can feed to a bot
@@ -961,10 +1260,10 @@ extern cv::Mat mat_dbg;
     std::vector<std::string> bmoves;
     
     ISLOOP (_diagram) {
-        int row = i / BOARD_SZ;
-        int col = i % BOARD_SZ;
+        int row = i / _boardSize;
+        int col = i % _boardSize;
         char buf[10];
-        snprintf( buf, 10, "%c%d", colchars[col], BOARD_SZ-row);
+        snprintf( buf, 10, "%c%d", colchars[col], _boardSize-row);
         std::string movestr = buf;
         if (_diagram[i] == WWHITE) { wmoves.push_back( movestr); }
         else if (_diagram[i] == BBLACK) { bmoves.push_back( movestr); }
@@ -1011,11 +1310,45 @@ extern cv::Mat mat_dbg;
     return sgf;
 } // get_sgf_for_img()
 
+// Make a game record from a video file. Returns the sgf, or nil if there was no board.
+//------------------------------------------------------------------------------------------
+- (NSString *) record_video:(NSString *)fname
+{
+    BoardLocator locate = [self](const cv::Mat &rgb, Points2f &corners) {
+        cv::Mat rgba;
+        cv::cvtColor( rgb, rgba, cv::COLOR_RGB2RGBA);
+        _ws.begin_frame();
+        _videoFrame = true;
+        bool success = [self find_board:rgba breakIfBad:YES];
+        _videoFrame = false;
+        _ws.end_frame();
+        if (!success || SZ(_corners) != 4) return false;
+        unwarp_points( _invProj, _invRot, _invMd, _corners, corners);
+        return corners_on_image( corners, rgb);
+    };
+    StoneClassifier classify = [self](const cv::Mat &crop) {
+        MLMultiArray *nn_bew_input = [self MultiArrayFromCVMat:crop memId:@"bew_input"];
+        return [_stoneModel classify:nn_bew_input];
+    };
+    // The classifier was trained on equalized crops, as f07_zoom_in makes them.
+    // find_board equalizes on its own and gets the raw frame.
+    FramePrep prep = [self](cv::Mat &rgb) { _clahe.apply_color( rgb, rgb, true); };
+    
+    std::string sgf;
+    RecordStats stats;
+    bool success = record_video( [fname UTF8String], _boardSize, locate, classify, sgf, &stats, prep);
+    _recordStats = nsprintf( @"%d frames, %d lost, %d occluded, %ld crops classified, %d moves, %.0f ms",
+                            stats.frames, stats.lost, stats.occluded, stats.classified, stats.moves, stats.ms);
+    NSLog( @"record_video: %@", _recordStats);
+    if (!success) return nil;
+    return @(sgf.c_str());
+} // record_video()
+
 // Get an empty sgf
 //-------------------------
 - (NSString *) empty_sgf
 {
-    return @(generate_sgf( "").c_str());
+    return @(generate_sgf( "", std::vector<int>(), Points2f(), 0, 0, _boardSize).c_str());
 } // empty_sgf()
 
 // Convert sgf string to UIImage
@@ -1036,8 +1369,9 @@ extern cv::Mat mat_dbg;
 {
     if (!sgf) sgf = @"";
     cv::Mat m;
+    const int boardsz = sgf_board_size( [sgf UTF8String]);
     draw_sgf( [sgf UTF8String], m,  1.5 * IMG_WIDTH);
-    if (terrmap) { draw_score( m, terrmap); }
+    if (terrmap) { draw_score( m, terrmap, boardsz); }
     double mmax = [coords[0][@"psv"] doubleValue];
     char letter = 'a';
     for ( NSDictionary *coord in coords) {
@@ -1045,7 +1379,7 @@ extern cv::Mat mat_dbg;
         if (psv < mmax * 0.25) {
             break;
         }
-        mark_next_move( [coord[@"move"] UTF8String], letter, m);
+        mark_next_move( [coord[@"move"] UTF8String], letter, m, boardsz);
         letter += 1;
     }
     UIImage *res = MatToUIImage( m);
@@ -1059,20 +1393,101 @@ extern cv::Mat mat_dbg;
     if (!sgf) sgf = @"";
     cv::Mat m;
     draw_sgf( [sgf UTF8String], m, 1.5 * IMG_WIDTH);
-    draw_score( m, terrmap);
+    draw_score( m, terrmap, sgf_board_size( [sgf UTF8String]));
     UIImage *res = MatToUIImage( m);
     return res;
 } // scoreimg()
 
+// Hash of the stones in an sgf, the same for all rotations and reflections.
+// Use it to spot the same board photographed again. 0 if there are no stones.
+//-----------------------------------------------------------------------------------
++ (uint64_t) position_hash:(NSString *)sgf_
+{
+    if (!sgf_) return 0;
+    std::string sgf = [sgf_ UTF8String];
+    auto diagram = sgf2vec( sgf);
+    if (std::none_of( diagram.begin(), diagram.end(), [](int v) { return v == BBLACK || v == WWHITE; })) {
+        return 0;
+    }
+    return diagram_canonical_hash( diagram, sgf_board_size( sgf));
+} // position_hash()
+
+// Check position_hash: same for a rotated board, different for another one.
+// Returns the number of failures.
+//--------------------------------------------------------------------------------
++ (int) test_position_hash
+{
+    const int N = 13;
+    std::vector<int> diagram( N*N, EEMPTY), rotated( N*N, EEMPTY);
+    diagram[2*N + 3] = BBLACK; diagram[3*N + 9] = WWHITE; diagram[10*N + 10] = BBLACK;
+    RLOOP (N) { CLOOP (N) { rotated[c*N + (N-1-r)] = diagram[r*N + c]; } }
+    std::vector<int> other = diagram;
+    other[6*N + 6] = WWHITE;
+    auto hash = [N](const std::vector<int> &d) {
+        return [CppInterface position_hash:@(generate_sgf( "", d, Points2f(), 0, 0, N).c_str())];
+    };
+    int nfails = 0;
+    if (hash( diagram) == 0) nfails++;
+    if (hash( diagram) != hash( rotated)) nfails++;
+    if (hash( diagram) == hash( other)) nfails++;
+    if (hash( std::vector<int>( N*N, EEMPTY)) != 0) nfails++;
+    return nfails;
+} // test_position_hash()
+
+// Run the C++ unit tests. Returns pairs of test name and number of failures.
+//------------------------------------------------------------------------------
++ (NSArray *) unit_tests
+{
+    return @[
+        @[@"Ingest", @(test_ingest())],
+        @[@"FFT", @(test_fft())],
+        @[@"Normalize", @(test_normalize())],
+        @[@"Thresh Dilate", @(test_thresh_dilate())],
+        @[@"Clahe", @(test_clahe())],
+        @[@"SpscMailbox", @(SpscMailbox<int>::test())],
+        @[@"SgfTokenizer", @(SgfTokenizer::test())],
+        @[@"SgfWriter", @(SgfWriter::test())],
+        @[@"GoBoard 9x9", @(GoBoard<9>::test())],
+        @[@"GoBoard 19x19", @(GoBoard<19>::test())],
+        @[@"Territory", @(Territory<19>::test())],
+        @[@"MoveDetector", @(MoveDetector<19>::test())],
+        @[@"BoardRenderer", @(BoardRenderer::test())],
+        @[@"Clust1D", @(Clust1D::test())],
+        @[@"GameRecorder", @(GameRecorder<19>::test())],
+    ];
+} // unit_tests()
+
+// Random games on a 19x19 GoBoard. Returns moves per second.
+//---------------------------------------------------------------
++ (double) bench_goboard
+{
+    return GoBoard<19>::bench( 200);
+} // bench_goboard()
+
+// Synthetic frames through a 19x19 GameRecorder. Returns frames per second.
+//-----------------------------------------------------------------------------
++ (double) bench_game_recorder
+{
+    return GameRecorder<19>::bench( 300);
+} // bench_game_recorder()
+
+// Estimate territory locally, without asking Katago.
+// terrmap gets one value per point, in [-1,1], positive for black.
+// Returns the area score, black minus white minus komi.
+//------------------------------------------------------------------------------------
++ (double) estimate_score:(NSString *)sgf komi:(double)komi terrmap:(double *)terrmap
+{
+    if (!sgf) sgf = @"";
+    std::string sgf_ = [sgf UTF8String];
+    return estimate_territory( sgf2vec( sgf_), sgf_board_size( sgf_), komi, terrmap);
+} // estimate_score()
+
 //-----------------------------------------------------------------
 + (NSString *) get_sgf_tag:(NSString *)tag_ sgf:(NSString *)sgf_
 {
     std::string sgf = [sgf_ UTF8String];
     std::string tag = [tag_ UTF8String];
-    std::string val = get_sgf_tag( sgf, tag);
-    // Remove backslashes
-    std::regex re_back( "\\\\");
-    val = std::regex_replace( val, re_back, "" );
+    std::string val = get_sgf_tag( sgf, tag); // unescaped
     return [NSString stringWithUTF8String:val.c_str()];
 } // get_sgf_tag()
 
@@ -1082,10 +1497,7 @@ extern cv::Mat mat_dbg;
     std::string sgf = [sgf_ UTF8String];
     std::string tag = [tag_ UTF8String];
     std::string val = [val_ UTF8String];
-    std::string res = set_sgf_tag( sgf, tag, val);
-    // Remove backslashes
-    std::regex re_back( "\\\\");
-    res = std::regex_replace( res, re_back, "" );
+    std::string res = set_sgf_tag( sgf, tag, val); // escapes val
     return [NSString stringWithUTF8String:res.c_str()];
 } // set_sgf_tag()
 
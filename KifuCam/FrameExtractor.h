@@ -28,10 +28,11 @@
 #import <Foundation/Foundation.h>
 #import <UIKit/UIKit.h>
 #import <AVFoundation/AVFoundation.h>
+#import "CppInterface.h"
 
 //==================================
 @protocol FrameExtractorDelegate
-- (void)captured:(UIImage *)image;
+- (void)captured:(CameraFrame *)frame;
 @end
 
 //====================================================================================
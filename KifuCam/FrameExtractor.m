@@ -104,6 +104,9 @@
     }
     [self.captureSession addInput:captureDeviceInput];
     AVCaptureVideoDataOutput *videoOutput = [AVCaptureVideoDataOutput new];
+    // Bi-planar YUV is what the camera produces natively. No conversion before ingest.
+    videoOutput.videoSettings = @{ (id)kCVPixelBufferPixelFormatTypeKey:
+                                       @(kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) };
     [videoOutput setSampleBufferDelegate:self queue:self.bufferQ];
     if (![self.captureSession canAddOutput:videoOutput]) {
         return;
@@ -151,24 +154,15 @@
     s_suspended = true;
     [self suspend];
 
-    // UIImage from samplebuffer. Bullshit Nonsense Nightmare.
+    // Straight from the camera planes to the small working image, in one pass
     CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
-    CVPixelBufferLockBaseAddress( imageBuffer,0);
     if (imageBuffer == NULL) return;
-    CIImage *ciImage = [CIImage imageWithCVImageBuffer:imageBuffer];
-    if (ciImage == NULL) return;
-    CIContext *context = [[CIContext alloc] initWithOptions:nil];
-    CGImageRef cgImage = [context createCGImage:ciImage fromRect:ciImage.extent];
-    UIImage *uiImage = [UIImage imageWithCGImage:cgImage];
-    CVPixelBufferUnlockBaseAddress( imageBuffer,0);
-    CFRelease(cgImage);
-    if (uiImage == NULL) return;
+    CameraFrame *frame = [CppInterface ingest:imageBuffer];
+    if (frame == nil) return;
     
     dispatch_async(dispatch_get_main_queue(),
                    ^{
-                       if (uiImage != NULL) {
-                           [self.delegate captured:uiImage];
-                       }
+                       [self.delegate captured:frame];
                        s_suspended = false;
                    });
 }
@@ -0,0 +1,345 @@
+//
+//  GameRecorder.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2019 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Make a game record from a video of a game.
+// The board is found once and then tracked. Per frame, only intersections whose crop
+// changed since they were last classified go through the stone classifier.
+// MoveDetector turns the diagrams into moves.
+
+#ifndef GameRecorder_hpp
+#define GameRecorder_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+
+#include "Globals.h"
+#include "Common.hpp"
+#include "Ocv.hpp"
+#include "BoardSize.hpp"
+#include "BoardTracker.hpp"
+#include "Helpers.hpp"
+#include "MoveDetector.hpp"
+
+// Crop around an intersection, RGB, CROPSIZE x CROPSIZE => BBLACK, WWHITE, EEMPTY, DDONTKNOW
+typedef std::function<int (const cv::Mat &crop)> StoneClassifier;
+// Find the board in an RGB frame. Corners tl, tr, br, bl in frame coordinates.
+typedef std::function<bool (const cv::Mat &img, Points2f &corners)> BoardLocator;
+// Anything to do to a frame before classification, like color equalization. In place.
+typedef std::function<void (cv::Mat &img)> FramePrep;
+
+struct RecordStats
+{
+    int frames = 0;      // frames read
+    int lost = 0;        // frames without a board
+    int occluded = 0;    // frames skipped because too much changed
+    long classified = 0; // crops that went through the classifier
+    int moves = 0;       // moves on the final line
+    double ms = 0;       // wall time
+};
+
+// Common interface, so callers only need the board size at runtime
+//=====================================================================
+class GameRecorderBase
+{
+public:
+    virtual ~GameRecorderBase() {}
+    // Feed a frame zoomed with zoom_in(). Returns the number of moves added.
+    virtual int feed( const cv::Mat &zoomed, const StoneClassifier &classify) = 0;
+    virtual std::string sgf() const = 0;
+    virtual int nmoves() const = 0;
+    virtual void reset() = 0;
+    // The board moved under us. Classify everything again on the next frame.
+    virtual void invalidate() = 0;
+    const RecordStats& stats() const { return m_stats; }
+protected:
+    RecordStats m_stats;
+}; // class GameRecorderBase
+
+template <int N = BOARD_SZ>
+class GameRecorder : public GameRecorderBase
+//==============================================
+{
+public:
+    static constexpr int NPOINTS = BoardSize<N>::NPOINTS;
+    static constexpr double CHANGE_THRESH = 12; // mean abs gray difference to count as changed
+    static constexpr int MAX_CHANGED = NPOINTS / 8; // more than that is a hand, not a move
+    static constexpr int MAX_OCCLUDED = 30; // after that many frames, it was the light, not a hand
+    
+    //------------------
+    GameRecorder()
+    {
+        // The intersections sit where zoom_in() puts them, whatever the frame
+        Points2f unit = { {0,0}, {1,0}, {1,1}, {0,1} }, square;
+        cv::Mat M;
+        zoom_in( unit, M, N);
+        cv::perspectiveTransform( unit, square, M);
+        double dh, dv;
+        get_intersections_from_corners( square, N, m_intersections, dh, dv);
+        m_ref.resize( NPOINTS);
+        m_diagram.assign( NPOINTS, DDONTKNOW);
+    } // GameRecorder()
+    
+    //------------------
+    void reset() override
+    {
+        m_detector.reset();
+        invalidate();
+        m_diagram.assign( NPOINTS, DDONTKNOW);
+        m_stats = RecordStats();
+    } // reset()
+    
+    //-------------------------
+    void invalidate() override
+    {
+        ILOOP (NPOINTS) { m_ref[i].release(); }
+        m_noccluded = 0;
+    } // invalidate()
+    
+    //---------------------------------------------------------------------------
+    int feed( const cv::Mat &zoomed, const StoneClassifier &classify) override
+    {
+        const int r = CROPSIZE/2;
+        const cv::Rect img_rect( 0, 0, zoomed.cols, zoomed.rows);
+        m_stats.frames++;
+        cv::cvtColor( zoomed, m_gray, cv::COLOR_RGB2GRAY);
+        
+        // Which crops changed since we classified them
+        m_changed.clear();
+        ILOOP (NPOINTS) {
+            cv::Rect rect( ROUND(m_intersections[i].x) - r, ROUND(m_intersections[i].y) - r, 2*r+1, 2*r+1);
+            if ((rect & img_rect) != rect) { m_diagram[i] = DDONTKNOW; continue; }
+            if (!m_ref[i].empty() &&
+                cv::norm( m_gray( rect), m_ref[i], cv::NORM_L1) < CHANGE_THRESH * rect.area()) continue;
+            m_changed.push_back( i);
+        }
+        // Right after invalidate() everything changed
+        bool fresh = m_ref[NPOINTS/2].empty();
+        if (!fresh && SZ(m_changed) > MAX_CHANGED && m_noccluded < MAX_OCCLUDED) {
+            m_noccluded++;
+            m_stats.occluded++;
+            return 0;
+        }
+        m_noccluded = 0;
+        for (int i : m_changed) {
+            cv::Rect rect( ROUND(m_intersections[i].x) - r, ROUND(m_intersections[i].y) - r, 2*r+1, 2*r+1);
+            m_gray( rect).copyTo( m_ref[i]);
+            m_diagram[i] = classify( zoomed( rect));
+            m_stats.classified++;
+        }
+        int res = m_detector.observe( m_diagram);
+        m_stats.moves = m_detector.nmoves();
+        return res;
+    } // feed()
+    
+    std::string sgf() const override { return m_detector.sgf(); }
+    int nmoves() const override { return m_detector.nmoves(); }
+    const MoveDetector<N>& detector() const { return m_detector; }
+    const Points2f& intersections() const { return m_intersections; }
+    
+    static int test();
+    static double bench( int nframes = 300);
+    
+private:
+    // Test helpers. A zoomed frame with the stones in diagram, and a classifier
+    // that goes by the brightness in the middle of the crop.
+    void draw_frame( const std::vector<int> &diagram, cv::Mat &frame) const;
+    static int classify_by_brightness( const cv::Mat &crop);
+    
+
+    MoveDetector<N> m_detector;
+    Points2f m_intersections;     // in the zoomed frame
+    std::vector<cv::Mat> m_ref;   // gray crop at the last classification
+    std::vector<int> m_diagram;   // classification per intersection
+    std::vector<int> m_changed;
+    int m_noccluded = 0;          // frames in a row with too many changes
+    cv::Mat m_gray;
+}; // class GameRecorder
+
+// Tests
+//=========
+
+//--------------------------------------------------------------------------------------
+template <int N>
+void GameRecorder<N>::draw_frame( const std::vector<int> &diagram, cv::Mat &frame) const
+{
+    const int r = CROPSIZE/2 - 3;
+    frame.create( IMG_WIDTH, IMG_WIDTH, CV_8UC3);
+    frame = cv::Scalar( 200, 160, 90);
+    ILOOP (NPOINTS) {
+        cv::Point p( ROUND(m_intersections[i].x), ROUND(m_intersections[i].y));
+        if (diagram[i] == BBLACK) { cv::circle( frame, p, r, cv::Scalar( 20, 20, 20), -1); }
+        else if (diagram[i] == WWHITE) { cv::circle( frame, p, r, cv::Scalar( 235, 235, 235), -1); }
+    }
+} // draw_frame()
+
+//--------------------------------------------------------------------
+template <int N>
+int GameRecorder<N>::classify_by_brightness( const cv::Mat &crop)
+{
+    const int c = CROPSIZE/2;
+    cv::Mat gray;
+    cv::cvtColor( crop( cv::Rect( c-4, c-4, 9, 9)), gray, cv::COLOR_RGB2GRAY);
+    double m = cv::mean( gray)[0];
+    if (m < 60) return BBLACK;
+    if (m > 200) return WWHITE;
+    return EEMPTY;
+} // classify_by_brightness()
+
+// Feed synthetic frames: empty board, a black stone, a hand, a white stone.
+// Check the moves and that only the changed crops got classified.
+// Returns the number of failures.
+//--------------------------------------------------------------------------
+template <int N>
+int GameRecorder<N>::test()
+{
+    TestCheck check( "GameRecorder::test");
+    GameRecorder rec;
+    std::vector<int> d( NPOINTS, EEMPTY);
+    cv::Mat frame;
+    auto show = [&](int nframes) {
+        rec.draw_frame( d, frame);
+        int res = 0;
+        ILOOP (nframes) { res += rec.feed( frame, classify_by_brightness); }
+        return res;
+    };
+    const int STABLE = MoveDetector<N>::STABLE_FRAMES;
+    
+    show( STABLE + 2);
+    check( rec.stats().classified == NPOINTS, "first frame classifies everything");
+    d[3*N + 3] = BBLACK;
+    check( show( STABLE + 1) == 1, "black move");
+    check( rec.stats().classified == NPOINTS + 1, "only the new stone classified");
+    
+    // A hand covers the middle of the board for a frame
+    rec.draw_frame( d, frame);
+    cv::rectangle( frame, cv::Point( 0, frame.rows/4), cv::Point( frame.cols, 3*frame.rows/4),
+                  cv::Scalar( 120, 90, 70), -1);
+    rec.feed( frame, classify_by_brightness);
+    check( rec.stats().occluded == 1, "hand skipped");
+    
+    d[(N-4)*N + N-4] = WWHITE;
+    check( show( STABLE + 1) == 1, "white move");
+    check( rec.stats().classified == NPOINTS + 2, "hand did not cause classification");
+    check( rec.nmoves() == 2 && rec.stats().moves == 2, "two moves");
+    std::string sgf = rec.sgf();
+    std::string bmove = std::string( ";B[") + char('a' + 3) + char('a' + 3) + "]";
+    std::string wmove = std::string( ";W[") + char('a' + N-4) + char('a' + N-4) + "]";
+    check( sgf.find( bmove + wmove) != std::string::npos, "sgf");
+    check( rec.stats().frames == 2*(STABLE + 1) + STABLE + 2 + 1, "frame count");
+    return check.nfails();
+} // test()
+
+// Frames per second through feed(), with a trivial classifier.
+// That is the cost of the recorder itself, without the network.
+// A stone goes down every 10 frames.
+//----------------------------------------------------------------------
+template <int N>
+double GameRecorder<N>::bench( int nframes)
+{
+    GameRecorder rec;
+    std::vector<int> d( NPOINTS, EEMPTY);
+    std::vector<cv::Mat> frames;
+    for (int k = 0; k * 10 < nframes; k++) {
+        frames.emplace_back();
+        rec.draw_frame( d, frames.back());
+        d[(k * 7) % NPOINTS] = (k % 2) ? WWHITE : BBLACK;
+    }
+    const int64 t0 = cv::getTickCount();
+    ILOOP (nframes) { rec.feed( frames[i / 10], classify_by_brightness); }
+    double secs = (cv::getTickCount() - t0) / cv::getTickFrequency();
+    double fps = nframes / std::max( secs, 1e-9);
+    std::cerr << "GameRecorder<" << N << ">::bench: " << nframes << " frames, "
+    << rec.stats().classified << " crops classified, " << rec.nmoves() << " moves, "
+    << fps << " frames/s\n";
+    return fps;
+} // bench()
+
+//-------------------------------------------------------------------------
+inline std::shared_ptr<GameRecorderBase> make_game_recorder( int boardsz)
+{
+    return with_board_size( boardsz, [](auto bs) -> std::shared_ptr<GameRecorderBase> {
+        return std::make_shared<GameRecorder<decltype(bs)::DIM>>();
+    });
+} // make_game_recorder()
+
+// Read a video file and write the game as sgf.
+// locate() runs on the first frame and whenever tracking fails. It and the tracker
+// get the raw frame. prep() only runs on the frame the crops come from.
+// Returns false if the video does not open or the board never shows up.
+//------------------------------------------------------------------------------------------------
+inline bool record_video( const std::string &fname, int boardsz,
+                         const BoardLocator &locate, const StoneClassifier &classify, // in
+                         std::string &sgf, RecordStats *stats = nullptr, // out
+                         const FramePrep &prep = nullptr)
+{
+    cv::VideoCapture cap( fname);
+    if (!cap.isOpened()) {
+        std::cerr << "record_video: cannot open " << fname << "\n";
+        return false;
+    }
+    auto recorder = make_game_recorder( boardsz);
+    BoardTracker tracker;
+    cv::Mat frame, small, rgb, zoomed, M;
+    Points2f corners, intersections;
+    bool found = false;
+    double dh, dv;
+    const int64 t0 = cv::getTickCount();
+    int nlost = 0;
+    
+    while (cap.read( frame)) {
+        if (frame.empty()) continue;
+        resize( frame, small, IMG_WIDTH);
+        cv::cvtColor( small, rgb, cv::COLOR_BGR2RGB);
+        if (!tracker.track( rgb, corners, intersections)) {
+            // Lost it, or never had it
+            if (!locate( rgb, corners) || SZ(corners) != 4) { nlost++; continue; }
+            get_intersections_from_corners( corners, boardsz, intersections, dh, dv);
+            tracker.lock( rgb, corners, intersections);
+            recorder->invalidate();
+            found = true;
+        }
+        if (prep) { prep( rgb); }
+        zoom_in( corners, M, boardsz);
+        cv::warpPerspective( rgb, zoomed, M, rgb.size());
+        recorder->feed( zoomed, classify);
+    } // while
+    
+    sgf = recorder->sgf();
+    if (stats) {
+        *stats = recorder->stats();
+        stats->frames += nlost;
+        stats->lost = nlost;
+        stats->ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+    }
+    return found;
+} // record_video()
+
+#endif /* GameRecorder_hpp */
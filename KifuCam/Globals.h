@@ -42,6 +42,18 @@ extern AppDelegate *g_app;
 #include "Ocv.hpp"
 extern std::string g_docroot;
 extern cv::Mat mat_dbg;
+
+// Workspace buffers of the board finding engine
+enum WsSlot {
+    WS_ORIG_SMALL, WS_GRAY, WS_GRAY_THRESHED, WS_SMALL_IMG, WS_HOUGH_ROUGH,
+    WS_ROTATED, WS_PROJECTED, WS_SCALED, WS_SCALED_FALLBACK, WS_HOUGH_FALLBACK,
+    WS_GRAY_SCALED, WS_GRAY_THRESHED_SCALED, WS_SMALL_IMG_SCALED, WS_HOUGH_PERP,
+    WS_BOARDNESS, WS_SMALL_ZOOMED, WS_GRAY_ZOOMED,
+    WS_NN_INPUT, WS_FEAT_ON, WS_FEAT_OFF, WS_FEAT, WS_FEAT_RESIZED,
+    WS_MATCH_CROSS,                           // 4 template match buffers, find_empty_places()
+    WS_MATCH_CROSS_PERP = WS_MATCH_CROSS + 4, // 4 more for find_empty_places_perp()
+    WS_NSLOTS = WS_MATCH_CROSS_PERP + 4
+};
 #endif
 
 // Always
@@ -32,8 +32,16 @@
 #define GoBoard_hpp
 
 #import <set>
+#import <array>
+#import <bitset>
+#import <vector>
+#import <random>
+#import <chrono>
+#import <iostream>
 #import "Globals.h"
+#import "BoardSize.hpp"
 #import "Common.hpp"
+#import "Zobrist.hpp"
 
 // An intersection on a Go board. row, col 0 to boardsize - 1.
 //==============================================================
@@ -41,14 +49,13 @@ class GoPoint
 {
 public:
     GoPoint( int row, int col) : m_row(row), m_col(col) {}
-    GoPoint( int idx) : m_row(idx/BOARD_SZ), m_col(idx % BOARD_SZ) {}
+    static GoPoint from_idx( int idx, int boardsz) { return GoPoint( idx / boardsz, idx % boardsz); }
     GoPoint():m_row(-1), m_col(-1) {}
     //---------------------------------------------
     bool operator < (const GoPoint& rhs) const {
         return (m_row < rhs.m_row) || ((m_row == rhs.m_row) && (m_col < rhs.m_col));
     }
-    //int idx() const { return (BOARD_SZ - m_row) * BOARD_SZ + m_col; }
-    int idx() const { return m_row * BOARD_SZ + m_col; }
+    int idx( int boardsz) const { return m_row * boardsz + m_col; }
     int m_row;
     int m_col;
 }; // class GoPoint
@@ -133,178 +140,240 @@ private:
     std::set<GoPoint> m_liberties;
 }; // class GoString
 
-//=================
+// A Go position on an N x N board, N in 9, 13, 19.
+// Flat per point arrays. Strings are union-find trees over point indexes, and each
+// string also links its stones in a ring, so we can walk it without a search.
+// The root of a string keeps its liberties as a bitset, and their count.
+// Zobrist hashes of the position, all 8 symmetries, follow every stone change.
+//=========================================================================================
+template <int N = BOARD_SZ>
 class GoBoard
 {
 public:
+    typedef BoardSize<N> Size;
+    static constexpr int NPOINTS = Size::NPOINTS;
+    typedef std::bitset<NPOINTS> Libs;
+    typedef Zobrist<N> Zob;
+    
     //---------------------
-    GoBoard( int sz=BOARD_SZ) {
-        m_sz = sz;
-    } // GoBoard()
+    GoBoard() {
+        m_color.fill( EEMPTY);
+        ILOOP (NPOINTS) { m_parent[i] = i; m_next[i] = i; }
+        m_nstones.fill( 0);
+        m_nlibs.fill( 0);
+        m_hashes.fill( Zob::empty());
+    }
     
     // Make a GoBoard from a recognized position
     //-----------------------------------------------
-    GoBoard( const int pos[], int sz=BOARD_SZ) {
-        m_sz = sz;
-        ILOOP( sz*sz) {
-            if (pos[i] == EEMPTY) { continue; }
-            int row = i / BOARD_SZ;
-            int col = i % BOARD_SZ;
-            place_stone( pos[i], GoPoint(row,col));
+    GoBoard( const int pos[]) : GoBoard() {
+        ILOOP( NPOINTS) {
+            if (pos[i] != BBLACK && pos[i] != WWHITE) { continue; }
+            place_stone( pos[i], i);
         } // for
     } // GoBoard( pos)
     
+    //---------------------------------------------------------
+    GoBoard( const typename Size::Diagram &pos) : GoBoard( pos.data()) {}
+    
+    // Call f(nidx) for each neighbor of point idx
+    //------------------------------------------------
+    template <typename F>
+    static void for_neighbors( int idx, F &&f) {
+        const auto &nt = neighbor_table();
+        for (int k = 0; k < nt.count[idx]; k++) { f( nt.nb[idx][k]); }
+    } // for_neighbors()
+    
     //------------------------------------------
-    std::set<GoPoint> neighbors( GoPoint p) {
-        std::set<GoPoint> res;
-        if (p.m_col > 0) { auto left = GoPoint( p.m_row, p.m_col - 1 ); res.insert( left); }
-        if (p.m_col < m_sz-1) { auto right = GoPoint( p.m_row, p.m_col + 1 ); res.insert( right); }
-        if (p.m_row > 0) { auto top = GoPoint( p.m_row-1, p.m_col); res.insert( top); }
-        if (p.m_row < m_sz-1) { auto bot = GoPoint( p.m_row+1, p.m_col); res.insert( bot); }
+    std::vector<GoPoint> neighbors( GoPoint p) const {
+        std::vector<GoPoint> res;
+        for_neighbors( p.idx(N), [&res](int n) { res.push_back( GoPoint::from_idx( n, N)); });
         return res;
     } // neighbors()
-
-    //------------------------------------
-    GoString get_go_string( GoPoint p) {
-        return m_grid[p];
+    
+    // Snapshot of the string through p, with stones and liberties as sets
+    //-------------------------------------------------------------------------
+    GoString get_go_string( GoPoint p) const {
+        int idx = p.idx(N);
+        if (m_color[idx] == EEMPTY) { return GoString(); }
+        int root = find( idx);
+        std::set<GoPoint> stones, libs;
+        for_stones( idx, [&stones](int s) { stones.insert( GoPoint::from_idx( s, N)); });
+        ILOOP (NPOINTS) {
+            if (m_libs[root][i]) { libs.insert( GoPoint::from_idx( i, N)); }
+        }
+        return GoString( m_color[idx], stones, libs);
     } // get_go_string()
-
+    
     //------------------------------------
-    int color( GoPoint p) {
-        return m_grid[p].color();
-    } // color()
-
-    //--------------------------------
-    bool isempty( GoPoint p) {
-        return m_grid[p].color() < 0;
-    } // isempty()
-
-    //-------------------------------------------
-    void place_stone( int color, GoPoint p_) {
-        std::set<GoPoint> liberties;
-        std::set<GoPoint> adj_same_color;
-        std::set<GoPoint> adj_other_color;
-        for (auto p : neighbors(p_)) {
-            if (isempty(p)) { liberties.insert( p); } 
-            else { // there's a stone at p
-                GoString &neigh_str( m_grid[p]);
-                if (neigh_str.color() == color) { // a friend
-                    adj_same_color.insert( p);
-                }
-                else { // a foe
-                    adj_other_color.insert( p);
-                }
-            }
-        } // for neighbors
-        GoString new_string( color, { p_ }, liberties);
-        // Merge adjacent strings of same color
-        for (auto p:adj_same_color) {
-            new_string = new_string.merged_with( m_grid[p]);
-        } // for
-        for (auto p : new_string.stones() ) {
-            m_grid[p] = new_string;
-        } // for
-        // Take this liberty off the other color strings
-        for( auto p:adj_other_color) {
-            auto gostr = get_go_string( p);
-            //std::cout << str_ptr << std::endl;
-            auto repl = gostr.rm_liberty( p_);
-            if (!repl.num_liberties()) { // No libs, take it off
-                rm_string( gostr);
+    int color( int idx) const { return m_color[idx]; }
+    int color( GoPoint p) const { return m_color[p.idx(N)]; }
+    bool isempty( int idx) const { return m_color[idx] == EEMPTY; }
+    bool isempty( GoPoint p) const { return isempty( p.idx(N)); }
+    
+    // Liberties and size of the string through a stone
+    //-----------------------------------------------------
+    int num_liberties( int idx) const { return m_nlibs[find( idx)]; }
+    int num_liberties( GoPoint p) const { return num_liberties( p.idx(N)); }
+    int string_size( int idx) const { return m_nstones[find( idx)]; }
+    const Libs& liberties( int idx) const { return m_libs[find( idx)]; }
+    
+    // Position hash. Equal positions, equal hash.
+    //-------------------------------------------------
+    uint64_t hash() const { return m_hashes[0]; }
+    // Also equal for rotated or mirrored positions
+    uint64_t canonical_hash() const { return Zob::canonical( m_hashes); }
+    
+    // Back to a diagram
+    //----------------------------------------------
+    typename Size::Diagram diagram() const {
+        typename Size::Diagram res;
+        ILOOP (NPOINTS) { res[i] = m_color[i]; }
+        return res;
+    } // diagram()
+    
+    // Id of the string through a stone. Same for all its stones.
+    //----------------------------------------------------------------
+    int string_id( int idx) const { return find( idx); }
+    
+    // Same string?
+    //--------------------------------------------
+    bool connected( int idx1, int idx2) const {
+        return m_color[idx1] != EEMPTY && m_color[idx2] != EEMPTY && find( idx1) == find( idx2);
+    }
+    
+    // Call f(sidx) for each stone in the string through idx
+    //-----------------------------------------------------------
+    template <typename F>
+    void for_stones( int idx, F &&f) const {
+        int s = idx;
+        do { f( s); s = m_next[s]; } while (s != idx);
+    } // for_stones()
+    
+    // Put a stone on an empty point, merge with friends, capture foes
+    //---------------------------------------------------------------------
+    void place_stone( int color, int idx) {
+        if (m_color[idx] != EEMPTY) { return; }
+        m_color[idx] = color;
+        m_parent[idx] = idx;
+        m_next[idx] = idx;
+        m_nstones[idx] = 1;
+        m_libs[idx].reset();
+        Zob::toggle( m_hashes, color, idx);
+        
+        int foes[4]; int nfoes = 0;
+        for_neighbors( idx, [&](int n) {
+            int me = find( idx); // changes when we merge
+            if (m_color[n] == EEMPTY) { m_libs[me].set( n); return; }
+            int r = find( n);
+            if (m_color[n] == color) {
+                if (r == me) { return; }
+                m_libs[r].reset( idx);
+                merge( me, r);
             }
-            else { // take the lib off the neighbor string
-                for (auto p : repl.stones() ) {
-                    m_grid[p] = repl;
-                }
+            else {
+                if (!m_libs[r][idx]) { return; } // seen that one already
+                m_libs[r].reset( idx);
+                m_nlibs[r]--;
+                foes[nfoes++] = r;
             }
-        } // for str_ptr
-        //std::cout << ">>>>>>>>>>>\n";
+        });
+        int me = find( idx);
+        m_nlibs[me] = (int)m_libs[me].count();
+        // Take the dead ones off
+        for (int k = 0; k < nfoes; k++) {
+            if (!m_nlibs[foes[k]]) { rm_string( foes[k]); }
+        }
     } // place_stone()
     
-    // Remove a captured string from the board
     //-------------------------------------------
-    void rm_string( GoString gostr) {
-        for (auto p : gostr.stones()) {
-            // Create libs for the neighboring strings
-            auto neighs = neighbors(p);
-            for (auto neigh : neighs) {
-                if (!m_grid.count(neigh)) { continue; } // empty
-                if (gostr.stones().count(neigh)) { continue; } // that's ourselves
-                auto neighstr = m_grid[neigh];
-                auto repl = neighstr.add_liberty( p);
-                for (auto &p : repl.stones() ) {
-                    m_grid[p] = repl;
-                }
-            } // for neighs
-            m_grid.erase( p);
-        } // for p in gostr
+    void place_stone( int color, GoPoint p) { place_stone( color, p.idx(N)); }
+    
+    // Remove the string through idx from the board.
+    // The neighbors get the points as liberties.
+    //---------------------------------------------------
+    void rm_string( int idx) {
+        if (m_color[idx] == EEMPTY) { return; }
+        for_stones( idx, [this](int s) {
+            Zob::toggle( m_hashes, m_color[s], s);
+            m_color[s] = EEMPTY;
+        });
+        int s = idx;
+        do {
+            int nxt = m_next[s];
+            for_neighbors( s, [this, s](int n) {
+                if (m_color[n] == EEMPTY) { return; }
+                int r = find( n);
+                if (!m_libs[r][s]) { m_libs[r].set( s); m_nlibs[r]++; }
+            });
+            m_parent[s] = s; m_next[s] = s; m_nstones[s] = 0; m_nlibs[s] = 0;
+            m_libs[s].reset();
+            s = nxt;
+        } while (s != idx);
     } // rm_string()
     
+    //----------------------------------------
+    void rm_string( GoPoint p) { rm_string( p.idx(N)); }
+    
     //---------------------------------
-    std::set<GoString> strings() {
+    std::set<GoString> strings() const {
         std::set<GoString> res;
-        for( auto const& [key, val] : m_grid ) {
-            res.insert( val);
-        } // for
+        ILOOP (NPOINTS) {
+            if (m_color[i] != EEMPTY && find( i) == i) { res.insert( get_go_string( GoPoint::from_idx( i, N))); }
+        }
         return res;
     } // strings()
     
     //-------------------------------------------------
-    std::set<GoString> strings_in_atari( int col) {
+    std::set<GoString> strings_in_atari( int col) const {
         std::set<GoString> res;
-        for( auto const& [key, val] : m_grid ) {
-            if (val.num_liberties() == 1) {
-                if (val.color() == col) {
-                    res.insert( val);
-                }
+        ILOOP (NPOINTS) {
+            if (m_color[i] == col && find( i) == i && m_nlibs[i] == 1) {
+                res.insert( get_go_string( GoPoint::from_idx( i, N)));
             }
-        } // for
+        }
         return res;
     } // strings_in_atari()
     
-    //---------------------------------------------
-    bool is_self_capture( int col, GoPoint p) {
-        std::set<GoString> friendly_strings;
-        for (auto neighbor: neighbors(p)) {
-            auto neighbor_string = m_grid[neighbor];
-            if (neighbor_string.color() < 0) { // liberty
-               return false;
+    // Would a stone of color col at idx have no liberties after captures?
+    //-------------------------------------------------------------------------
+    bool is_self_capture( int col, int idx) const {
+        bool res = true;
+        for_neighbors( idx, [&](int n) {
+            if (!res) { return; }
+            if (m_color[n] == EEMPTY) { res = false; } // liberty
+            else if (m_nlibs[find( n)] != 1) { // friend keeps a liberty, foe survives
+                if (m_color[n] == col) { res = false; }
             }
-            else if (neighbor_string.color() == col) {
-                friendly_strings.insert( neighbor_string);
-            }
-            else if (neighbor_string.num_liberties() == 1) { // capture
-               return false;
-            }
-        } // for
-        if (std::all_of( friendly_strings.begin(), friendly_strings.end(),
-                        [](GoString s) { return s.num_liberties() == 1; })) {
-            return true;
-        }
-        return false;
+            else if (m_color[n] != col) { res = false; } // capture
+        });
+        return res;
     } // is_self_capture()
     
-    //---------------------------------------------
-    bool is_weak_eye( int col, GoPoint p) {
-        if (m_grid[p].color() < 0) {
-            return false;
-        }
-        for (auto neighbor: neighbors(p)) {
-            auto ncol = m_grid[neighbor].color();
-            if (ncol != col) {
-                return false;
-            }
-        }
-        return true;
+    //-------------------------------------------------
+    bool is_self_capture( int col, GoPoint p) const { return is_self_capture( col, p.idx(N)); }
+    
+    // An empty point with only col stones around it
+    //----------------------------------------------------
+    bool is_weak_eye( int col, int idx) const {
+        if (m_color[idx] != EEMPTY) { return false; }
+        bool res = true;
+        for_neighbors( idx, [&](int n) { if (m_color[n] != col) { res = false; } });
+        return res;
     } // is_weak_eye()
+    
+    //---------------------------------------------
+    bool is_weak_eye( int col, GoPoint p) const { return is_weak_eye( col, p.idx(N)); }
+    
+    // Examples and checks. Returns the number of failures.
+    //--------------------------------------------------------
+    static int test() {
+        TestCheck check( "GoBoard::test");
+        typename Size::Diagram pos;
+        pos.fill( EEMPTY);
+        auto w = [&pos](int row,int col) { pos[(row)*N + col] = WWHITE; };
+        auto b = [&pos](int row,int col) { pos[(row)*N + col] = BBLACK; };
         
-    //----------------------
-    static void test() {
-        int pos[BOARD_SZ * BOARD_SZ];
-        ILOOP(BOARD_SZ * BOARD_SZ) { pos[i] = EEMPTY; }
-        auto w = [&pos](int row,int col) { pos[(row)*BOARD_SZ + col] = WWHITE; };
-        auto b = [&pos](int row,int col) { pos[(row)*BOARD_SZ + col] = BBLACK; };
-
         // Just two strings, B and W, no captures
         /*
          x x . o .
@@ -313,21 +382,134 @@ public:
         b(0,0); b(0,1);
         w(1,0); w(1,1); w(1,2); w(1,3); w(0,3);
         auto board = GoBoard( pos);
+        check( board.num_liberties( GoPoint(0,0)) == 1, "black in atari");
+        check( board.string_size( GoPoint(1,2).idx(N)) == 5, "white string size");
+        check( board.connected( GoPoint(0,3).idx(N), GoPoint(1,0).idx(N)), "white connected");
+        check( SZ(board.strings_in_atari( BBLACK)) == 1, "strings_in_atari");
+        check( !board.is_self_capture( WWHITE, GoPoint(0,2)), "capture is no self capture");
+        check( board.is_self_capture( BBLACK, GoPoint(0,2)), "self capture");
+        check( SZ(board.strings()) == 2, "two strings");
         
         // Two stones captured
         /*
          x x o o .
          o o o o .
          */
-        ILOOP(BOARD_SZ * BOARD_SZ) { pos[i] = EEMPTY; }
-        b(0,0); b(0,1);
-        w(1,0); w(1,1); w(1,2); w(1,3); w(0,3);
-        w(0,2);
-        board = GoBoard( pos);
+        board.place_stone( WWHITE, GoPoint(0,2));
+        check( board.isempty( GoPoint(0,0)) && board.isempty( GoPoint(0,1)), "capture");
+        check( board.num_liberties( GoPoint(1,1)) == 8, "libs after capture");
+        check( board.is_weak_eye( WWHITE, GoPoint(0,0)) == false, "eye with one neighbor empty");
+        board.place_stone( WWHITE, GoPoint(0,0));
+        check( board.is_weak_eye( WWHITE, GoPoint(0,1)), "weak eye");
+        
+        // Same as the snapshot strings say
+        auto gs = board.get_go_string( GoPoint(1,1));
+        check( SZ(gs.stones()) == 7 && gs.num_liberties() == board.num_liberties( GoPoint(1,1)), "snapshot");
+        
+        // Incremental hash matches the hash from scratch, captures included
+        auto diag = board.diagram();
+        check( board.hash() == Zob::hash( diag), "incremental hash");
+        check( board.hash() != GoBoard().hash(), "hash not empty");
+        // Mirror and transpose give the same canonical hash
+        typename Size::Diagram mirrored, transposed;
+        ILOOP (NPOINTS) {
+            int r = i / N, c = i % N;
+            mirrored[r*N + (N-1-c)] = diag[i];
+            transposed[c*N + r] = diag[i];
+        }
+        auto bm = GoBoard( mirrored), bt = GoBoard( transposed);
+        check( bm.hash() != board.hash(), "mirror changes plain hash");
+        check( bm.canonical_hash() == board.canonical_hash(), "mirror canonical");
+        check( bt.canonical_hash() == board.canonical_hash(), "transpose canonical");
+        check( Zob::canonical( diag) == board.canonical_hash(), "canonical from scratch");
+        return check.nfails();
     } // test()
+    
+    // Play random games, avoiding self capture and filling own eyes.
+    // Prints and returns the moves per second.
+    //--------------------------------------------------------------------
+    static double bench( int ngames = 1000, unsigned seed = 42) {
+        std::mt19937 rng( seed);
+        long nmoves = 0, checksum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        ILOOP (ngames) {
+            GoBoard board;
+            int col = BBLACK;
+            int npass = 0;
+            for (int move = 0; move < 3 * NPOINTS && npass < 2; move++) {
+                int start = rng() % NPOINTS;
+                int found = -1;
+                for (int k = 0; k < NPOINTS; k++) {
+                    int p = (start + k) % NPOINTS;
+                    if (!board.isempty( p)) { continue; }
+                    if (board.is_weak_eye( col, p) || board.is_self_capture( col, p)) { continue; }
+                    found = p; break;
+                }
+                if (found < 0) { npass++; }
+                else { npass = 0; board.place_stone( col, found); nmoves++; }
+                col = (col == BBLACK) ? WWHITE : BBLACK;
+            } // for move
+            ILOOP (NPOINTS) { checksum += board.color( i); }
+        } // for games
+        double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0).count();
+        double mps = nmoves / std::max( secs, 1e-9);
+        std::cerr << "GoBoard<" << N << ">::bench: " << ngames << " games, " << nmoves << " moves, "
+        << mps << " moves/s, checksum " << checksum << "\n";
+        return mps;
+    } // bench()
+    
 private:
-    int m_sz;
-    std::map<GoPoint,GoString> m_grid;
+    // Neighbors of every point, computed once per board size
+    struct NeighborTable {
+        std::array<std::array<int,4>, NPOINTS> nb;
+        std::array<int, NPOINTS> count;
+    };
+    //---------------------------------------------------------
+    static const NeighborTable& neighbor_table() {
+        static const NeighborTable nt = [] {
+            NeighborTable t;
+            ILOOP (NPOINTS) {
+                int r = i / N, c = i % N, k = 0;
+                if (c > 0)   { t.nb[i][k++] = i - 1; }
+                if (c < N-1) { t.nb[i][k++] = i + 1; }
+                if (r > 0)   { t.nb[i][k++] = i - N; }
+                if (r < N-1) { t.nb[i][k++] = i + N; }
+                t.count[i] = k;
+            }
+            return t;
+        }();
+        return nt;
+    } // neighbor_table()
+    
+    // Root of the string through idx, halving the path on the way
+    //------------------------------------------------------------------
+    int find( int idx) const {
+        while (m_parent[idx] != idx) {
+            m_parent[idx] = m_parent[m_parent[idx]];
+            idx = m_parent[idx];
+        }
+        return idx;
+    } // find()
+    
+    // Join two strings, given their roots. The smaller one goes under the bigger one.
+    //-------------------------------------------------------------------------------------
+    void merge( int r1, int r2) {
+        if (m_nstones[r1] < m_nstones[r2]) { std::swap( r1, r2); }
+        m_parent[r2] = r1;
+        m_nstones[r1] += m_nstones[r2];
+        m_libs[r1] |= m_libs[r2];
+        m_nlibs[r1] = (int)m_libs[r1].count();
+        std::swap( m_next[r1], m_next[r2]); // splice the rings
+    } // merge()
+    
+    // Data
+    std::array<int8_t, NPOINTS> m_color;   // BBLACK, WWHITE, EEMPTY
+    mutable std::array<int16_t, NPOINTS> m_parent; // union-find, compressed by find()
+    std::array<int16_t, NPOINTS> m_next;   // ring of stones in the same string
+    std::array<int16_t, NPOINTS> m_nstones; // at the root
+    std::array<int16_t, NPOINTS> m_nlibs;   // at the root
+    std::array<Libs, NPOINTS> m_libs;       // at the root
+    typename Zob::Hashes m_hashes;          // position hash under each symmetry
 }; // class GoBoard
 
 
@@ -34,20 +34,21 @@
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <vector>
-#include <regex>
 
 #include "Common.hpp"
+#include "BoardSize.hpp"
 #include "Clust1D.hpp"
+#include "Lattice1D.hpp"
+#include "SgfTokenizer.hpp"
+#include "SgfWriter.hpp"
+#include "BoardRenderer.hpp"
 
 // Apply inverse thresh and dilate grayscale image.
+// Adaptive threshold over 5x5, then a 3x3 dilate, in one pass. dst must not be img.
 //-------------------------------------------------------------------------------------------
 inline void thresh_dilate( const cv::Mat &img, cv::Mat &dst, int thresh = 8)
 {
-    cv::adaptiveThreshold( img, dst, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
-                          5 /* 11 */ ,  // neighborhood_size
-                          thresh);  // threshold
-    cv::Mat element = cv::getStructuringElement( cv::MORPH_RECT, cv::Size(3,3));
-    cv::dilate( dst, dst, element );
+    adaptive_thresh_dilate( img, dst, thresh);
 }
 
 
@@ -71,248 +72,207 @@ inline void thresh_dilate( const cv::Mat &img, cv::Mat &dst, int thresh = 8)
  */
 // The GC tag has the pixel coordinates of the intersections.
 // Couldn't use json because sgf chokes on brackets.
+// boardsz 0 means take it from the diagram.
+// Appends to w. Reuse w across calls and the buffer stops growing.
 //------------------------------------------------------------------------------------------
-inline std::string generate_sgf( const std::string &title,
-                                const std::vector<int> diagram = std::vector<int>(),
-                                const Points2f &intersections = Points2f(),
-                                float phi=0, float theta=0)
+inline void generate_sgf( SgfWriter &w, const std::string &title,
+                         const std::vector<int> &diagram = std::vector<int>(),
+                         const Points2f &intersections = Points2f(),
+                         float phi=0, float theta=0, int boardsz=0)
 {
-    const int BUFSZ = 10000;
-    char buf[BUFSZ+1];
+    if (!boardsz) {
+        boardsz = SZ(diagram) ? ROUND( sqrt( SZ(diagram))) : BOARD_SZ;
+    }
+    w.reserve( w.size() + SgfWriter::estimate( SZ(diagram), SZ(intersections)));
+    
+    w.raw( "(;GM[1]").raw( " GN").value( title)
+     .raw( " FF[4]"
+          " CA[UTF-8]"
+          " AP[KifuCam]"
+          " RU[Chinese]"
+          " PB[Black]"
+          " PW[White]"
+          " BS[0]WS[0]")
+     .raw( ' ').prop( "SZ", boardsz)
+     .raw( ' ').prop( "DT", local_date_stamp())
+     .raw( " KM[0]"
+          " HA[0]");
     
-    // Intersection coordinate string
-    std::string coords = "intersections:(";
-    ISLOOP( intersections) {
-        snprintf( buf, BUFSZ, "(%d,%d)", ROUND( intersections[i].x), ROUND( intersections[i].y));
-        if (i>0) { coords += ","; }
-        coords += buf;
+    // Intersection coordinates, phi, theta. Nothing in there needs escaping.
+    w.raw( " GC[intersections:(");
+    ISLOOP (intersections) {
+        if (i>0) { w.raw( ','); }
+        w.raw( '(').num( ROUND( intersections[i].x)).raw( ',').num( ROUND( intersections[i].y)).raw( ')');
     }
-    coords += ")";
-    snprintf( buf, BUFSZ, "phi:%.2f", phi);
-    std::string phistr = buf;
-    snprintf( buf, BUFSZ, "theta:%.2f", theta);
-    std::string thetastr = buf;
-
-    // Generate sgf
-    snprintf( buf, BUFSZ,
-             "(;GM[1]"
-             " GN[%s]"
-             " FF[4]"
-             " CA[UTF-8]"
-             " AP[KifuCam]"
-             " RU[Chinese]"
-             " PB[Black]"
-             " PW[White]"
-             " BS[0]WS[0]"
-             " SZ[%d]"
-             " DT[%s]"
-             " KM[0]"
-             " HA[0]"
-             " GC[%s#%s#%s#]"
-             ,title.c_str(), BOARD_SZ, local_date_stamp().c_str(),
-             coords.c_str(), phistr.c_str(), thetastr.c_str());
-
-    std::string moves="";
-    ISLOOP (diagram) {
-        int row = i / BOARD_SZ;
-        int col = i % BOARD_SZ;
-        char ccol = 'a' + col;
-        char crow = 'a' + row;
-        std::string tag;
-        if (diagram[i] == WWHITE) { tag = "AW"; }
-        else if (diagram[i] == BBLACK) { tag = "AB"; }
-        else continue;
-        moves += tag + "[" + ccol + crow + "]";
+    w.raw( ")#phi:").num( phi, 2).raw( "#theta:").num( theta, 2).raw( "#]");
+    
+    // Stones, one list per color
+    for (int color : { BBLACK, WWHITE }) {
+        bool first = true;
+        ISLOOP (diagram) {
+            if (diagram[i] != color) continue;
+            if (first) { w.raw( color == BBLACK ? "AB" : "AW"); first = false; }
+            w.point( i % boardsz, i / boardsz);
+        }
     }
-    return buf + moves + ")\n";
+    w.raw( ")\n");
+} // generate_sgf()
+
+// Same, as a string
+//------------------------------------------------------------------------------------------
+inline std::string generate_sgf( const std::string &title,
+                                const std::vector<int> &diagram = std::vector<int>(),
+                                const Points2f &intersections = Points2f(),
+                                float phi=0, float theta=0, int boardsz=0)
+{
+    SgfWriter w;
+    generate_sgf( w, title, diagram, intersections, phi, theta, boardsz);
+    return w.take();
 } // generate_sgf()
 
 // e.g for board size, call get_sgf_tag( sgf, "SZ")
+// First value of the first property with that name, unescaped. "" if none.
 //----------------------------------------------------------------------------------
-inline std::string get_sgf_tag( const std::string &sgf, const std::string &tag)
+inline std::string get_sgf_tag( std::string_view sgf, std::string_view tag)
 {
-    std::string res;
-    std::regex re_tag( tag + "\\[[^\\]]*\\]");
-    std::smatch m;
-    std::regex_search( sgf, m, re_tag);
-    if (!SZ(m)) {
-        return "";
+    SgfTokenizer tz( sgf);
+    SgfTokenizer::Token tok;
+    while (tz.next( tok)) {
+        if (tok.kind == SgfTokenizer::VALUE && tok.ident == tag) {
+            return sgf_unescape( tok.value);
+        }
     }
-    std::string mstr = m[0];
-    std::vector<std::string> parts, parts1;
-    str_split( mstr, parts, '[');
-    str_split( parts[1], parts1, ']');
-    res = parts1[0];
-    return res;
+    return "";
 } // get_sgf_tag()
 
-// Set a tag to a value. Does not work for SZ tag. Who would wants to change the size?
-//---------------------------------------------------------------------------------------------------------
-inline std::string set_sgf_tag( const std::string &sgf, const std::string &tag,  const std::string &val)
+// Board size from the SZ tag. BOARD_SZ if there is none, or if we can't do it.
+//------------------------------------------------------------------------------
+inline int sgf_board_size( std::string_view sgf)
 {
+    std::string szstr = get_sgf_tag( sgf, "SZ");
+    int res = atoi( szstr.c_str());
+    if (!board_size_ok( res)) { res = BOARD_SZ; }
+    return res;
+} // sgf_board_size()
+
+// Set a tag to a value. Removes the old property with all its values,
+// and puts the new one right after SZ, or at the start of the root node without SZ.
+//---------------------------------------------------------------------------------------------------------
+inline std::string set_sgf_tag( std::string_view sgf, std::string_view tag, std::string_view val)
+{
+    std::vector<std::pair<size_t,size_t>> cuts; // spans of the old property
+    const size_t NONE = std::string::npos;
+    size_t root_at = NONE, sz_at = NONE, sz_prop = NONE;
+    SgfTokenizer tz( sgf);
+    SgfTokenizer::Token tok;
+    while (tz.next( tok)) {
+        if (tok.kind == SgfTokenizer::NODE && root_at == NONE) { root_at = tok.end; }
+        if (tok.kind != SgfTokenizer::VALUE) continue;
+        if (tok.ident == tag) {
+            if (SZ(cuts) && cuts.back().first == tok.prop_begin) { cuts.back().second = tok.end; }
+            else { cuts.emplace_back( tok.prop_begin, tok.end); }
+        }
+        // After the last value of the first SZ
+        if (tok.ident == "SZ" && (sz_prop == NONE || sz_prop == tok.prop_begin)) {
+            sz_prop = tok.prop_begin;
+            sz_at = tok.end;
+        }
+    } // while
+    size_t insert_at = (sz_at != NONE) ? sz_at : root_at;
+    
+    std::string newtag = std::string( tag) + "[" + sgf_escape( val) + "]";
     std::string res;
-    // Remove old tag, if any
-    std::regex re_tag( tag + "\\[[^\\]]*\\]");
-    res = std::regex_replace( sgf, re_tag, "" );
-    // Build new tag
-    std::string newtag = tag + "[" + val + "]";
-    // Insert right after SZ tag
-    std::regex re_insert( "(.*SZ\\[[0-9]+\\])(.*)");
-    res = std::regex_replace( res, re_insert, "$1" + newtag + "$2" );
+    res.reserve( sgf.size() + newtag.size());
+    size_t pos = 0;
+    for (auto &cut : cuts) {
+        if (insert_at >= pos && insert_at <= cut.first) {
+            res.append( sgf.substr( pos, insert_at - pos));
+            res += newtag;
+            pos = insert_at;
+            insert_at = NONE;
+        }
+        res.append( sgf.substr( pos, cut.first - pos));
+        pos = cut.second;
+    }
+    if (insert_at != NONE && insert_at >= pos) {
+        res.append( sgf.substr( pos, insert_at - pos));
+        res += newtag;
+        pos = insert_at;
+    }
+    res.append( sgf.substr( pos));
     return res;
 } // set_sgf_tag()
 
 // Look for AB[ab][cd] or AW[ab]... and transform into a linear vector
-// of ints
-//-----------------------------------------------------------
-inline std::vector<int> sgf2vec( const std::string &sgf_)
-{
-    //PLOG("==========\n");
-    const int NONE = 0;
-    const int AB = 1;
-    const int AW = 2;
-    std::string sgf = std::regex_replace( sgf_, std::regex("\\s+"), "" ); // no whitespace
-    int boardsz = std::stoi( get_sgf_tag( sgf, "SZ"));
-    std::vector<int> res( boardsz * boardsz, EEMPTY);
-    if (SZ(sgf) < 3) return res;
-    char window[4];
-    window[0] = sgf[0];
-    window[1] = sgf[1];
-    window[2] = sgf[2];
-    window[3] = '\0';
-    int i;
-    auto shiftwin = [&i,&window,&sgf](){window[0] = window[1]; window[1] = window[2]; window[2] = sgf[i++];};
-    int mode = NONE;
-    for (i=3; i < SZ(sgf); ) {
-        std::string tstr(window);
-        if (window[2] != '[') {
-            mode = NONE;
-            shiftwin();
-            continue;
-        }
-        else if (tstr == "AB[" || mode == AB) {
-            mode = AB;
-            if (i+2 > SZ(sgf)) break;
-            int col = sgf[i] - 'a';
-            shiftwin();
-            int row = sgf[i] - 'a';
-            shiftwin();
-            int idx = col + row * boardsz;
-            res[idx] = BBLACK;
-            //PLOG("B at %c%c\n",col+'a',row+'a');
-            shiftwin(); shiftwin();
-        }
-        else if (tstr == "AW[" || mode == AW) {
-            mode = AW;
-            if (i+2 > SZ(sgf)) break;
-            int col = sgf[i] - 'a';
-            shiftwin();
-            int row = sgf[i] - 'a';
-            shiftwin();
-            int idx = col + row * boardsz;
-            res[idx] = WWHITE;
-            //PLOG("W at %c%c\n",col+'a',row+'a');
-            shiftwin(); shiftwin();
+// of ints. Also takes AB[aa:cc] rectangles.
+//--------------------------------------------------------------------------
+inline std::vector<int> sgf2vec( std::string_view sgf)
+{
+    struct Setup { int color; std::string_view pt; };
+    std::vector<Setup> setup;
+    int boardsz = 0;
+    SgfTokenizer::for_each_value( sgf, [&](std::string_view ident, std::string_view val) {
+        if (ident == "AB") { setup.push_back( { BBLACK, val }); }
+        else if (ident == "AW") { setup.push_back( { WWHITE, val }); }
+        else if (ident == "SZ" && !boardsz) {
+            boardsz = atoi( std::string( val).c_str());
+            if (!board_size_ok( boardsz)) { boardsz = BOARD_SZ; }
         }
-        else {
-            mode = NONE;
-            shiftwin();
+    });
+    if (!boardsz) { boardsz = BOARD_SZ; }
+    std::vector<int> res( boardsz * boardsz, EEMPTY);
+    auto coord = [boardsz](char c) { int v = c - 'a'; return (v >= 0 && v < boardsz) ? v : -1; };
+    for (auto &s : setup) {
+        if (SZ(s.pt) != 2 && !(SZ(s.pt) == 5 && s.pt[2] == ':')) continue;
+        int col0 = coord( s.pt[0]), row0 = coord( s.pt[1]);
+        int col1 = col0, row1 = row0;
+        if (SZ(s.pt) == 5) { col1 = coord( s.pt[3]); row1 = coord( s.pt[4]); }
+        if (col0 < 0 || row0 < 0 || col1 < 0 || row1 < 0) continue;
+        for (int row = std::min( row0, row1); row <= std::max( row0, row1); row++) {
+            for (int col = std::min( col0, col1); col <= std::max( col0, col1); col++) {
+                res[col + row * boardsz] = s.color;
+            }
         }
-    } // for
+    }
     return res;
 } // sgf2vec
 
 // Convert row, col to screen image coordinates.
 //--------------------------------------------------------------------
-inline cv::Point rc2p (int innerwidth, int marg, int row, int col)
+inline cv::Point rc2p (int innerwidth, int marg, int row, int col, int boardsz = BOARD_SZ)
 {
     cv::Point res;
-    float d = innerwidth / (BOARD_SZ-1.0) ;
+    float d = innerwidth / (boardsz-1.0) ;
     res.x = ROUND( marg + d*col);
     res.y = ROUND( marg + d*row);
     return res;
 } // rc2p()
 
-// Draw gray sgf on a square single channel Mat @@@
+// Draw gray sgf on a square single channel Mat.
+// The empty board and the stones come from the renderer's cache.
 //----------------------------------------------------------------------
-inline void draw_sgf( const std::string &sgf_, cv::Mat &dst, int width)
+inline void draw_sgf( std::string_view sgf, cv::Mat &dst, int width)
 {
-    std::string sgf = std::regex_replace( sgf_, std::regex("\\s+"), "" ); // no whitespace
-    int height = width;
-    dst = cv::Mat( height, width, CV_8UC3);
-    dst = cv::Scalar::all(BOARD_GRAY);
-    std::vector<int> diagram( BOARD_SZ*BOARD_SZ,EEMPTY);
-    int marg = width * 0.05;
-    int innerwidth = width - 2*marg;
+    const int boardsz = sgf_board_size( sgf);
+    std::vector<int> diagram;
     if (SZ(sgf) > 3) {
         diagram = sgf2vec( sgf);
     }
-//    auto rc2p = [innerwidth, marg](int row, int col) {
-//        cv::Point res;
-//        float d = innerwidth / (BOARD_SZ-1.0) ;
-//        res.x = ROUND( marg + d*col);
-//        res.y = ROUND( marg + d*row);
-//        return res;
-//    };
-    // Draw the lines
-    ILOOP (BOARD_SZ) {
-        cv::Point p1 = rc2p( innerwidth, marg, i, 0);
-        cv::Point p2 = rc2p( innerwidth, marg, i, BOARD_SZ-1);
-        cv::Point q1 = rc2p( innerwidth, marg, 0, i);
-        cv::Point q2 = rc2p( innerwidth, marg, BOARD_SZ-1, i);
-        cv::line( dst, p1, p2, cv::Scalar(0,0,0), 1, cv::LINE_AA);
-        cv::line( dst, q1, q2, cv::Scalar(0,0,0), 1, cv::LINE_AA);
-    }
-    // Draw the hoshis
-    int r = ROUND( 0.15 * innerwidth / (BOARD_SZ-1.0));
-    cv::Point p;
-    p = rc2p( innerwidth, marg, 3, 3);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 15, 15);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 3, 15);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 15, 3);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 9, 9);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 9, 3);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 3, 9);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 9, 15);
-    cv::circle( dst, p, r, 0, -1);
-    p = rc2p( innerwidth, marg, 15, 9);
-    cv::circle( dst, p, r, 0, -1);
-
-    // Draw the stones
-    int rad = ROUND( 0.5 * innerwidth / (BOARD_SZ-1.0)) - 1;
-    ISLOOP (diagram) {
-        int r = i / BOARD_SZ;
-        int c = i % BOARD_SZ;
-        cv::Point p = rc2p( innerwidth, marg, r, c);
-        if (diagram[i] == WWHITE) {
-            cv::circle( dst, p, rad, cv::Scalar::all(255), -1, cv::LINE_AA);
-            cv::circle( dst, p, rad, cv::Scalar::all(0), 1, cv::LINE_AA);
-        }
-        else if (diagram[i] == BBLACK) {
-            cv::circle( dst, p, rad, cv::Scalar::all(0), -1, cv::LINE_AA);
-        }
-    } // ISLOOP
+    BoardRenderer::instance().render( diagram, boardsz, width, dst);
 } // draw_sgf()
 
 // Draw next move on the board
 //----------------------------------------------------------------------------------
-inline void draw_next_move( const std::string &coord, int color, cv::Mat &dst) {
+inline void draw_next_move( const std::string &coord, int color, cv::Mat &dst, int boardsz = BOARD_SZ) {
     auto width = dst.cols;
     if (coord.length() > 3) { return; }
     std::string colchars = "ABCDEFGHJKLMNOPQRST";
-    int row = BOARD_SZ - atoi( coord.c_str() + 1);
+    int row = boardsz - atoi( coord.c_str() + 1);
     auto col = (int)colchars.find( coord.c_str()[0]);
     int marg = width * 0.05;
     int innerwidth = width - 2*marg;
-    auto p = rc2p( innerwidth, marg, row, col);
-    int rad = ROUND( 0.5 * innerwidth / (BOARD_SZ-1.0)) - 1;
+    auto p = rc2p( innerwidth, marg, row, col, boardsz);
+    int rad = ROUND( 0.5 * innerwidth / (boardsz-1.0)) - 1;
     if (color == WWHITE) {
         cv::circle( dst, p, rad, 255, -1, cv::LINE_AA);
         cv::circle( dst, p, rad, 0, 1, cv::LINE_AA);
@@ -328,54 +288,19 @@ inline void draw_next_move( const std::string &coord, int color, cv::Mat &dst) {
 
 // Draw letter on intersection
 //-------------------------------------------------------------------------------------
-inline void mark_next_move( const std::string &coord, char letter, cv::Mat &dst) {
-    std::string txt( 1, letter);
-    auto width = dst.cols;
+inline void mark_next_move( const std::string &coord, char letter, cv::Mat &dst, int boardsz = BOARD_SZ) {
     if (!endsInDigit(coord)) return;
-    
     std::string colchars = "ABCDEFGHJKLMNOPQRST";
-    int row = BOARD_SZ - atoi( coord.c_str() + 1);
+    int row = boardsz - atoi( coord.c_str() + 1);
     auto col = (int)colchars.find( coord.c_str()[0]);
-    int marg = width * 0.05;
-    int innerwidth = width - 2*marg;
-    auto p = rc2p( innerwidth, marg, row, col);
-    
-    int fontFace = cv::FONT_HERSHEY_DUPLEX;
-    double fontScale = 0.8;
-    int thickness = 1;
-    int baseline=0;
-    auto textSize = cv::getTextSize( txt, fontFace,
-                                fontScale, thickness, &baseline);
-    int rad = ROUND( 0.5 * innerwidth / (BOARD_SZ-1.0)) - 1;
-    double alpha = 1.0;
-    draw_alpha_square( p, rad, dst, cv::Scalar::all(BOARD_GRAY), alpha);
-    p.x -= textSize.width / 2;
-    p.y += textSize.height / 2;
-    cv::putText( dst, txt, p, fontFace, fontScale,
-                cv::Scalar( 0xe0,0,0), thickness, cv::LINE_AA);
+    BoardRenderer::instance().draw_letter( letter, row, col, boardsz, dst);
 } // mark_next_move()
 
 // Draw score map on position image
 //------------------------------------------------------
-inline void draw_score( cv::Mat &img, double *terrmap)
+inline void draw_score( cv::Mat &img, double *terrmap, int boardsz = BOARD_SZ)
 {
-    int width = img.cols;
-    int marg = width * 0.05;
-    int innerwidth = width - 2*marg;
-    int rad = ROUND( 0.3 * innerwidth / (BOARD_SZ-1.0)) - 1;
-    ILOOP (BOARD_SZ*BOARD_SZ) {
-        double prob = terrmap[i];
-        //int r = (BOARD_SZ - i / BOARD_SZ) - 1;
-        int r = i / BOARD_SZ;
-        int c = i % BOARD_SZ;
-        cv::Point p = rc2p( innerwidth, marg, r,c);
-        if (prob < 0) { // white
-            draw_alpha_square( p, rad, img, cv::Scalar(255,255,255), fabs(prob));
-        } // for
-        else { // black
-            draw_alpha_square( p, rad, img, cv::Scalar(0,0,0), fabs(prob));
-        } // for
-    } // ILOOP
+    BoardRenderer::instance().draw_score( terrmap, boardsz, img);
 } // draw_score()
 
 // Reject board if opposing lines not parallel
@@ -567,66 +492,56 @@ inline void filter_lines( std::vector<cv::Vec2f> &lines)
     lines = good;
 } // filter_lines()
 
-// Find line where top_x and bot_x match best.
-//------------------------------------------------------------------------------------------------------------------------------------
-inline int closest_vert_line( const std::vector<cv::Vec2f> &lines, double top_x, double bot_x, double top_y, double bot_y,
-                             double &min_dtop, double &min_dbot, double &min_err, double &min_top_rho, double &min_bot_rho) // out
-{
-    std::vector<double> top_rhos = vec_extract( lines,
-                                               [top_y](cv::Vec2f a) { return x_from_y( top_y, a); });
-    std::vector<double> bot_rhos = vec_extract( lines,
-                                               [bot_y](cv::Vec2f a) { return x_from_y( bot_y, a); });
-    int minidx = -1;
-    min_err = 1E9;
-    ISLOOP (top_rhos) {
-        double dtop = fabs( top_rhos[i] - top_x );
-        double dbot = fabs( bot_rhos[i] - bot_x );
-        double err = dtop + dbot;
-        if (err < min_err) {
-            minidx = i;
-            min_err = err;
-            min_dtop = dtop;
-            min_dbot = dbot;
-            min_top_rho = top_rhos[i];
-            min_bot_rho = bot_rhos[i];
-        }
+// Replace lines by the lattice fitted to them. Line positions are measured at
+// two places, a and b, and the lines must be sorted by b. The lattice is fitted at b,
+// and the same indices are used at a. Real lines close to the lattice are kept,
+// gaps get synthesized lines. Emits up to boardsz+1 lines on each side of the middle.
+//----------------------------------------------------------------------------------------------
+template <typename GetA, typename GetB, typename Make>
+inline void lattice_lines( std::vector<cv::Vec2f> &lines, double pitch, double extent, double thresh,
+                          int boardsz, GetA get_a, GetB get_b, Make make_line)
+{
+    std::vector<double> as = vec_extract( lines, get_a);
+    std::vector<double> bs = vec_extract( lines, get_b);
+    Lattice1D lat_a, lat_b;
+    if (!lat_b.fit( bs, pitch) || !lat_a.fit_with_ks( as, lat_b.ks())) {
+        lines.clear();
+        return;
     }
-    return minidx;
-} // closest_vert_line()
-
-// Find line where left_y and right_y match best.
-//--------------------------------------------------------------------------------------------------------------------------------------
-inline int closest_horiz_line( const std::vector<cv::Vec2f> &lines, double left_y, double right_y, double left_x, double right_x,
-                             double &min_dleft, double &min_dright, double &min_err, double &min_left_rho, double &min_right_rho) // out
-{
-    std::vector<double> left_rhos = vec_extract( lines,
-                                                [left_x](cv::Vec2f a) { return y_from_x( left_x, a); });
-    std::vector<double> right_rhos = vec_extract( lines,
-                                                 [right_x](cv::Vec2f a) { return y_from_x( right_x, a); });
-    int minidx = -1;
-    min_err = 1E9;
-    ISLOOP (left_rhos) {
-        double dleft = fabs( left_rhos[i] - left_y );
-        double dright = fabs( right_rhos[i] - right_y );
-        double err = dleft + dright;
-        if (err < min_err) {
-            minidx = i;
-            min_err = err;
-            min_dleft = dleft;
-            min_dright = dright;
-            min_left_rho = left_rhos[i];
-            min_right_rho = right_rhos[i];
+    const std::vector<int> &ks = lat_b.ks();
+    const int R = boardsz + 1;
+    const int kmid = lat_b.index_near( bs[SZ(bs)/2]);
+    
+    // Which real line sits on each lattice index
+    std::vector<int> real_line( 2*R + 1, -1);
+    ISLOOP (ks) {
+        if (ks[i] == Lattice1D::NOK) continue;
+        int slot = ks[i] - kmid + R;
+        if (slot >= 0 && slot <= 2*R) { real_line[slot] = i; }
+    }
+    
+    std::vector<cv::Vec2f> res;
+    for (int k = kmid - R; k <= kmid + R; k++) {
+        double a = lat_a.at(k);
+        double b = lat_b.at(k);
+        if (a < 0 || a > extent) continue;
+        // If there is a close line, use it. Else interpolate.
+        int idx = real_line[k - kmid + R];
+        if (idx >= 0 && fabs( as[idx] - a) < thresh && fabs( bs[idx] - b) < thresh) {
+            a = as[idx];
+            b = bs[idx];
         }
+        res.push_back( make_line( a, b));
     }
-    return minidx;
-} // closest_horiz_line()
+    lines = res;
+} // lattice_lines()
 
-// Find the x-change per line in in upper and lower screen area and synthesize
-// the whole bunch starting at the middle. Replace synthesized lines with real
+// Find the x-change per line in in upper and lower screen area, fit a lattice
+// to all lines, and emit the whole bunch. Replace synthesized lines with real
 // ones if close enough.
 //------------------------------------------------------------------------------------------------
-inline void fix_vertical_lines( std::vector<cv::Vec2f> &lines, const std::vector<cv::Vec2f> &all_vert_lines,
-                        const cv::Mat &img, double x_thresh = 4.0)
+inline void fix_vertical_lines( std::vector<cv::Vec2f> &lines, const cv::Mat &img,
+                               double x_thresh = 4.0, int boardsz = BOARD_SZ)
 {
     const double width = img.cols;
     const int top_y = 0.2 * img.rows;
@@ -636,85 +551,28 @@ inline void fix_vertical_lines( std::vector<cv::Vec2f> &lines, const std::vector
               [bot_y](cv::Vec2f a, cv::Vec2f b) {
                   return x_from_y( bot_y, a) < x_from_y( bot_y, b);
               });
-    std::vector<double> top_rhos = vec_extract( lines,
-                                               [top_y](cv::Vec2f a) { return x_from_y( top_y, a); });
-    std::vector<double> bot_rhos = vec_extract( lines,
-                                               [bot_y](cv::Vec2f a) { return x_from_y( bot_y, a); });
+    auto top_x = [top_y](cv::Vec2f a) { return x_from_y( top_y, a); };
+    auto bot_x = [bot_y](cv::Vec2f a) { return x_from_y( bot_y, a); };
+    std::vector<double> top_rhos = vec_extract( lines, top_x);
+    std::vector<double> bot_rhos = vec_extract( lines, bot_x);
     auto d_top_rhos = vec_delta( top_rhos);
     auto d_bot_rhos = vec_delta( bot_rhos);
     vec_filter( d_top_rhos, [](double d){ return d > 0.8 * CROPSIZE && d < 1.5 * CROPSIZE;});
     vec_filter( d_bot_rhos, [](double d){ return d > 0.8 * CROPSIZE && d < 1.5 * CROPSIZE;});
-    //double d_top_rho = vec_median( d_top_rhos);
-    //double d_bot_rho = vec_median( d_bot_rhos);
     double d_rho = vec_median( vconc( d_top_rhos, d_bot_rhos));
 
-    // Find a good line close to the middle
-    int good_idx = good_center_line( lines);
-    if (good_idx < 0) {
-        lines.clear();
-        return;
-    }
-    cv::Vec2f med_line = lines[good_idx];
-    
-    // Interpolate the rest
-    std::vector<cv::Vec2f> synth_lines;
-    synth_lines.push_back(med_line);
-    double top_rho, bot_rho;
-    // If there is a close line, use it. Else interpolate.
-    const double X_THRESH = x_thresh; //6;
-    // Lines to the right
-    top_rho = x_from_y( top_y, med_line);
-    bot_rho = x_from_y( bot_y, med_line);
-    ILOOP(100) {
-        //top_rho += d_top_rho;
-        top_rho += d_rho;
-        bot_rho += d_rho;
-        double dtop, dbot, err, top_x, bot_x;
-        //closest_vert_line( all_vert_lines, top_rho, bot_rho, top_y, bot_y, // in
-        closest_vert_line( lines, top_rho, bot_rho, top_y, bot_y, // in
-                          dtop, dbot, err, top_x, bot_x); // out
-        if (dbot < X_THRESH && dtop < X_THRESH) {
-            top_rho   = top_x;
-            bot_rho   = bot_x;
-        }
-        cv::Vec2f line = segment2polar( cv::Vec4f( top_rho, top_y, bot_rho, bot_y));
-        if (top_rho > width) break;
-        if (i > BOARD_SZ) break;
-        synth_lines.push_back( line);
-    } // ILOOP
-    // Lines to the left
-    top_rho = x_from_y( top_y, med_line);
-    bot_rho = x_from_y( bot_y, med_line);
-    ILOOP(100) {
-        //top_rho -= d_top_rho;
-        top_rho -= d_rho;
-        bot_rho -= d_rho;
-        double dtop, dbot, err, top_x, bot_x;
-        //closest_vert_line( all_vert_lines, top_rho, bot_rho, top_y, bot_y, // in
-        closest_vert_line( lines, top_rho, bot_rho, top_y, bot_y, // in
-                          dtop, dbot, err, top_x, bot_x); // out
-        if (dbot < X_THRESH && dtop < X_THRESH) {
-            top_rho   = top_x;
-            bot_rho   = bot_x;
-        }
-        cv::Vec2f line = segment2polar( cv::Vec4f( top_rho, top_y, bot_rho, bot_y));
-        if (top_rho < 0) break;
-        if (i > BOARD_SZ) break;
-        synth_lines.push_back( line);
-    } // ILOOP
-    std::sort( synth_lines.begin(), synth_lines.end(),
-              [bot_y](cv::Vec2f a, cv::Vec2f b) {
-                  return x_from_y( bot_y, a) < x_from_y( bot_y, b);
-              });
-    lines = synth_lines;
+    lattice_lines( lines, d_rho, width, x_thresh, boardsz, top_x, bot_x,
+                  [top_y, bot_y](double top_rho, double bot_rho) {
+                      return segment2polar( cv::Vec4f( top_rho, top_y, bot_rho, bot_y));
+                  });
 } // fix_vertical_lines()
 
-// Find the y-change per line in in left and right screen area and synthesize
-// the whole bunch starting at the middle. Replace synthesized lines with real
+// Find the y-change per line in in left and right screen area, fit a lattice
+// to all lines, and emit the whole bunch. Replace synthesized lines with real
 // ones if close enough.
 //-------------------------------------------------------------------------------------------------------------
-inline void fix_horizontal_lines( std::vector<cv::Vec2f> &lines, const std::vector<cv::Vec2f> &all_horiz_lines,
-                                 const cv::Mat &img, double y_thresh = 4.0)
+inline void fix_horizontal_lines( std::vector<cv::Vec2f> &lines, const cv::Mat &img,
+                                 double y_thresh = 4.0, int boardsz = BOARD_SZ)
 {
     const double height = img.rows;
     const int left_x = 0.2 * img.cols;
@@ -724,77 +582,20 @@ inline void fix_horizontal_lines( std::vector<cv::Vec2f> &lines, const std::vect
               [right_x](cv::Vec2f a, cv::Vec2f b) {
                   return y_from_x( right_x, a) < y_from_x( right_x, b);
               });
-    std::vector<double> left_rhos = vec_extract( lines,
-                                                [left_x](cv::Vec2f a) { return y_from_x( left_x, a); });
-    std::vector<double> right_rhos = vec_extract( lines,
-                                                 [right_x](cv::Vec2f a) { return y_from_x( right_x, a); });
+    auto left_y  = [left_x](cv::Vec2f a) { return y_from_x( left_x, a); };
+    auto right_y = [right_x](cv::Vec2f a) { return y_from_x( right_x, a); };
+    std::vector<double> left_rhos = vec_extract( lines, left_y);
+    std::vector<double> right_rhos = vec_extract( lines, right_y);
     auto d_left_rhos = vec_delta( left_rhos);
     auto d_right_rhos = vec_delta( right_rhos);
     vec_filter( d_left_rhos, [](double d){ return d > 0.8 * CROPSIZE && d < 2 * CROPSIZE;});
     vec_filter( d_right_rhos, [](double d){ return d > 0.8 * CROPSIZE && d < 2 * CROPSIZE;});
-    //double d_left_rho  = vec_median( d_left_rhos);
-    //double d_right_rho = vec_median( d_right_rhos);
     double d_rho = vec_median( vconc( d_left_rhos, d_right_rhos));
 
-    // Find a good line close to the middle
-    int good_idx = good_center_line( lines);
-    if (good_idx < 0) {
-        lines.clear();
-        return;
-    }
-    cv::Vec2f med_line = lines[good_idx];
-    
-    // Interpolate the rest
-    std::vector<cv::Vec2f> synth_lines;
-    synth_lines.push_back(med_line);
-    double left_rho, right_rho;
-    // If there is a close line, use it. Else interpolate.
-    const double Y_THRESH = y_thresh; //6;
-    // Lines below
-    left_rho = y_from_x( left_x, med_line);
-    right_rho = y_from_x( right_x, med_line);
-    ILOOP(100) {
-        left_rho += d_rho;
-        right_rho += d_rho;
-        double dleft, dright, err, left_y, right_y;
-        //closest_horiz_line( all_horiz_lines, left_rho, right_rho, left_x, right_x, // in
-        closest_horiz_line( lines, left_rho, right_rho, left_x, right_x, // in
-                           dleft, dright, err, left_y, right_y); // out
-        if (dleft < Y_THRESH && dright < Y_THRESH) {
-            left_rho    = left_y;
-            right_rho   = right_y;
-        }
-        cv::Vec2f line = segment2polar( cv::Vec4f( left_x, left_rho, right_x, right_rho));
-        if (right_rho > height) break;
-        if (i > BOARD_SZ) break;
-        synth_lines.push_back( line);
-    } // ILOOP
-    
-    // Lines above
-    left_rho = y_from_x( left_x, med_line);
-    right_rho = y_from_x( right_x, med_line);
-    ILOOP(100) {
-        left_rho -= d_rho;
-        right_rho -= d_rho;
-        double dleft, dright, err, left_y, right_y;
-        //closest_horiz_line( all_horiz_lines, left_rho, right_rho, left_x, right_x, // in
-        closest_horiz_line( lines, left_rho, right_rho, left_x, right_x, // in
-                           dleft, dright, err, left_y, right_y); // out
-        if (dleft < Y_THRESH && dright < Y_THRESH) {
-            left_rho    = left_y;
-            right_rho   = right_y;
-        }
-        cv::Vec2f line = segment2polar( cv::Vec4f( left_x, left_rho, right_x, right_rho));
-        if (left_rho < 0) break;
-        if (i > BOARD_SZ) break;
-        synth_lines.push_back( line);
-    } // ILOOP
-     
-    std::sort( synth_lines.begin(), synth_lines.end(),
-              [right_x](cv::Vec2f a, cv::Vec2f b) {
-                  return y_from_x( right_x, a) < y_from_x( right_x, b);
-              });
-    lines = synth_lines;
+    lattice_lines( lines, d_rho, height, y_thresh, boardsz, left_y, right_y,
+                  [left_x, right_x](double left_rho, double right_rho) {
+                      return segment2polar( cv::Vec4f( left_x, left_rho, right_x, right_rho));
+                  });
 } // fix_horizontal_lines()
 
 
@@ -944,11 +745,13 @@ inline cv::Point tiebreak( const cv::Mat &m1, const cv::Mat &m2)
     return res;
 } // tiebreak()
 
-// Find corners by pixelwise boardness score, typically from a neural network
+// Find corners by pixelwise boardness score, typically from a neural network.
+// The N x N window has a fixed size, so the compiler can unroll the sums.
 //-------------------------------------------------------------------------------------------------------------------
+template <int N>
 inline
 Points2f find_corners_from_score( std::vector<cv::Vec2f> &horiz_lines, std::vector<cv::Vec2f> &vert_lines,
-                                 const Points2f &intersections, const cv::Mat &pixel_boardness, int board_sz = BOARD_SZ)
+                                 const Points2f &intersections, const cv::Mat &pixel_boardness)
 {
     int i;
     if (SZ(horiz_lines) < 3 || SZ(vert_lines) < 3) return Points2f();
@@ -969,29 +772,24 @@ Points2f find_corners_from_score( std::vector<cv::Vec2f> &horiz_lines, std::vect
             }
         } // CSLOOP
     } // RSLOOP
-    // Find top left for board_sz * board_sz region with highest score
+    // Find top left for N * N region with highest score
     double mmax = -1E9;
-    i = -1; int best_r = -1; int best_c = -1;
+    int best_r = -1; int best_c = -1;
     RSLOOP (horiz_lines) {
         CSLOOP (vert_lines) {
-            i++;
             double ssum = 0;
-            for (int rr = r; rr < r + board_sz; rr++) {
-                for (int cc = c; cc < c + board_sz; cc++) {
-                    if (!p_on_img( cv::Point( cc, rr), isec_boardness)) {
-                        ssum = -1E10;
-                        goto OUTER;
-                    }
-                    // Only sum inside
-                    if (rr == r || rr == r + board_sz - 1 ||
-                        cc == c || cc == c + board_sz -1)
-                    {}
-                    else {
-                        ssum += isec_boardness.at<uchar>(rr,cc);
+            if (r + N > isec_boardness.rows || c + N > isec_boardness.cols) {
+                ssum = -1E10;
+            }
+            else {
+                // Only sum inside
+                for (int rr = r + 1; rr < r + N - 1; rr++) {
+                    const uchar *row = isec_boardness.ptr<uchar>(rr);
+                    for (int cc = c + 1; cc < c + N - 1; cc++) {
+                        ssum += row[cc];
                     }
-                } // for(cc)
-            } // for(rr)
-        OUTER:
+                }
+            }
             if (ssum > mmax) {
                 mmax = ssum;
                 best_r = r; best_c = c;
@@ -1004,17 +802,28 @@ Points2f find_corners_from_score( std::vector<cv::Vec2f> &horiz_lines, std::vect
     
     auto rc2pf = [&](int r, int c) { return intersections[r * SZ(vert_lines) + c]; };
     Point2f tl = rc2pf( best_r, best_c);
-    Point2f tr = rc2pf( best_r, best_c + board_sz - 1);
-    Point2f br = rc2pf( best_r + board_sz - 1, best_c + board_sz - 1);
-    Point2f bl = rc2pf( best_r + board_sz - 1, best_c);
+    Point2f tr = rc2pf( best_r, best_c + N - 1);
+    Point2f br = rc2pf( best_r + N - 1, best_c + N - 1);
+    Point2f bl = rc2pf( best_r + N - 1, best_c);
     Points2f corners = { tl, tr, br, bl };
     // Return the board lines only
-    horiz_lines = vec_slice( horiz_lines, best_r, board_sz);
-    vert_lines  = vec_slice( vert_lines, best_c, board_sz);
+    horiz_lines = vec_slice( horiz_lines, best_r, N);
+    vert_lines  = vec_slice( vert_lines, best_c, N);
 
     return corners;
 } // find_corners_from_score()
 
+// Runtime board size version of find_corners_from_score<N>()
+//-------------------------------------------------------------------------------------------------------------------
+inline
+Points2f find_corners_from_score( std::vector<cv::Vec2f> &horiz_lines, std::vector<cv::Vec2f> &vert_lines,
+                                 const Points2f &intersections, const cv::Mat &pixel_boardness, int board_sz = BOARD_SZ)
+{
+    return with_board_size( board_sz, [&](auto bs) {
+        return find_corners_from_score<decltype(bs)::DIM>( horiz_lines, vert_lines, intersections, pixel_boardness);
+    });
+} // find_corners_from_score()
+
 // Get intersections of two sets of lines
 //--------------------------------------------------------------------------
 inline Points2f get_intersections( const std::vector<cv::Vec2f> &hlines,
@@ -1032,12 +841,16 @@ inline Points2f get_intersections( const std::vector<cv::Vec2f> &hlines,
     return res;
 } // get_intersections()
 
-// Unwarp the square defined by corners
-//-----------------------------------------------------------
-inline void zoom_in( const Points2f &corners, cv::Mat &M)
+// Unwarp the square defined by corners.
+// Smaller boards get a smaller square, so the line distance is the same as on 19x19.
+// The stone classifier only knows that one.
+//-----------------------------------------------------------------------------------------
+inline void zoom_in( const Points2f &corners, cv::Mat &M, int boardsz = BOARD_SZ)
 {
-    int lmarg = IMG_WIDTH / 20;
-    int tmarg = IMG_WIDTH / 20; // 15;
+    const double inner19 = IMG_WIDTH - 2 * (IMG_WIDTH / 20);
+    const double inner = inner19 * (boardsz - 1) / (BOARD_SZ - 1.0);
+    int lmarg = ROUND( (IMG_WIDTH - inner) / 2);
+    int tmarg = lmarg;
     // Target square for transform
     Points2f square = {
         cv::Point( lmarg, tmarg),
@@ -1062,6 +875,22 @@ bool corners_on_image(const Points2f &corners, const cv::Mat &M)
     return true;
 } // corners_on_image()
 
+// Draw board outline and intersections for video mode
+//--------------------------------------------------------------------------------------------
+inline void draw_board_overlay( cv::Mat &canvas, const Points2f &corners, const Points2f &intersections)
+{
+    if (SZ(corners) != 4) return;
+    if (!corners_on_image( corners, canvas)) return;
+    ILOOP (4) {
+        const cv::Point2f &a = corners[i];
+        const cv::Point2f &b = corners[(i+1) % 4];
+        draw_line( cv::Vec4f( a.x, a.y, b.x, b.y), canvas, cv::Scalar( 255,0,0,255));
+    }
+    ISLOOP (intersections) {
+        draw_point( intersections[i], canvas, 2, cv::Scalar(0,0,255,255));
+    }
+} // draw_board_overlay()
+
 // Fill image outside of board with average. Helps with adaptive thresholds.
 //----------------------------------------------------------------------------------
 inline void fill_outside_with_average_gray( cv::Mat &img, const Points2f &corners)
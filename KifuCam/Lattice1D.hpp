@@ -0,0 +1,216 @@
+//
+//  Lattice1D.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Fit a 1-D lattice x_k = a + b*k + c*k*k to noisy line positions.
+// The quadratic term models the pitch change from perspective.
+// Lines get their integer k from a consensus search, then the model is
+// refined by trimmed least squares, reassigning k as the model improves.
+
+#ifndef Lattice1D_hpp
+#define Lattice1D_hpp
+
+#include <iostream>
+#include <climits>
+#include "Common.hpp"
+
+class Lattice1D
+//=================
+{
+public:
+    static constexpr int NOK = INT_MIN;  // k of an outlier
+    static constexpr int REFINE_ITER = 4;
+
+    double a = 0, b = 0, c = 0;
+
+    // Position of lattice line k
+    inline double at( double k) const { return a + b*k + c*k*k; }
+
+    // Lattice index per input position from the last fit(). NOK for outliers.
+    inline const std::vector<int> &ks() const { return m_ks; }
+
+    // Fit to positions pos, sorted ascending, given a rough pitch.
+    // A line is an inlier if it is within tol * pitch of its lattice position.
+    //-----------------------------------------------------------------------------------
+    inline bool fit( const std::vector<double> &pos, double pitch, double tol = 0.25)
+    {
+        const int n = SZ(pos);
+        m_ks.assign( n, NOK);
+        if (n < 2 || pitch <= 0) return false;
+        const double maxd = tol * pitch;
+
+        // Consensus: which line puts the most others on a regular grid
+        int bestref = -1, bestcount = -1;
+        ILOOP (n) {
+            int count = 0;
+            JLOOP (n) {
+                double r = (pos[j] - pos[i]) / pitch;
+                if (fabs( r - ROUND(r)) * pitch < maxd) count++;
+            }
+            if (count > bestcount) { bestcount = count; bestref = i; }
+        }
+        ILOOP (n) {
+            double r = (pos[i] - pos[bestref]) / pitch;
+            if (fabs( r - ROUND(r)) * pitch < maxd) m_ks[i] = ROUND(r);
+        }
+        a = pos[bestref]; b = pitch; c = 0;
+        if (!solve( pos, m_ks)) return false;
+
+        // Refine. Far from the reference, the pitch has changed, so reassign k.
+        // Residuals tighten the tolerance as the fit gets better.
+        double sigma = maxd;
+        ILOOP (REFINE_ITER) {
+            m_resid.clear();
+            JLOOP (n) {
+                int k = index_near( pos[j]);
+                double d = fabs( at(k) - pos[j]);
+                m_ks[j] = (d < tol * local_pitch(k) && d < 3 * sigma) ? k : NOK;
+                if (m_ks[j] != NOK) m_resid.push_back( d);
+            }
+            unique_ks( pos);
+            if (!solve( pos, m_ks)) return false;
+            // Robust sigma from the median absolute residual, at least one pixel
+            sigma = std::max( 1.0, 1.4826 * vec_median( m_resid));
+        }
+        return true;
+    } // fit()
+
+    // Fit positions of the same lines somewhere else, with k from another fit
+    //------------------------------------------------------------------------------------
+    inline bool fit_with_ks( const std::vector<double> &pos, const std::vector<int> &ks)
+    {
+        m_ks = ks;
+        a = 0; b = 0; c = 0;
+        return solve( pos, m_ks);
+    } // fit_with_ks()
+
+    // Lattice index whose position is closest to x
+    //-------------------------------------------------
+    inline int index_near( double x) const
+    {
+        // Newton on a + b*k + c*k*k - x, starting from the linear guess
+        if (b == 0) return 0;
+        double k = (x - a) / b;
+        ILOOP (3) {
+            double slope = b + 2*c*k;
+            if (fabs( slope) < 1E-9) break;
+            k -= (at(k) - x) / slope;
+        }
+        return ROUND(k);
+    } // index_near()
+
+    // Distance to the next line at k
+    //-------------------------------------------
+    inline double local_pitch( int k) const
+    {
+        return fabs( b + 2*c*k);
+    }
+
+private:
+    // One line per lattice index. The one closest to the model wins.
+    //----------------------------------------------------------------
+    inline void unique_ks( const std::vector<double> &pos)
+    {
+        int prev = -1;
+        ISLOOP (pos) {
+            if (m_ks[i] == NOK) continue;
+            if (prev >= 0 && m_ks[prev] == m_ks[i]) {
+                if (fabs( at( m_ks[i]) - pos[i]) < fabs( at( m_ks[prev]) - pos[prev])) {
+                    m_ks[prev] = NOK;
+                }
+                else {
+                    m_ks[i] = NOK;
+                    continue;
+                }
+            }
+            prev = i;
+        }
+    } // unique_ks()
+
+    // Least squares for a, b, c over the inliers.
+    // Drops c if the k's do not spread enough to see it.
+    //-------------------------------------------------------------------------------
+    inline bool solve( const std::vector<double> &pos, const std::vector<int> &ks)
+    {
+        // Normal equations, sums of k^0..k^4 and x*k^0..x*k^2
+        double s[5] = {0,0,0,0,0}, t[3] = {0,0,0};
+        int kmin = INT_MAX, kmax = INT_MIN, n = 0;
+        ISLOOP (pos) {
+            if (ks[i] == NOK) continue;
+            double k = ks[i], kp = 1;
+            JLOOP (5) { s[j] += kp; if (j < 3) t[j] += pos[i] * kp; kp *= k; }
+            kmin = std::min( kmin, ks[i]); kmax = std::max( kmax, ks[i]);
+            n++;
+        }
+        if (n < 2 || kmin == kmax) return false;
+        if (n >= 4 && kmax - kmin >= 3) {
+            double A[3][4] = {
+                { s[0], s[1], s[2], t[0] },
+                { s[1], s[2], s[3], t[1] },
+                { s[2], s[3], s[4], t[2] } };
+            double x[3];
+            if (gauss3( A, x)) {
+                a = x[0]; b = x[1]; c = x[2];
+                return true;
+            }
+        }
+        // Straight lattice, no pitch change
+        double det = s[0] * s[2] - s[1] * s[1];
+        if (fabs( det) < 1E-12) return false;
+        a = (t[0] * s[2] - s[1] * t[1]) / det;
+        b = (s[0] * t[1] - s[1] * t[0]) / det;
+        c = 0;
+        return true;
+    } // solve()
+
+    // Gaussian elimination with partial pivoting on a 3x4 system
+    //----------------------------------------------------------------
+    static inline bool gauss3( double A[3][4], double x[3])
+    {
+        ILOOP (3) {
+            int piv = i;
+            for (int r = i+1; r < 3; r++) { if (fabs( A[r][i]) > fabs( A[piv][i])) piv = r; }
+            if (fabs( A[piv][i]) < 1E-12) return false;
+            if (piv != i) { JLOOP (4) { std::swap( A[i][j], A[piv][j]); } }
+            for (int r = i+1; r < 3; r++) {
+                double f = A[r][i] / A[i][i];
+                for (int j = i; j < 4; j++) A[r][j] -= f * A[i][j];
+            }
+        }
+        for (int i = 2; i >= 0; i--) {
+            double sum = A[i][3];
+            for (int j = i+1; j < 3; j++) sum -= A[i][j] * x[j];
+            x[i] = sum / A[i][i];
+        }
+        return true;
+    } // gauss3()
+
+    // Data
+    std::vector<int> m_ks;
+    std::vector<double> m_resid;
+}; // class Lattice1D
+
+#endif /* Lattice1D_hpp */
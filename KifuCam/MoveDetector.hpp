@@ -0,0 +1,342 @@
+//
+//  MoveDetector.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2019 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Turn a stream of recognized diagrams into a game record.
+// A diagram counts once it has been seen for STABLE_FRAMES frames in a row,
+// so hands over the board and single bad frames do nothing.
+// A stable diagram that is one or two legal moves (captures included) away from
+// the current position adds those moves. One that matches an earlier position on
+// the current line is a takeback, and the next move starts a variation.
+
+#ifndef MoveDetector_hpp
+#define MoveDetector_hpp
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <iostream>
+
+#include "Globals.h"
+#include "BoardSize.hpp"
+#include "GoBoard.hpp"
+#include "SgfWriter.hpp"
+#include "Zobrist.hpp"
+
+template <int N = BOARD_SZ>
+class MoveDetector
+//====================
+{
+public:
+    typedef GoBoard<N> Board;
+    typedef Zobrist<N> Zob;
+    typedef typename BoardSize<N>::Diagram Diagram;
+    static constexpr int NPOINTS = BoardSize<N>::NPOINTS;
+    static constexpr int STABLE_FRAMES = 3;
+    
+    // A move in the game tree. Node 0 is the start position.
+    struct Node {
+        int color = EEMPTY;
+        int idx = -1;
+        int parent = -1;
+        std::vector<int> children;
+        uint64_t hash = 0; // position after the move
+    };
+    
+    //------------------------
+    MoveDetector() { reset(); }
+    
+    //------------------------
+    void reset()
+    {
+        m_nodes.clear();
+        m_cur = 0;
+        m_board = Board();
+        m_last_hash = 0;
+        m_nsame = 0;
+        m_started = false;
+        m_nunexplained = 0;
+    } // reset()
+    
+    // Feed the diagram seen in one frame, NPOINTS values.
+    // Returns the number of moves added, 0 to 2.
+    //------------------------------------------------------------
+    int observe( const int *diagram)
+    {
+        Diagram d;
+        ILOOP (NPOINTS) {
+            if (diagram[i] == DDONTKNOW) { m_nsame = 0; return 0; } // not a position
+            d[i] = diagram[i];
+        }
+        const uint64_t h = Zob::hash( d);
+        if (h == m_last_hash && m_nsame) { m_nsame++; }
+        else { m_last_hash = h; m_nsame = 1; }
+        if (m_nsame != STABLE_FRAMES) { return 0; } // act once per stable diagram
+        
+        if (!m_started) {
+            // Whatever is on the board when we start is the setup
+            m_root = d;
+            m_board = Board( d);
+            m_nodes.assign( 1, Node());
+            m_nodes[0].hash = m_board.hash();
+            m_cur = 0;
+            m_started = true;
+            return 0;
+        }
+        if (h == m_board.hash()) { return 0; }
+        // Back to an earlier position on this line
+        for (int n = m_nodes[m_cur].parent; n >= 0; n = m_nodes[n].parent) {
+            if (m_nodes[n].hash == h) { goto_node( n); return 0; }
+        }
+        return try_moves( d, h);
+    } // observe()
+    
+    //---------------------------------------------------------
+    int observe( const std::vector<int> &diagram)
+    {
+        if (SZ(diagram) != NPOINTS) { return 0; }
+        return observe( diagram.data());
+    }
+    
+    bool started() const { return m_started; }
+    const Board& board() const { return m_board; }
+    const std::vector<Node>& nodes() const { return m_nodes; }
+    int current() const { return m_cur; }
+    // Stable diagrams we could not explain with legal moves
+    int nunexplained() const { return m_nunexplained; }
+    
+    // Moves from the start to the current position
+    //-------------------------------------------------
+    int nmoves() const
+    {
+        int res = 0;
+        for (int n = m_cur; n > 0; n = m_nodes[n].parent) { res++; }
+        return res;
+    } // nmoves()
+    
+    // The whole tree as sgf. Setup stones in the root node, variations in parentheses.
+    //---------------------------------------------------------------------------------------
+    void write_sgf( SgfWriter &w) const
+    {
+        w.raw( "(;GM[1]FF[4]CA[UTF-8]AP[KifuCam]").prop( "SZ", N);
+        if (m_started) {
+            for (int color : { BBLACK, WWHITE }) {
+                bool first = true;
+                ILOOP (NPOINTS) {
+                    if (m_root[i] != color) continue;
+                    if (first) { w.raw( color == BBLACK ? "AB" : "AW"); first = false; }
+                    w.point( i % N, i / N);
+                }
+            }
+            write_children( w, 0);
+        }
+        w.raw( ")\n");
+    } // write_sgf()
+    
+    //---------------------------
+    std::string sgf() const
+    {
+        SgfWriter w;
+        write_sgf( w);
+        return w.take();
+    } // sgf()
+    
+    static int test();
+    
+private:
+    // One move, or two moves of different colors, from here to d
+    //------------------------------------------------------------------
+    int try_moves( const Diagram &d, uint64_t h)
+    {
+        int added[2]; int nadded = 0;
+        ILOOP (NPOINTS) {
+            if (!m_board.isempty( i) || (d[i] != BBLACK && d[i] != WWHITE)) continue;
+            if (nadded == 2) { m_nunexplained++; return 0; }
+            added[nadded++] = i;
+        }
+        if (nadded == 1) {
+            const int p = added[0];
+            Board b = m_board;
+            if (legal( b, d[p], p) && (b.place_stone( d[p], p), b.hash() == h)) {
+                add_move( d[p], p);
+                return 1;
+            }
+        }
+        else if (nadded == 2 && d[added[0]] != d[added[1]]) {
+            // Try alternating colors first
+            if (d[added[0]] == m_nodes[m_cur].color) { std::swap( added[0], added[1]); }
+            for (int k = 0; k < 2; k++) {
+                const int p = added[k], q = added[1-k];
+                Board b = m_board;
+                if (!legal( b, d[p], p)) continue;
+                b.place_stone( d[p], p);
+                if (!legal( b, d[q], q)) continue;
+                b.place_stone( d[q], q);
+                if (b.hash() != h) continue;
+                add_move( d[p], p);
+                add_move( d[q], q);
+                return 2;
+            }
+        }
+        m_nunexplained++;
+        return 0;
+    } // try_moves()
+    
+    //------------------------------------------------------------
+    static bool legal( const Board &b, int color, int idx)
+    {
+        return b.isempty( idx) && !b.is_self_capture( color, idx);
+    } // legal()
+    
+    // Play a move. If the tree has it already, follow it.
+    //---------------------------------------------------------
+    void add_move( int color, int idx)
+    {
+        m_board.place_stone( color, idx);
+        for (int c : m_nodes[m_cur].children) {
+            if (m_nodes[c].color == color && m_nodes[c].idx == idx) { m_cur = c; return; }
+        }
+        Node node;
+        node.color = color;
+        node.idx = idx;
+        node.parent = m_cur;
+        node.hash = m_board.hash();
+        m_nodes.push_back( node);
+        int n = SZ(m_nodes) - 1;
+        m_nodes[m_cur].children.push_back( n);
+        m_cur = n;
+    } // add_move()
+    
+    // Set the board to the position at node n
+    //----------------------------------------------
+    void goto_node( int n)
+    {
+        std::vector<int> path;
+        for (int k = n; k > 0; k = m_nodes[k].parent) { path.push_back( k); }
+        m_board = Board( m_root);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            m_board.place_stone( m_nodes[*it].color, m_nodes[*it].idx);
+        }
+        m_cur = n;
+    } // goto_node()
+    
+    // Moves after node n. The main line goes straight on, variations get parentheses.
+    //------------------------------------------------------------------------------------
+    void write_children( SgfWriter &w, int n) const
+    {
+        while (SZ(m_nodes[n].children) == 1) {
+            n = m_nodes[n].children[0];
+            write_move( w, n);
+        }
+        for (int c : m_nodes[n].children) {
+            w.raw( '(');
+            write_move( w, c);
+            write_children( w, c);
+            w.raw( ')');
+        }
+    } // write_children()
+    
+    //----------------------------------------------------
+    void write_move( SgfWriter &w, int n) const
+    {
+        const Node &node = m_nodes[n];
+        w.raw( node.color == BBLACK ? ";B" : ";W").point( node.idx % N, node.idx / N);
+    } // write_move()
+    
+    // Data
+    Diagram m_root;     // start position
+    std::vector<Node> m_nodes;
+    int m_cur;          // node of the current position
+    Board m_board;      // current position
+    uint64_t m_last_hash;
+    int m_nsame;        // frames the last diagram has been seen in a row
+    bool m_started;
+    int m_nunexplained;
+}; // class MoveDetector
+
+// Examples and checks. Returns the number of failures.
+//--------------------------------------------------------------
+template <int N>
+int MoveDetector<N>::test()
+{
+    TestCheck check( "MoveDetector::test");
+    MoveDetector md;
+    std::vector<int> d( NPOINTS, EEMPTY);
+    auto rc = [](int r, int c) { return r*N + c; };
+    auto show = [&md, &d](int nframes) {
+        int res = 0;
+        ILOOP (nframes) { res += md.observe( d); }
+        return res;
+    };
+    
+    show( STABLE_FRAMES);
+    check( md.started(), "start");
+    d[rc(2,2)] = BBLACK;
+    check( show( STABLE_FRAMES + 5) == 1, "first move once");
+    
+    // A hand over the board for a frame or two changes nothing
+    std::vector<int> clean = d;
+    ILOOP (N) { d[rc(4,i)] = BBLACK; }
+    show( STABLE_FRAMES - 1);
+    d = clean;
+    check( show( STABLE_FRAMES) == 0 && md.nmoves() == 1, "hand");
+    
+    // Capture in the corner
+    d[rc(0,0)] = WWHITE; show( STABLE_FRAMES);
+    d[rc(1,0)] = BBLACK; show( STABLE_FRAMES);
+    d[rc(8,8)] = WWHITE; show( STABLE_FRAMES);
+    d[rc(0,1)] = BBLACK; d[rc(0,0)] = EEMPTY;
+    check( show( STABLE_FRAMES) == 1, "capture");
+    check( md.board().isempty( rc(0,0)) && md.nmoves() == 5, "captured stone gone");
+    
+    // Two moves between stable frames
+    d[rc(6,6)] = WWHITE; d[rc(6,2)] = BBLACK;
+    check( show( STABLE_FRAMES) == 2 && md.nmoves() == 7, "two moves");
+    
+    // Something that is no legal move
+    std::vector<int> before = d;
+    d[rc(5,5)] = BBLACK; d[rc(5,6)] = BBLACK;
+    check( show( STABLE_FRAMES) == 0 && md.nunexplained() == 1, "not a move");
+    
+    // Take back the last move and play elsewhere: a variation
+    d = before;
+    d[rc(6,2)] = EEMPTY;
+    check( show( STABLE_FRAMES) == 0 && md.nmoves() == 6, "takeback");
+    d[rc(3,3)] = BBLACK;
+    check( show( STABLE_FRAMES) == 1 && md.nmoves() == 7, "variation");
+    
+    std::string sgf = md.sgf();
+    check( sgf.find( ";B[cc];W[aa];B[ab];W[ii];B[ba];W[gg](;B[cg])(;B[dd]))") != std::string::npos, "sgf");
+    SgfTokenizer tz( sgf);
+    SgfTokenizer::Token tok;
+    int nmoves = 0;
+    while (tz.next( tok)) { if (tok.kind == SgfTokenizer::VALUE && (tok.ident == "B" || tok.ident == "W")) nmoves++; }
+    check( nmoves == 8, "sgf moves");
+    return check.nfails();
+} // test()
+
+#endif /* MoveDetector_hpp */
@@ -110,12 +110,15 @@ inline void warp_points( const Points &points_in, const cv::Mat &M,
 inline float parallel_projection( cv::Size sz, const std::vector<cv::Vec2f> &plines_,
                                  float &minphi, cv::Mat &minM, cv::Mat &invM)
 {
-    auto paralellity = [plines_]( const cv::Mat &M) {
-        std::vector<cv::Vec2f> plines;
+    // Buffers live across the 240 iterations below
+    std::vector<cv::Vec2f> plines;
+    std::vector<double> thetas;
+    auto paralellity = [&plines_, &plines, &thetas]( const cv::Mat &M) {
         warp_plines( plines_, M, plines);
-        auto thetas = vec_extract( plines, [](cv::Vec2f line) { return line[1]; } );
-        double q1 = vec_q1( thetas);
-        double q3 = vec_q3( thetas);
+        thetas.resize( SZ(plines));
+        ISLOOP (plines) { thetas[i] = plines[i][1]; }
+        double q1, med, q3;
+        quartiles( thetas.data(), SZ(thetas), q1, med, q3);
         double dq = q3 - q1;
         return dq;
     }; // paralellity()
@@ -144,11 +147,14 @@ inline float straight_rotation( cv::Size sz, const std::vector<cv::Vec2f> &pline
                                float &minphi, cv::Mat &minM, cv::Mat &invM)
 {
     Point2f center( sz.width/2.0, sz.height/2.0);
-    auto straightness = [plines_]( const cv::Mat &M) {
-        std::vector<cv::Vec2f> plines;
+    // Buffers live across the 161 iterations below
+    std::vector<cv::Vec2f> plines;
+    std::vector<double> thetas;
+    auto straightness = [&plines_, &plines, &thetas]( const cv::Mat &M) {
         warp_plines( plines_, M, plines);
-        auto thetas = vec_extract( plines, [](cv::Vec2f line) { return line[1]; } );
-        double med = vec_median( thetas);
+        thetas.resize( SZ(plines));
+        ISLOOP (plines) { thetas[i] = plines[i][1]; }
+        double med = select_kth( thetas.data(), SZ(thetas), SZ(thetas) / 2);
         return fabs(PI/2 - med);
     }; // straightness()
     double phi;
@@ -168,6 +174,116 @@ inline float straight_rotation( cv::Size sz, const std::vector<cv::Vec2f> &pline
     return minstr;
 } // straight_rotation()
 
+// Vanishing point of a bunch of polar lines, as a unit homogeneous vector.
+// Coordinates are centered on the image and scaled by max(w,h)/2, so a vanishing
+// point at infinity is no special case. Least squares: minimize sum w_i * (l_i . v)^2
+// with |v| = 1, which is the eigenvector of sum w_i * l_i * l_i^T with the smallest
+// eigenvalue. Then reweight to damp lines that miss the point.
+//----------------------------------------------------------------------------------------
+inline bool vanishing_point( cv::Size sz, const std::vector<cv::Vec2f> &plines, cv::Vec3d &vp)
+{
+    const int ROUNDS = 3;
+    if (SZ(plines) < 3) return false;
+    const double cx = sz.width / 2.0;
+    const double cy = sz.height / 2.0;
+    const double s = MAX( sz.width, sz.height) / 2.0;
+    // x*cos(theta) + y*sin(theta) = rho in normalized coordinates
+    std::vector<cv::Vec3d> ls( SZ(plines));
+    ISLOOP (plines) {
+        const double rho = plines[i][0], theta = plines[i][1];
+        const double c = cos( theta), sn = sin( theta);
+        ls[i] = cv::Vec3d( c, sn, (c * cx + sn * cy - rho) / s);
+    }
+    std::vector<double> w( SZ(ls), 1.0);
+    std::vector<double> resid( SZ(ls));
+    cv::Mat A( 3, 3, CV_64F), evals, evecs;
+    for (int round = 0; round < ROUNDS; round++) {
+        A = 0.0;
+        ISLOOP (ls) {
+            for (int r=0; r < 3; r++) { for (int c=0; c < 3; c++) {
+                A.at<double>( r, c) += w[i] * ls[i][r] * ls[i][c];
+            }}
+        }
+        // Eigenvalues come sorted descending
+        if (!cv::eigen( A, evals, evecs)) return false;
+        vp = cv::Vec3d( evecs.at<double>( 2, 0), evecs.at<double>( 2, 1), evecs.at<double>( 2, 2));
+        // Cauchy weights, with a robust sigma from the median residual
+        ISLOOP (ls) { resid[i] = fabs( ls[i].dot( vp)); }
+        double sigma = 1.4826 * vec_median( resid) + 1E-9;
+        ISLOOP (ls) { w[i] = 1.0 / (1.0 + SQR( resid[i] / (2 * sigma))); }
+    } // for round
+    return true;
+} // vanishing_point()
+
+// Rectifying homography in closed form from the vanishing points of the horizontals
+// and the verticals. Send the vanishing line to infinity, which makes both families
+// parallel, then shear so they become horizontal and vertical. Lengths along both line
+// directions stay the same at the image center.
+// If pts is not empty, shrink and shift so the warped pts fit into the image.
+// theta is the angle of the horizontals in degrees, like in straight_rotation().
+// Returns false if the vanishing points make no sense. Then use the angle sweeps.
+//-------------------------------------------------------------------------------------------
+inline bool vanishing_projection( cv::Size sz, const std::vector<cv::Vec2f> &horiz,
+                                 const std::vector<cv::Vec2f> &vert, const Points &pts,
+                                 float &theta, cv::Mat &M, cv::Mat &invM)
+{
+    cv::Vec3d vh, vv;
+    if (!vanishing_point( sz, horiz, vh)) return false;
+    if (!vanishing_point( sz, vert, vv)) return false;
+    // The vanishing line must stay clear of the image
+    cv::Vec3d l = vh.cross( vv);
+    if (fabs( l[2]) < 1.0 * hypot( l[0], l[1])) return false;
+    cv::Matx33d Hp( 1, 0, 0,
+                   0, 1, 0,
+                   l[0] / l[2], l[1] / l[2], 1);
+    // Hp keeps the first two coordinates of points on the vanishing line,
+    // so these are the line directions after Hp.
+    cv::Vec2d dh( vh[0], vh[1]), dv( vv[0], vv[1]);
+    dh /= cv::norm( dh); dv /= cv::norm( dv);
+    if (dh[0] < 0) dh = -dh;
+    if (dv[1] < 0) dv = -dv;
+    // Map dh to (1,0) and dv to (0,1)
+    const double det = dh[0] * dv[1] - dv[0] * dh[1];
+    if (det < 0.5) return false; // lines too far from perpendicular
+    cv::Matx33d Af( dv[1] / det, -dv[0] / det, 0,
+                   -dh[1] / det, dh[0] / det, 0,
+                   0, 0, 1);
+    // Back to pixels
+    const double cx = sz.width / 2.0;
+    const double cy = sz.height / 2.0;
+    const double s = MAX( sz.width, sz.height) / 2.0;
+    cv::Matx33d N( 1/s, 0, -cx/s,
+                  0, 1/s, -cy/s,
+                  0, 0, 1);
+    cv::Matx33d invN( s, 0, cx,
+                     0, s, cy,
+                     0, 0, 1);
+    cv::Matx33d H = invN * Af * Hp * N;
+
+    // Keep the board in the image. Ignore points beyond the vanishing line.
+    if (SZ(pts)) {
+        double xmin = 1E9, xmax = -1E9, ymin = 1E9, ymax = -1E9;
+        for (const auto &p : pts) {
+            cv::Vec3d q = H * cv::Vec3d( p.x, p.y, 1);
+            if (q[2] <= 0) continue;
+            xmin = MIN( xmin, q[0] / q[2]); xmax = MAX( xmax, q[0] / q[2]);
+            ymin = MIN( ymin, q[1] / q[2]); ymax = MAX( ymax, q[1] / q[2]);
+        }
+        if (xmax > xmin && ymax > ymin) {
+            const double MARGIN = 0.9;
+            double f = MIN( 1.0, MARGIN * MIN( sz.width / (xmax - xmin), sz.height / (ymax - ymin)));
+            cv::Matx33d F( f, 0, cx - f * (xmin + xmax) / 2,
+                          0, f, cy - f * (ymin + ymax) / 2,
+                          0, 0, 1);
+            H = F * H;
+        }
+    }
+    theta = atan2( dh[1], dh[0]) * 180 / PI;
+    M = cv::Mat( H).clone();
+    invM = M.inv();
+    return true;
+} // vanishing_projection()
+
 // Get affine transform to scale image
 //-----------------------------------------------
 inline cv::Mat scale_transform( double scale)
@@ -202,13 +318,96 @@ inline void unwarp_points( cv::Mat &invProj, cv::Mat &invRot, cv::Mat &invDist,
     }
 } // unwarp_points()
 
+// Grid pitch from the spectrum of point coordinates along one axis.
+// Splat the coordinates into a histogram, window it, and take the strongest
+// frequency with a period between lo and hi. O(n log n), and no lines needed.
+// Returns false if there is no clear peak.
+//------------------------------------------------------------------------------------------
+inline bool fft_pitch( const std::vector<double> &coords, double lo, double hi, double &pitch)
+{
+    const int N = 2048; // zero padded, for resolution
+    const int MINPTS = 20;
+    const double MINPEAK = 2.5; // peak over mean magnitude in the band
+    const double HARMONIC = 0.8; // take half the frequency if it has this much of the peak
+    if (SZ(coords) < MINPTS) return false;
+    const double cmin = vec_min( coords);
+    const double extent = vec_max( coords) - cmin;
+    if (extent < 2 * hi || extent > N - 2) return false;
+    
+    thread_local std::vector<double> hist;
+    thread_local std::vector<cplx> spec;
+    hist.assign( N, 0.0);
+    spec.resize( N/2 + 1);
+    for (double c : coords) {
+        const double x = c - cmin;
+        const int i = (int)x;
+        const double f = x - i;
+        hist[i] += 1 - f;
+        hist[i+1] += f;
+    }
+    // Remove the mean, then Hann window over the occupied part
+    const int len = (int)extent + 2;
+    double mean = 0;
+    ILOOP (len) { mean += hist[i]; }
+    mean /= len;
+    ILOOP (len) { hist[i] = (hist[i] - mean) * 0.5 * (1 - cos( 2 * PI * i / (len - 1))); }
+    rfft( hist.data(), spec.data(), N);
+    
+    // Strongest bin in the band
+    const int klo = std::max( 2, (int)floor( N / hi));
+    const int khi = std::min( N/2 - 2, (int)ceil( N / lo));
+    if (khi <= klo) return false;
+    int kbest = -1;
+    double best = 0, sum = 0;
+    for (int k = klo; k <= khi; k++) {
+        const double mag = abs( spec[k]);
+        sum += mag;
+        if (mag > best) { best = mag; kbest = k; }
+    }
+    if (best < MINPEAK * sum / (khi - klo + 1)) return false;
+    // Points on a grid have harmonics. Prefer the fundamental.
+    const int kh = ROUND( kbest / 2.0);
+    int kfund = -1;
+    double fund = 0;
+    for (int k = std::max( klo, kh - 2); k <= std::min( khi, kh + 2); k++) {
+        if (abs( spec[k]) > fund) { fund = abs( spec[k]); kfund = k; }
+    }
+    if (kfund > 0 && fund >= HARMONIC * best) { kbest = kfund; }
+    // Parabolic interpolation between bins
+    const double a = abs( spec[kbest-1]), b = abs( spec[kbest]), c = abs( spec[kbest+1]);
+    const double denom = a - 2*b + c;
+    const double d = denom < 0 ? 0.5 * (a - c) / denom : 0;
+    pitch = N / (kbest + d);
+    return pitch >= lo && pitch <= hi;
+} // fft_pitch()
+
+// Size of the image after pitch_scale(). Allocate dst with this.
+//-------------------------------------------------------------
+inline cv::Size pitch_scaled_size( double pitch, cv::Size sz)
+{
+    const double scale = CROPSIZE / pitch;
+    return cv::Size( sz.width * scale, sz.height * scale);
+}
+
+// Scale image to make the grid pitch CROPSIZE. Return the transform and its inverse.
+// dst must not be src.
+//------------------------------------------------------------------------------------------------------
+inline void pitch_scale( double pitch, const cv::Mat &src, cv::Mat &dst, float &scale, cv::Mat &Md, cv::Mat &invMd)
+{
+    scale = CROPSIZE / pitch;
+    Md = scale_transform( scale);
+    invMd = scale_transform( 1.0 / scale);
+    cv::warpAffine( src, dst, Md, pitch_scaled_size( pitch, src.size()));
+} // pitch_scale()
+
 // Scale image to make distance of verticals == CROPSIZE. Return the transform and its inverse.
+// If there is no distance, dst is a copy of src.
 //-----------------------------------------------------------------------------------------------
-inline void fix_vertical_distance( std::vector<cv::Vec2f> &lines, cv::Mat &small_img,
+inline void fix_vertical_distance( std::vector<cv::Vec2f> &lines, const cv::Mat &src, cv::Mat &dst,
                                   float &scale, cv::Mat &Md, cv::Mat &invMd)
 
 {
-    const int mid_y = 0.5 * small_img.rows;
+    const int mid_y = 0.5 * src.rows;
 
     std::sort( lines.begin(), lines.end(),
               [mid_y](cv::Vec2f a, cv::Vec2f b) {
@@ -223,15 +422,28 @@ inline void fix_vertical_distance( std::vector<cv::Vec2f> &lines, cv::Mat &small
         Md = scale_transform(1.0);
         invMd = scale_transform(1.0);
         scale = 1.0;
+        src.copyTo( dst);
         return;
     }
 
     double d_mid_rho = vec_median( d_mid_rhos);
-    scale = CROPSIZE / d_mid_rho; 
-    Md = scale_transform( scale);
-    invMd = scale_transform( 1.0 / scale);
-    const cv::Size sz( small_img.cols * scale, small_img.rows * scale);
-    cv::warpAffine( small_img, small_img, Md, sz);
+    pitch_scale( d_mid_rho, src, dst, scale, Md, invMd);
 } // fix_vertical_distance()
 
+// Md * Mp * Ms as one 3x3 perspective transform.
+// Ms and Md are 2x3 affine, Mp is 3x3. Lets us warp an image once instead of three times.
+//----------------------------------------------------------------------------------------------
+inline cv::Mat compose_warps( const cv::Mat &Ms, const cv::Mat &Mp, const cv::Mat &Md)
+{
+    auto to3x3 = [](const cv::Mat &m) {
+        cv::Mat res = cv::Mat::eye( 3, 3, CV_64F);
+        cv::Mat m64;
+        m.convertTo( m64, CV_64F);
+        m64.copyTo( res.rowRange( 0, m64.rows));
+        return res;
+    };
+    cv::Mat res = to3x3( Md) * to3x3( Mp) * to3x3( Ms);
+    return res;
+} // compose_warps()
+
 #endif /* Perspective_hpp */
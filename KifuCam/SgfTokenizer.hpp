@@ -0,0 +1,202 @@
+//
+//  SgfTokenizer.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Walk an sgf string once and hand out its tokens, without copying anything.
+// Values come back raw, as string_views into the source, escapes intact.
+// Use sgf_unescape() to get the text.
+
+#ifndef SgfTokenizer_hpp
+#define SgfTokenizer_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+#include "Common.hpp"
+
+class SgfTokenizer
+//====================
+{
+public:
+    enum Kind { END, OPEN, CLOSE, NODE, VALUE };
+    struct Token {
+        Kind kind = END;
+        std::string_view ident; // property identifier, for VALUE
+        std::string_view value; // between the brackets, raw
+        size_t prop_begin = 0;  // where the identifier starts
+        size_t begin = 0, end = 0; // the token, brackets included
+    };
+    
+    explicit SgfTokenizer( std::string_view sgf) : m_sgf(sgf) {}
+    
+    // Next token. False at the end.
+    // AB[aa][bb] gives two VALUE tokens, both with ident AB.
+    //-------------------------------------------------------------
+    inline bool next( Token &tok)
+    {
+        const size_t n = m_sgf.size();
+        while (m_pos < n) {
+            const char ch = m_sgf[m_pos];
+            tok.begin = m_pos;
+            if (ch == '(' || ch == ')' || ch == ';') {
+                tok.kind = (ch == '(') ? OPEN : (ch == ')') ? CLOSE : NODE;
+                tok.end = ++m_pos;
+                m_ident = std::string_view();
+                return true;
+            }
+            else if (ch == '[') {
+                // Value up to the first unescaped ]
+                size_t i = m_pos + 1;
+                while (i < n && m_sgf[i] != ']') {
+                    if (m_sgf[i] == '\\') i++;
+                    i++;
+                }
+                if (i >= n) { m_pos = n; break; } // unterminated, drop it
+                tok.kind = VALUE;
+                tok.ident = m_ident;
+                tok.prop_begin = m_ident_begin;
+                tok.value = m_sgf.substr( m_pos + 1, i - m_pos - 1);
+                tok.end = m_pos = i + 1;
+                return true;
+            }
+            else if (is_letter( ch)) {
+                size_t i = m_pos;
+                while (i < n && is_letter( m_sgf[i])) i++;
+                m_ident = m_sgf.substr( m_pos, i - m_pos);
+                m_ident_begin = m_pos;
+                m_pos = i;
+            }
+            else {
+                m_pos++; // whitespace and junk between tokens
+            }
+        } // while
+        tok = Token();
+        tok.begin = tok.end = n;
+        return false;
+    } // next()
+    
+    // Call f( ident, raw value) for every property value
+    //-----------------------------------------------------------------------
+    template <typename F>
+    static void for_each_value( std::string_view sgf, F &&f)
+    {
+        SgfTokenizer tz( sgf);
+        Token tok;
+        while (tz.next( tok)) {
+            if (tok.kind == VALUE) { f( tok.ident, tok.value); }
+        }
+    } // for_each_value()
+    
+    //----------------------
+    static int test();
+    
+private:
+    static bool is_letter( char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
+    
+    // Data
+    std::string_view m_sgf;
+    size_t m_pos = 0;
+    std::string_view m_ident;
+    size_t m_ident_begin = 0;
+}; // class SgfTokenizer
+
+// Text of a raw value. Backslash escapes the next char; backslash newline is a soft break.
+//-----------------------------------------------------------------------------------------------
+inline std::string sgf_unescape( std::string_view raw)
+{
+    std::string res;
+    res.reserve( raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c == '\\' && i + 1 < raw.size()) {
+            c = raw[++i];
+            if (c == '\n' || c == '\r') {
+                // Soft line break, also eat the other half of \r\n
+                if (i + 1 < raw.size() && (raw[i+1] == '\n' || raw[i+1] == '\r') && raw[i+1] != c) i++;
+                continue;
+            }
+        }
+        res += c;
+    }
+    return res;
+} // sgf_unescape()
+
+// Make text safe to put between brackets
+//----------------------------------------------------
+inline std::string sgf_escape( std::string_view text)
+{
+    std::string res;
+    res.reserve( text.size());
+    for (char c : text) {
+        if (c == ']' || c == '\\') res += '\\';
+        res += c;
+    }
+    return res;
+} // sgf_escape()
+
+// Examples and checks. Returns the number of failures.
+//--------------------------------------------------------------
+inline int SgfTokenizer::test()
+{
+    TestCheck check( "SgfTokenizer::test");
+    const std::string sgf = "(;GM[1] SZ[19]\n C[a \\] b \\\\ c]AB[aa][bb] AW [cc];B[dd](;W[ee]))";
+    std::vector<std::string> got;
+    SgfTokenizer tz( sgf);
+    Token tok;
+    while (tz.next( tok)) {
+        switch (tok.kind) {
+            case OPEN:  got.push_back( "("); break;
+            case CLOSE: got.push_back( ")"); break;
+            case NODE:  got.push_back( ";"); break;
+            default: got.push_back( std::string( tok.ident) + "=" + std::string( tok.value));
+        }
+    }
+    const std::vector<std::string> expected = {
+        "(", ";", "GM=1", "SZ=19", "C=a \\] b \\\\ c", "AB=aa", "AB=bb", "AW=cc",
+        ";", "B=dd", "(", ";", "W=ee", ")", ")" };
+    check( got == expected, "token stream");
+    
+    // Token positions let you cut properties out
+    SgfTokenizer tz2( sgf);
+    while (tz2.next( tok) && !(tok.kind == VALUE && tok.ident == "AB")) {}
+    check( sgf.substr( tok.prop_begin, tok.end - tok.prop_begin) == "AB[aa]", "prop_begin");
+    
+    check( sgf_unescape( "a \\] b \\\\ c") == "a ] b \\ c", "unescape");
+    check( sgf_unescape( "x\\\ny") == "xy", "soft break");
+    check( sgf_escape( "a ] b \\ c") == "a \\] b \\\\ c", "escape");
+    check( sgf_unescape( sgf_escape( "]]\\[")) == "]]\\[", "round trip");
+    
+    // Unterminated value at the end is dropped, no crash
+    SgfTokenizer tz3( "(;C[abc");
+    int nvals = 0;
+    while (tz3.next( tok)) { if (tok.kind == VALUE) nvals++; }
+    check( nvals == 0, "unterminated");
+    return check.nfails();
+} // test()
+
+#endif /* SgfTokenizer_hpp */
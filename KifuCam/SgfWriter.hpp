@@ -0,0 +1,216 @@
+//
+//  SgfWriter.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Build sgf text in one growing buffer.
+// Values get escaped on the way in. Point lists go out as AB[aa][bb], one tag per list.
+// clear() keeps the capacity, so a writer reused across diagrams stops allocating.
+// The result can go straight to a file descriptor.
+
+#ifndef SgfWriter_hpp
+#define SgfWriter_hpp
+
+#include <string>
+#include <string_view>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "SgfTokenizer.hpp"
+
+class SgfWriter
+//=================
+{
+public:
+    // Bytes we expect for a diagram. Reserve this and nothing reallocates.
+    //---------------------------------------------------------------------------
+    inline static size_t estimate( int nstones, int nintersections)
+    {
+        const size_t HEADER = 256;        // root properties and date
+        const size_t PER_STONE = 4;       // [ab]
+        const size_t PER_INTERSECTION = 12; // (1234,1234),
+        return HEADER + PER_STONE * nstones + PER_INTERSECTION * nintersections;
+    } // estimate()
+    
+    // Start over, keep the memory
+    inline void clear() { m_buf.clear(); }
+    inline void reserve( size_t n) { m_buf.reserve( n); }
+    
+    // Text as is, no escaping
+    inline SgfWriter& raw( std::string_view s) { m_buf.append( s); return *this; }
+    inline SgfWriter& raw( char c) { m_buf.push_back( c); return *this; }
+    
+    // Integer as decimal text
+    //-------------------------------------
+    inline SgfWriter& num( int x)
+    {
+        char buf[16];
+        auto res = std::to_chars( buf, buf + sizeof(buf), x);
+        m_buf.append( buf, res.ptr - buf);
+        return *this;
+    } // num()
+    
+    // Fixed point, e.g. num( 0.5, 2) gives 0.50
+    //-------------------------------------------------
+    inline SgfWriter& num( double x, int decimals)
+    {
+        char buf[64];
+        int n = snprintf( buf, sizeof(buf), "%.*f", decimals, x);
+        if (n > 0) m_buf.append( buf, std::min( n, (int)sizeof(buf) - 1));
+        return *this;
+    } // num()
+    
+    // Value text between brackets, with ] and \ escaped
+    //------------------------------------------------------
+    inline SgfWriter& value( std::string_view text)
+    {
+        m_buf.push_back( '[');
+        for (char c : text) {
+            if (c == ']' || c == '\\') m_buf.push_back( '\\');
+            m_buf.push_back( c);
+        }
+        m_buf.push_back( ']');
+        return *this;
+    } // value()
+    
+    // A whole property, TAG[val]
+    //----------------------------------------------------------------
+    inline SgfWriter& prop( std::string_view tag, std::string_view val)
+    {
+        m_buf.append( tag);
+        return value( val);
+    } // prop()
+    
+    //--------------------------------------------------
+    inline SgfWriter& prop( std::string_view tag, int val)
+    {
+        m_buf.append( tag);
+        m_buf.push_back( '[');
+        num( val);
+        m_buf.push_back( ']');
+        return *this;
+    } // prop()
+    
+    // One point value [cr] of a list. Write the tag once before the first one.
+    // col and row are zero based.
+    //---------------------------------------------
+    inline SgfWriter& point( int col, int row)
+    {
+        const char v[4] = { '[', char('a' + col), char('a' + row), ']' };
+        m_buf.append( v, 4);
+        return *this;
+    } // point()
+    
+    inline const std::string& str() const { return m_buf; }
+    inline const char* c_str() const { return m_buf.c_str(); }
+    inline size_t size() const { return m_buf.size(); }
+    
+    // Hand the buffer over. The writer is empty afterwards.
+    //---------------------------------------------------------
+    inline std::string take()
+    {
+        std::string res;
+        res.swap( m_buf);
+        return res;
+    } // take()
+    
+    // Write everything to an open file descriptor. False on error.
+    //------------------------------------------------------------------
+    inline bool write_fd( int fd) const
+    {
+        const char *p = m_buf.data();
+        size_t left = m_buf.size();
+        while (left) {
+            ssize_t n = ::write( fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += n; left -= n;
+        }
+        return true;
+    } // write_fd()
+    
+    // Write to a file. Goes to a temp file first and gets renamed,
+    // so a reader never sees half an sgf. False on error.
+    //----------------------------------------------------------------
+    inline bool write_file( const std::string &fname) const
+    {
+        const std::string tmp = fname + ".tmp";
+        int fd = ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = write_fd( fd);
+        ok = (::close( fd) == 0) && ok;
+        if (ok) ok = (::rename( tmp.c_str(), fname.c_str()) == 0);
+        if (!ok) ::unlink( tmp.c_str());
+        return ok;
+    } // write_file()
+    
+    static int test();
+    
+private:
+    std::string m_buf;
+}; // class SgfWriter
+
+// Examples and checks. Returns the number of failures.
+//--------------------------------------------------------------
+inline int SgfWriter::test()
+{
+    TestCheck check( "SgfWriter::test");
+    SgfWriter w;
+    w.reserve( estimate( 3, 0));
+    const char *cap = w.c_str();
+    w.raw( "(;").prop( "SZ", 19).raw( ' ').prop( "C", "a ] b \\ c")
+     .raw( "AB").point( 0, 0).point( 18, 18).raw( "AW").point( 3, 2).raw( ")\n");
+    check( w.str() == "(;SZ[19] C[a \\] b \\\\ c]AB[aa][ss]AW[dc])\n", "output");
+    check( w.c_str() == cap, "no realloc within estimate");
+    
+    // The tokenizer reads back what we wrote
+    SgfTokenizer tz( w.str());
+    SgfTokenizer::Token tok;
+    std::string comment;
+    int nab = 0;
+    while (tz.next( tok)) {
+        if (tok.kind != SgfTokenizer::VALUE) continue;
+        if (tok.ident == "C") comment = sgf_unescape( tok.value);
+        if (tok.ident == "AB") nab++;
+    }
+    check( comment == "a ] b \\ c", "escape round trip");
+    check( nab == 2, "point list");
+    
+    w.clear();
+    w.num( -42).raw( ' ').num( 0.125, 2);
+    check( w.str() == "-42 0.12" || w.str() == "-42 0.13", "numbers");
+    std::string s = w.take();
+    check( w.size() == 0 && !s.empty(), "take");
+    return check.nfails();
+} // test()
+
+#endif /* SgfWriter_hpp */
@@ -0,0 +1,316 @@
+//
+//  Territory.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2019 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Guess who owns each point, without asking a bot.
+// Benson's algorithm finds groups that live no matter what, and their eyes.
+// Empty areas with only one color around them go to that color.
+// Everything else is decided by Bouzy's dilation and erosion of stone influence.
+// The result has the same format as the Katago terrmap: one value per point in [-1,1],
+// positive for black.
+
+#ifndef Territory_hpp
+#define Territory_hpp
+
+#include <array>
+#include <bitset>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Globals.h"
+#include "BoardSize.hpp"
+#include "GoBoard.hpp"
+
+template <int N = BOARD_SZ>
+class Territory
+//=================
+{
+public:
+    typedef GoBoard<N> Board;
+    static constexpr int NPOINTS = Board::NPOINTS;
+    typedef std::bitset<NPOINTS> Points;
+    typedef std::array<int, NPOINTS> Influence;
+    
+    static constexpr int DILATIONS = 5;  // Bouzy's 5/21 is the territory setting
+    static constexpr int EROSIONS = 21;
+    static constexpr int STONE_INFLUENCE = 128;
+    static constexpr int MAX_ENCLOSED = NPOINTS / 3; // bigger empty areas are not territory yet
+    
+    // Ownership per point into terrmap, positive for black.
+    // Returns the area score, black minus white minus komi.
+    //----------------------------------------------------------------------------
+    static double estimate( const Board &board, double *terrmap, double komi = 0)
+    {
+        Points balive, beyes, walive, weyes;
+        benson( board, BBLACK, balive, beyes);
+        benson( board, WWHITE, walive, weyes);
+        Influence infl;
+        bouzy( board, beyes | balive, weyes | walive, infl);
+        
+        int nblack = 0, nwhite = 0;
+        ILOOP (NPOINTS) {
+            double own;
+            if (balive[i] || beyes[i]) { own = 1.0; }
+            else if (walive[i] || weyes[i]) { own = -1.0; }
+            else if (board.color( i) == BBLACK) { own = 0.9; }
+            else if (board.color( i) == WWHITE) { own = -0.9; }
+            else { own = std::max( -0.8, std::min( 0.8, infl[i] / 16.0)); }
+            terrmap[i] = own;
+            if (own >= 0.5) { nblack++; }
+            else if (own <= -0.5) { nwhite++; }
+        } // ILOOP
+        enclosed( board, beyes | weyes, terrmap, nblack, nwhite);
+        return nblack - nwhite - komi;
+    } // estimate()
+    
+    // Benson's unconditional life for color col.
+    // alive gets the stones that cannot be captured, eyes the areas they enclose,
+    // including opponent stones in there.
+    //----------------------------------------------------------------------------
+    static void benson( const Board &board, int col, Points &alive, Points &eyes)
+    {
+        alive.reset(); eyes.reset();
+        // Regions: connected areas of points that are not col
+        std::array<int16_t, NPOINTS> region;
+        region.fill( -1);
+        std::vector<std::vector<int>> members;
+        std::vector<int> stack;
+        ILOOP (NPOINTS) {
+            if (board.color( i) == col || region[i] >= 0) { continue; }
+            int id = SZ(members);
+            members.emplace_back();
+            region[i] = id;
+            stack.push_back( i);
+            while (!stack.empty()) {
+                int p = stack.back(); stack.pop_back();
+                members[id].push_back( p);
+                Board::for_neighbors( p, [&](int n) {
+                    if (board.color( n) != col && region[n] < 0) { region[n] = id; stack.push_back( n); }
+                });
+            }
+        } // ILOOP
+        const int nregions = SZ(members);
+        
+        // Strings next to each region, and the ones each region is vital to.
+        // A region is vital to a string if all its empty points are liberties of the string.
+        std::vector<std::vector<int>> around( nregions), vital( nregions);
+        ILOOP (nregions) {
+            bool first_empty = true;
+            for (int p : members[i]) {
+                int roots[4]; int nroots = 0;
+                Board::for_neighbors( p, [&](int n) {
+                    if (board.color( n) != col) { return; }
+                    int r = board.string_id( n);
+                    for (int k = 0; k < nroots; k++) { if (roots[k] == r) { return; } }
+                    roots[nroots++] = r;
+                });
+                for (int k = 0; k < nroots; k++) {
+                    if (std::find( around[i].begin(), around[i].end(), roots[k]) == around[i].end()) {
+                        around[i].push_back( roots[k]);
+                    }
+                }
+                if (!board.isempty( p)) { continue; }
+                if (first_empty) { vital[i].assign( roots, roots + nroots); first_empty = false; continue; }
+                vital[i].erase( std::remove_if( vital[i].begin(), vital[i].end(), [&](int r) {
+                    return std::find( roots, roots + nroots, r) == roots + nroots;
+                }), vital[i].end());
+            } // for p
+        } // ILOOP
+        
+        // Drop strings with fewer than two vital regions, then regions next to a dropped
+        // string, until nothing changes.
+        std::bitset<NPOINTS> dropped_string;   // by root
+        std::vector<bool> dropped_region( nregions, false);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            std::array<int8_t, NPOINTS> nvital;
+            nvital.fill( 0);
+            ILOOP (nregions) {
+                if (dropped_region[i]) { continue; }
+                for (int r : vital[i]) { if (nvital[r] < 2) nvital[r]++; }
+            }
+            ILOOP (NPOINTS) {
+                if (board.color( i) != col || board.string_id( i) != i || dropped_string[i]) { continue; }
+                if (nvital[i] < 2) { dropped_string.set( i); changed = true; }
+            }
+            ILOOP (nregions) {
+                if (dropped_region[i]) { continue; }
+                for (int r : around[i]) {
+                    if (dropped_string[r]) { dropped_region[i] = true; changed = true; break; }
+                }
+            }
+        } // while
+        
+        ILOOP (NPOINTS) {
+            if (board.color( i) == col) {
+                if (!dropped_string[board.string_id( i)]) { alive.set( i); }
+            }
+            else {
+                int r = region[i];
+                if (!dropped_region[r] && !vital[r].empty() && !around[r].empty()) { eyes.set( i); }
+            }
+        } // ILOOP
+    } // benson()
+    
+    // Bouzy's dilation and erosion of stone influence. Positive is black.
+    // Points in black_fixed or white_fixed start out as black or white stones.
+    //------------------------------------------------------------------------------------
+    static void bouzy( const Board &board, const Points &black_fixed, const Points &white_fixed,
+                      Influence &infl)
+    {
+        ILOOP (NPOINTS) {
+            if (black_fixed[i]) { infl[i] = STONE_INFLUENCE; }
+            else if (white_fixed[i]) { infl[i] = -STONE_INFLUENCE; }
+            else if (board.color( i) == BBLACK) { infl[i] = STONE_INFLUENCE; }
+            else if (board.color( i) == WWHITE) { infl[i] = -STONE_INFLUENCE; }
+            else { infl[i] = 0; }
+        }
+        Influence next;
+        // Dilate: grow into points with no enemy influence around
+        ILOOP (DILATIONS) {
+            for (int p = 0; p < NPOINTS; p++) {
+                int npos = 0, nneg = 0;
+                Board::for_neighbors( p, [&](int n) { npos += infl[n] > 0; nneg += infl[n] < 0; });
+                int v = infl[p];
+                if (v >= 0 && !nneg) { v += npos; }
+                if (infl[p] <= 0 && !npos) { v -= nneg; }
+                next[p] = v;
+            }
+            infl = next;
+        }
+        // Erode: shrink where neighbors are not on our side
+        ILOOP (EROSIONS) {
+            for (int p = 0; p < NPOINTS; p++) {
+                int v = infl[p];
+                int nother = 0;
+                Board::for_neighbors( p, [&](int n) {
+                    if (v > 0 && infl[n] <= 0) nother++;
+                    if (v < 0 && infl[n] >= 0) nother++;
+                });
+                if (v > 0) { v = std::max( 0, v - nother); }
+                else if (v < 0) { v = std::min( 0, v + nother); }
+                next[p] = v;
+            }
+            infl = next;
+        }
+    } // bouzy()
+    
+    // Examples and checks. Returns the number of failures.
+    //--------------------------------------------------------
+    static int test()
+    {
+        TestCheck check( "Territory::test");
+        typename BoardSize<N>::Diagram pos;
+        double terrmap[NPOINTS];
+        
+        // Black wall on column 3, white wall on column 5. Column 4 is dame.
+        pos.fill( EEMPTY);
+        ILOOP (N) { pos[i*N + 3] = BBLACK; pos[i*N + 5] = WWHITE; }
+        double score = estimate( Board( pos), terrmap, 0.5);
+        check( terrmap[0] > 0.5 && terrmap[6] < 0, "walls");
+        check( fabs( terrmap[4]) < 0.5, "dame");
+        if (N == 9) { check( score == -0.5, "score"); }
+        
+        // Black group in the corner with two eyes, at a and b
+        /*
+         a x b x .
+         x x x x .
+         */
+        pos.fill( EEMPTY);
+        for (int c : {1,3}) { pos[c] = BBLACK; }
+        ILOOP (4) { pos[N + i] = BBLACK; }
+        Board board( pos);
+        Points alive, eyes;
+        benson( board, BBLACK, alive, eyes);
+        check( alive[1] && alive[N] && alive[N+3], "two eyes alive");
+        check( eyes[0] && eyes[2] && !eyes[4], "eyes");
+        estimate( board, terrmap);
+        check( terrmap[0] == 1.0 && terrmap[2] == 1.0, "eyes owned");
+        
+        // With only one eye it can die
+        pos[3] = EEMPTY;
+        benson( Board( pos), BBLACK, alive, eyes);
+        check( alive.none() && eyes.none(), "one eye");
+        return check.nfails();
+    } // test()
+    
+private:
+    // Empty areas bordered by one color only, and not too big, go to that color
+    //-------------------------------------------------------------------------------------------
+    static void enclosed( const Board &board, const Points &skip, double *terrmap, int &nblack, int &nwhite)
+    {
+        Points seen = skip;
+        std::vector<int> area, stack;
+        ILOOP (NPOINTS) {
+            if (seen[i] || !board.isempty( i)) { continue; }
+            area.clear();
+            bool black = false, white = false;
+            seen.set( i);
+            stack.push_back( i);
+            while (!stack.empty()) {
+                int p = stack.back(); stack.pop_back();
+                area.push_back( p);
+                Board::for_neighbors( p, [&](int n) {
+                    int c = board.color( n);
+                    if (c == BBLACK) { black = true; }
+                    else if (c == WWHITE) { white = true; }
+                    else if (!seen[n]) { seen.set( n); stack.push_back( n); }
+                });
+            }
+            if (black == white || SZ(area) > MAX_ENCLOSED) { continue; }
+            const double own = black ? 0.9 : -0.9;
+            for (int p : area) {
+                // Recount the point with its new owner
+                if (terrmap[p] >= 0.5) { nblack--; }
+                else if (terrmap[p] <= -0.5) { nwhite--; }
+                terrmap[p] = own;
+                if (black) { nblack++; } else { nwhite++; }
+            }
+        } // ILOOP
+    } // enclosed()
+}; // class Territory
+
+// Territory estimate for a diagram whose size is only known at runtime.
+// terrmap gets boardsz * boardsz values. Returns the area score, B - W - komi.
+//-------------------------------------------------------------------------------------------
+inline double estimate_territory( const std::vector<int> &diagram, int boardsz, double komi,
+                                 double *terrmap)
+{
+    if (!board_size_ok( boardsz) || SZ(diagram) != boardsz * boardsz) {
+        ILOOP (SZ(diagram)) { terrmap[i] = 0; }
+        return -komi;
+    }
+    return with_board_size( boardsz, [&](auto bs) {
+        const int NN = decltype(bs)::DIM;
+        return Territory<NN>::estimate( GoBoard<NN>( diagram.data()), terrmap, komi);
+    });
+} // estimate_territory()
+
+#endif /* Territory_hpp */
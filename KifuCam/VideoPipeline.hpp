@@ -0,0 +1,141 @@
+//
+//  VideoPipeline.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Run the video mode stages on their own threads, so that frame k can be
+// in detection while frame k+1 is in preprocessing.
+// Stages are connected by lock-free mailboxes holding one frame each. Under load,
+// the older frame is dropped, so each stage works on the freshest frame we have.
+
+#ifndef VideoPipeline_hpp
+#define VideoPipeline_hpp
+
+#include <iostream>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include "Common.hpp"
+#include "Ocv.hpp"
+#include "SpscMailbox.hpp"
+
+// What travels down the pipeline
+//==================================
+struct VideoFrame
+{
+    cv::Mat img;              // RGB frame at working size, later with the overlay
+    cv::Mat gray;             // same frame, gray
+    Points2f corners;         // board corners in img coordinates
+    Points2f intersections;   // grid points in img coordinates
+    bool found = false;       // did we find a board
+}; // struct VideoFrame
+
+class VideoPipeline
+//====================
+{
+public:
+    // A stage works on the frame in place. Return false to drop the frame.
+    typedef std::function<bool(VideoFrame &)> Stage;
+    // Gets the frames that made it through all stages
+    typedef std::function<void(VideoFrame &)> Sink;
+
+    static constexpr int IDLE_WAIT_MS = 2; // poll interval of an idle stage
+
+    ~VideoPipeline() { stop(); }
+
+    // Start one thread per stage
+    //---------------------------------------------------------------
+    inline void start( const std::vector<Stage> &stages, Sink sink)
+    {
+        stop();
+        m_stages = stages;
+        m_sink = sink;
+        m_boxes.clear();
+        ISLOOP (m_stages) {
+            m_boxes.push_back( std::unique_ptr<Mailbox>( new Mailbox));
+        }
+        m_dropped = 0;
+        m_running = true;
+        ISLOOP (m_stages) {
+            m_threads.push_back( std::thread( &VideoPipeline::run_stage, this, i));
+        }
+    } // start()
+
+    // Stop and join all threads. Frames in flight are lost.
+    //-----------------------------------------------------------
+    inline void stop()
+    {
+        m_running = false;
+        for (auto &t : m_threads) { t.join(); }
+        m_threads.clear();
+    } // stop()
+
+    inline bool running() const { return m_running; }
+    inline int dropped() const { return m_dropped; }
+
+    // Feed a frame. Call from one thread only.
+    //-------------------------------------------
+    inline void push( VideoFrame &&frame)
+    {
+        if (!m_running) return;
+        if (m_boxes[0]->push( std::move( frame))) { m_dropped++; }
+    } // push()
+
+private:
+    typedef SpscMailbox<VideoFrame> Mailbox;
+
+    // Thread body of stage idx
+    //---------------------------------
+    inline void run_stage( int idx)
+    {
+        Mailbox &in = *m_boxes[idx];
+        bool last = (idx == SZ(m_stages) - 1);
+        VideoFrame frame;
+        while (m_running) {
+            if (!in.pop( frame)) {
+                std::this_thread::sleep_for( std::chrono::milliseconds( IDLE_WAIT_MS));
+                continue;
+            }
+            if (!m_stages[idx]( frame)) continue;
+            if (last) {
+                m_sink( frame);
+            }
+            else if (m_boxes[idx+1]->push( std::move( frame))) {
+                m_dropped++;
+            }
+        } // while
+    } // run_stage()
+
+    // Data
+    std::vector<Stage> m_stages;
+    Sink m_sink;
+    std::vector<std::unique_ptr<Mailbox>> m_boxes;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_running{false};
+    std::atomic<int> m_dropped{0};
+}; // class VideoPipeline
+
+#endif /* VideoPipeline_hpp */
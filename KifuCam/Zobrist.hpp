@@ -0,0 +1,164 @@
+//
+//  Zobrist.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// 64 bit Zobrist hashes of Go positions.
+// A position hashes to the xor of one random key per stone, so placing or removing
+// a stone is a single xor. We also keep the hash of each of the 8 rotations and
+// reflections. The smallest of those is the same for all of them: canonical().
+
+#ifndef Zobrist_hpp
+#define Zobrist_hpp
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "Globals.h"
+#include "BoardSize.hpp"
+
+template <int N>
+struct Zobrist
+//================
+{
+    typedef BoardSize<N> Size;
+    static constexpr int NPOINTS = Size::NPOINTS;
+    static constexpr int NSYM = 8;
+    typedef std::array<uint64_t, NSYM> Hashes;
+    
+    // Key for a stone of color at idx. EEMPTY and DDONTKNOW have none.
+    //-----------------------------------------------------------------------
+    static uint64_t key( int color, int idx)
+    {
+        if (color == BBLACK) return tables().keys[0][idx];
+        if (color == WWHITE) return tables().keys[1][idx];
+        return 0;
+    } // key()
+    
+    // Where idx goes under symmetry t, 0 <= t < 8. t == 0 is the identity.
+    //---------------------------------------------------------------------------
+    static int sym( int t, int idx) { return tables().perm[t][idx]; }
+    
+    // Hash of the empty board. Differs between board sizes.
+    //---------------------------------------------------------
+    static uint64_t empty() { return tables().empty; }
+    
+    // Toggle a stone in all 8 hashes
+    //------------------------------------------------------
+    static void toggle( Hashes &h, int color, int idx)
+    {
+        if (color != BBLACK && color != WWHITE) return;
+        for (int t = 0; t < NSYM; t++) { h[t] ^= key( color, sym( t, idx)); }
+    } // toggle()
+    
+    // The same value for a position and all its rotations and reflections
+    //--------------------------------------------------------------------------
+    static uint64_t canonical( const Hashes &h) { return *std::min_element( h.begin(), h.end()); }
+    
+    // All 8 hashes of a diagram, from scratch
+    //----------------------------------------------------
+    static Hashes hashes( const int pos[])
+    {
+        Hashes h; h.fill( empty());
+        for (int i = 0; i < NPOINTS; i++) { toggle( h, pos[i], i); }
+        return h;
+    } // hashes()
+    
+    // Plain hash of a diagram, from scratch
+    //----------------------------------------------------
+    static uint64_t hash( const int pos[])
+    {
+        uint64_t h = empty();
+        for (int i = 0; i < NPOINTS; i++) { h ^= key( pos[i], i); }
+        return h;
+    } // hash()
+    static uint64_t hash( const typename Size::Diagram &pos) { return hash( pos.data()); }
+    static uint64_t canonical( const typename Size::Diagram &pos) { return canonical( hashes( pos.data())); }
+    
+private:
+    struct Tables {
+        uint64_t keys[2][NPOINTS];
+        int perm[NSYM][NPOINTS];
+        uint64_t empty;
+    };
+    
+    // Random keys from a fixed seed, so hashes are the same on every run
+    //-------------------------------------------------------------------------
+    static const Tables& tables()
+    {
+        static const Tables tabs = [] {
+            Tables t;
+            uint64_t state = 0x4b69667543616dULL ^ N;
+            auto splitmix = [&state]() {
+                uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            };
+            t.empty = splitmix();
+            for (int c = 0; c < 2; c++) {
+                for (int i = 0; i < NPOINTS; i++) { t.keys[c][i] = splitmix(); }
+            }
+            // Bit 0 flips rows, bit 1 flips columns, bit 2 transposes
+            for (int s = 0; s < NSYM; s++) {
+                for (int i = 0; i < NPOINTS; i++) {
+                    int r = i / N, c = i % N;
+                    if (s & 1) r = N - 1 - r;
+                    if (s & 2) c = N - 1 - c;
+                    if (s & 4) std::swap( r, c);
+                    t.perm[s][i] = r * N + c;
+                }
+            }
+            return t;
+        }();
+        return tabs;
+    } // tables()
+}; // struct Zobrist
+
+// Hash of a diagram whose size is only known at runtime. 0 if the size is off.
+//-------------------------------------------------------------------------------
+inline uint64_t diagram_hash( const std::vector<int> &diagram, int boardsz)
+{
+    if (!board_size_ok( boardsz) || (int)diagram.size() != boardsz * boardsz) return 0;
+    return with_board_size( boardsz, [&diagram](auto bs) {
+        return Zobrist<decltype(bs)::DIM>::hash( diagram.data());
+    });
+} // diagram_hash()
+
+// Same for all rotations and reflections of the diagram
+//-------------------------------------------------------------------------------
+inline uint64_t diagram_canonical_hash( const std::vector<int> &diagram, int boardsz)
+{
+    if (!board_size_ok( boardsz) || (int)diagram.size() != boardsz * boardsz) return 0;
+    return with_board_size( boardsz, [&diagram](auto bs) {
+        typedef Zobrist<decltype(bs)::DIM> Z;
+        return Z::canonical( Z::hashes( diagram.data()));
+    });
+} // diagram_canonical_hash()
+
+#endif /* Zobrist_hpp */
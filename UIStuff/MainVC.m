@@ -70,6 +70,7 @@
     [super viewDidLoad];
     self.frameExtractor = [FrameExtractor new];
     self.cppInterface = [CppInterface new];
+    self.cppInterface.boardSize = [getProp( @"opt_board_size", @"19") intValue];
     self.frameExtractor.delegate = self;
     self.debugstate = 0;
 }
@@ -149,6 +150,7 @@
 - (void) viewWillDisappear:(BOOL) animated
 {
     [self.frameExtractor suspend];
+    [_cppInterface video_stop];
 }
 
 //-------------------------------
@@ -300,6 +302,7 @@
 {
     if ([g_app.menuVC photoMode] || [g_app.menuVC videoMode]) {
         [self.frameExtractor suspend];
+        [_cppInterface video_stop];
         [self processImgQ];
     }
     // Enable debug menu on the right if trigger position seen
@@ -313,26 +316,27 @@
 
 // Called on each video frame. Behave differently depending on active mode.
 //---------------------------------------------------------------------------
-- (void)captured:(UIImage *)image
+- (void)captured:(CameraFrame *)frame
 {
     if ([g_app.menuVC debugMode]) {
         [self.frameExtractor suspend];
+        [_cppInterface video_stop];
         return;
     } // debugMode
     else if ([g_app.menuVC photoMode]) {
+        [_cppInterface video_stop];
         [self.frameExtractor suspend];
-        [self.cameraView setImage:image];
-        //_img = image;
-        [_cppInterface qImg:image];
+        [self.cameraView setImage:[CppInterface frameImage:frame]];
+        [_cppInterface qFrame:frame];
         [self.frameExtractor resume];
     } // photoMode
     else if ([g_app.menuVC videoMode]) {
-        [self.frameExtractor suspend];
-        //_img = image;
-        [_cppInterface qImg:image];
-        UIImage *processedImg = [self.cppInterface video_mode];
-        //self.img = processedImg;
-        [self.cameraView setImage:processedImg];
+        // Resume capture right away. The pipeline drops frames it cannot handle.
+        [_cppInterface video_push:frame show:^(UIImage *processedImg) {
+            if ([g_app.menuVC videoMode]) {
+                [self.cameraView setImage:processedImg];
+            }
+        }];
         if (self.view.window) {
             [self.frameExtractor resume];
         }
@@ -27,6 +27,7 @@
 
 
 #import "Globals.h"
+#import "AnalysisCache.h"
 #import "CppInterface.h"
 #import "RightViewController.h"
 #import "RightViewCell.h"
@@ -61,6 +62,9 @@ enum {ITEM_NOT_SELECTED=0, ITEM_SELECTED=1};
                        @{ @"txt": @"Add Test Case", @"state": @(ITEM_NOT_SELECTED) },
                        @{ @"txt": @"Run Test Cases", @"state": @(ITEM_NOT_SELECTED) },
                        @{ @"txt": @"Overwrite Test Cases", @"state": @(ITEM_NOT_SELECTED) },
+                       @{ @"txt": @"Stress Test Cases", @"state": @(ITEM_NOT_SELECTED) },
+                       @{ @"txt": @"A/B Geometry", @"state": @(ITEM_NOT_SELECTED) },
+                       @{ @"txt": @"Record Test Videos", @"state": @(ITEM_NOT_SELECTED) },
                        @{ @"txt": @"", @"state": @(ITEM_NOT_SELECTED) },
                        @{ @"txt": @"Upload Test Cases", @"state": @(ITEM_NOT_SELECTED) },
                        @{ @"txt": @"Download Test Casess", @"state": @(ITEM_NOT_SELECTED) }
@@ -143,6 +147,15 @@ enum {ITEM_NOT_SELECTED=0, ITEM_SELECTED=1};
         else if ([menuItem hasPrefix:@"Overwrite Test Cases"]) {
             dispatch_async( dispatch_get_main_queue(), ^{ [self mnuRunTestCases:YES]; });
         }
+        else if ([menuItem hasPrefix:@"Stress Test Cases"]) {
+            dispatch_async( dispatch_get_main_queue(), ^{ [self mnuStressTestCases]; });
+        }
+        else if ([menuItem hasPrefix:@"A/B Geometry"]) {
+            dispatch_async( dispatch_get_main_queue(), ^{ [self mnuABGeometry]; });
+        }
+        else if ([menuItem hasPrefix:@"Record Test Videos"]) {
+            dispatch_async( dispatch_get_main_queue(), ^{ [self mnuRecordVideos]; });
+        }
         else if ([menuItem hasPrefix:@"Upload Test Cases"]) {
             [self mnuUploadTestCases];
         }
@@ -194,6 +207,9 @@ enum {ITEM_NOT_SELECTED=0, ITEM_SELECTED=1};
 {
     NSArray *testfiles = globFiles(@TESTCASE_FOLDER , @TESTCASE_PREFIX, @"*.png");
     NSMutableArray *errCounts = [NSMutableArray new];
+    NSMutableArray *allocCounts = [NSMutableArray new];
+    // Test cases set their own board size. Keep that away from the user's engine.
+    CppInterface *engine = [CppInterface new];
     int idx = -1;
     for (id fname in testfiles ) {
         idx++;
@@ -208,16 +224,17 @@ enum {ITEM_NOT_SELECTED=0, ITEM_SELECTED=1};
             NSString *sgf = [NSString stringWithContentsOfFile:fullfname encoding:NSUTF8StringEncoding error:NULL];
             // Classify
             NSLog( @"%@", fname);
-            int nerrs = [g_app.mainVC.cppInterface runTestImg:img withSgf: sgf];
+            int nerrs = [engine runTestImg:img withSgf: sgf];
             if (overwrite) {
                 if ([getProp( @"opt_overwrite_sgf", @"off") isEqualToString:@"on"]) {
-                    [g_app.mainVC.cppInterface save_current_sgf:fullfname overwrite:YES];
+                    [engine save_current_sgf:fullfname overwrite:YES];
                 }
                 else {
-                    [g_app.mainVC.cppInterface save_current_sgf:fullfname overwrite:NO];
+                    [engine save_current_sgf:fullfname overwrite:NO];
                 }
             }
             [errCounts addObject:@(nerrs)];
+            [allocCounts addObject:@([engine frame_allocs])];
         } // @autoreleasepool
     } // for
     
@@ -231,22 +248,192 @@ enum {ITEM_NOT_SELECTED=0, ITEM_SELECTED=1};
     }
     NSMutableString *msg = [NSMutableString new];
     [msg appendString: nsprintf( @"Total Errors:%d\n", totErrs)];
-    [msg appendString:@"Error Count by File\n"];
-    [msg appendString:@"===================\n\n"];
+    [msg appendString: nsprintf( @"Buffer Allocations:%ld\n", [engine total_allocs])];
+    if ([testfiles count]) {
+        NSString *fullfname = getFullPath( nsprintf( @"%@/%@", @TESTCASE_FOLDER, testfiles[0]));
+        int eqfails = [engine test_equalize:[UIImage imageWithContentsOfFile:fullfname]];
+        [msg appendString: nsprintf( @"Frames without Color Equalization:%d\n", eqfails)];
+    }
+    [msg appendString: nsprintf( @"Position Hash Failures:%d\n", [CppInterface test_position_hash])];
+    for (NSArray *test in [CppInterface unit_tests]) {
+        [msg appendString: nsprintf( @"%@ Failures:%d\n", test[0], [test[1] intValue])];
+    }
+    [msg appendString: nsprintf( @"GoBoard Moves/s:%.0f\n", [CppInterface bench_goboard])];
+    [msg appendString: nsprintf( @"GameRecorder Frames/s:%.0f\n", [CppInterface bench_game_recorder])];
+    [msg appendString:@"Error and Allocation Count by File\n"];
+    [msg appendString:@"==================================\n\n"];
 
     i = -1;
     for (id fname in testfiles) {
         i++;
         long count = [errCounts[i] integerValue];
-        NSString *line = nsprintf( @"%@:\t%5ld\n", fname, count);
+        long allocs = [allocCounts[i] integerValue];
+        NSString *line = nsprintf( @"%@:\t%5ld\t%5ld\n", fname, count, allocs);
         [msg appendString:line];
     } // for
 
     UITextView *tv = g_app.testResultsVC.tv;
     tv.text = msg;
     [g_app.navVC pushViewController:g_app.testResultsVC animated:YES];
+    // Needs scripts/fake_katagui.py. Shows up when the answers are in.
+    [AnalysisCache testWithCompletion:^(int nfails) {
+        tv.text = nsprintf( @"Analysis Cache Failures:%d\n%@", nfails, tv.text);
+    }];
 } // mnuRunTestCases()
 
+// Run all test cases on one engine per core, all at the same time.
+// Every engine must produce the same sgf as a serial run.
+//--------------------------------------------------------------------
+- (void)mnuStressTestCases
+{
+    NSArray *testfiles = globFiles(@TESTCASE_FOLDER , @TESTCASE_PREFIX, @"*.png");
+    NSMutableArray *imgs = [NSMutableArray new];
+    NSMutableArray *sgfs = [NSMutableArray new];
+    for (id fname in testfiles ) {
+        NSString *fullfname = getFullPath( nsprintf( @"%@/%@", @TESTCASE_FOLDER, fname));
+        [imgs addObject:[UIImage imageWithContentsOfFile:fullfname]];
+        fullfname = changeExtension( fullfname, @".sgf");
+        NSString *sgf = [NSString stringWithContentsOfFile:fullfname encoding:NSUTF8StringEncoding error:NULL];
+        [sgfs addObject:sgf ? sgf : @""];
+    }
+    int nfiles = (int)[testfiles count];
+    
+    // Serial reference run
+    CppInterface *refEngine = [CppInterface new];
+    NSMutableArray *refResults = [NSMutableArray new];
+    for (int i=0; i < nfiles; i++) {
+        @autoreleasepool {
+            [refEngine runTestImg:imgs[i] withSgf:sgfs[i]];
+            [refResults addObject:[refEngine get_sgf]];
+        }
+    }
+    
+    // Same thing on N engines in parallel
+    int nengines = (int)[[NSProcessInfo processInfo] activeProcessorCount];
+    NSMutableArray *engines = [NSMutableArray new];
+    NSMutableArray *results = [NSMutableArray new];
+    for (int e=0; e < nengines; e++) {
+        [engines addObject:[CppInterface new]];
+        NSMutableArray *res = [NSMutableArray new];
+        for (int i=0; i < nfiles; i++) { [res addObject:@""]; }
+        [results addObject:res];
+    }
+    dispatch_group_t group = dispatch_group_create();
+    NSDate *start = [NSDate date];
+    for (int e=0; e < nengines; e++) {
+        dispatch_queue_t q = dispatch_queue_create( nsprintf( @"com.ahaux.stressQ%d", e).UTF8String, DISPATCH_QUEUE_SERIAL);
+        CppInterface *engine = engines[e];
+        NSMutableArray *res = results[e];
+        dispatch_group_async( group, q, ^{
+            // Each engine starts at a different file to mix things up
+            for (int k=0; k < nfiles; k++) {
+                int i = (k + e) % nfiles;
+                @autoreleasepool {
+                    [engine runTestImg:imgs[i] withSgf:sgfs[i]];
+                    res[i] = [engine get_sgf];
+                }
+            }
+        });
+    } // for
+    dispatch_group_wait( group, DISPATCH_TIME_FOREVER);
+    double secs = -[start timeIntervalSinceNow];
+    
+    // Compare with serial results
+    NSMutableString *details = [NSMutableString new];
+    int nmismatch = 0;
+    for (int i=0; i < nfiles; i++) {
+        for (int e=0; e < nengines; e++) {
+            if (![results[e][i] isEqualToString:refResults[i]]) {
+                nmismatch++;
+                [details appendString: nsprintf( @"%@:\tengine %d differs\n", testfiles[i], e)];
+            }
+        }
+    }
+    NSMutableString *msg = [NSMutableString new];
+    [msg appendString: nsprintf( @"Engines:%d Files:%d Time:%.1fs\n", nengines, nfiles, secs)];
+    [msg appendString: nsprintf( @"Mismatches:%d\n", nmismatch)];
+    [msg appendString:@"===================\n\n"];
+    [msg appendString:details];
+    
+    UITextView *tv = g_app.testResultsVC.tv;
+    tv.text = msg;
+    [g_app.navVC pushViewController:g_app.testResultsVC animated:YES];
+} // mnuStressTestCases()
+
+// Run all test cases with angle sweeps (A) and with vanishing points (B)
+// in f02. Compare error counts and time per image.
+//------------------------------------------------------------------------------
+- (void)mnuABGeometry
+{
+    NSArray *testfiles = globFiles(@TESTCASE_FOLDER , @TESTCASE_PREFIX, @"*.png");
+    CppInterface *engines[2] = { [CppInterface new], [CppInterface new] };
+    engines[0].vanishingPoints = NO;
+    engines[1].vanishingPoints = YES;
+    int totErrs[2] = {0,0};
+    double secs[2] = {0,0};
+    NSMutableString *details = [NSMutableString new];
+    for (id fname in testfiles ) {
+        NSString *fullfname = getFullPath( nsprintf( @"%@/%@", @TESTCASE_FOLDER, fname));
+        @autoreleasepool {
+            UIImage *img = [UIImage imageWithContentsOfFile:fullfname];
+            NSString *sgf = [NSString stringWithContentsOfFile:changeExtension( fullfname, @".sgf")
+                                                      encoding:NSUTF8StringEncoding error:NULL];
+            int nerrs[2];
+            for (int e=0; e < 2; e++) {
+                NSDate *start = [NSDate date];
+                nerrs[e] = [engines[e] runTestImg:img withSgf:sgf];
+                secs[e] -= [start timeIntervalSinceNow];
+                totErrs[e] += nerrs[e];
+            }
+            [details appendString: nsprintf( @"%@:\t%5d\t%5d\n", fname, nerrs[0], nerrs[1])];
+        } // @autoreleasepool
+    } // for
+    
+    int nfiles = MAX( 1, (int)[testfiles count]);
+    NSMutableString *msg = [NSMutableString new];
+    [msg appendString: nsprintf( @"A Sweeps:\t%d errors\t%.1f ms/img\n", totErrs[0], 1000 * secs[0] / nfiles)];
+    [msg appendString: nsprintf( @"B Vanishing:\t%d errors\t%.1f ms/img\n", totErrs[1], 1000 * secs[1] / nfiles)];
+    [msg appendString:@"Error Count by File (A B)\n"];
+    [msg appendString:@"=========================\n\n"];
+    [msg appendString:details];
+    
+    UITextView *tv = g_app.testResultsVC.tv;
+    tv.text = msg;
+    [g_app.navVC pushViewController:g_app.testResultsVC animated:YES];
+} // mnuABGeometry()
+
+// Record the game in each test video (.mov, .mp4) and save it next to the
+// video as .sgf. Show moves, classified crops, and frames per second.
+//------------------------------------------------------------------------------
+- (void)mnuRecordVideos
+{
+    NSMutableArray *testfiles = [NSMutableArray new];
+    [testfiles addObjectsFromArray:globFiles(@TESTCASE_FOLDER , @TESTCASE_PREFIX, @"*.mov")];
+    [testfiles addObjectsFromArray:globFiles(@TESTCASE_FOLDER , @TESTCASE_PREFIX, @"*.mp4")];
+    CppInterface *engine = [CppInterface new];
+    NSMutableString *msg = [NSMutableString new];
+    [msg appendString:@"Recorded Videos\n"];
+    [msg appendString:@"===============\n\n"];
+    for (id fname in testfiles ) {
+        NSString *fullfname = getFullPath( nsprintf( @"%@/%@", @TESTCASE_FOLDER, fname));
+        @autoreleasepool {
+            NSString *sgf = [engine record_video:fullfname];
+            if (!sgf) {
+                [msg appendString: nsprintf( @"%@:\tno board\n", fname)];
+                continue;
+            }
+            [sgf writeToFile:changeExtension( fullfname, @".sgf")
+                  atomically:YES encoding:NSUTF8StringEncoding error:NULL];
+            [msg appendString: nsprintf( @"%@:\t%@\n", fname, engine.recordStats)];
+        } // @autoreleasepool
+    } // for
+    if (![testfiles count]) { [msg appendString:@"No videos in testcases\n"]; }
+    
+    UITextView *tv = g_app.testResultsVC.tv;
+    tv.text = msg;
+    [g_app.navVC pushViewController:g_app.testResultsVC animated:YES];
+} // mnuRecordVideos()
+
 // Upload test cases to S3
 //----------------------------
 - (void)mnuUploadTestCases
@@ -30,17 +30,13 @@
 typedef void (^SDCompletionHandler)(void);
 
 @interface SaveDiscardVC : UIViewController 
-// Upload image and sgf to S3
+// Upload image and sgf to S3, unless the same position went up before
 + (void) uploadToS3:(NSString*)fname;
-// Get territory map from remote Katago
-- (void) askRemoteBotTerr:(int)turn
-                     komi:(double)komi
-                 handicap:(int)handicap
-               completion:(SDCompletionHandler)completion;
-- (void) askRemoteBotMove:(int)turn
-                     komi:(double)komi
-                 handicap:(int)handicap
-               completion:(SDCompletionHandler)completion;
+// Get territory map, move and score from remote Katago, or from the cache
+- (void) askRemoteBot:(int)turn
+                 komi:(double)komi
+             handicap:(int)handicap
+           completion:(SDCompletionHandler)completion;
 
 // Set this before pushing VC
 @property NSString *sgf;
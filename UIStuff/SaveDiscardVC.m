@@ -28,6 +28,7 @@
 #import "SaveDiscardVC.h"
 #import "Common.h"
 #import "S3.h"
+#import "AnalysisCache.h"
 #import "Globals.h"
 #import "ImagesVC.h"
 #import "KifuCam-Swift.h"
@@ -220,24 +221,71 @@
     return fname;
 } // savePhotoAndSgf()
 
+// Positions uploaded so far, as position_hash strings. Oldest first.
+//---------------------------------------------------------------------
++ (NSMutableOrderedSet *) uploadedPositions
+{
+    static NSMutableOrderedSet *uploaded;
+    if (!uploaded) {
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        uploaded = [NSMutableOrderedSet orderedSetWithArray:[defaults arrayForKey:@"uploaded_positions"]];
+    }
+    return uploaded;
+} // uploadedPositions()
+
+// Key for the position in sgf. Nil for an empty board, nothing to compare.
+//---------------------------------------------------------------------------
++ (NSString *) uploadKey:(NSString *)sgf
+{
+    uint64_t hash = [CppInterface position_hash:sgf];
+    if (!hash) return nil;
+    return nsprintf( @"%016llx", hash);
+} // uploadKey()
+
+// Remember a position as uploaded. Call only after the upload succeeded.
+// The same board gets photographed over and over. One upload per position is enough.
+//---------------------------------------------------------------------------------------
++ (void) markUploaded:(NSString *)key
+{
+    const int MAX_UPLOADED = 1000;
+    if (!key) return;
+    NSMutableOrderedSet *uploaded = [SaveDiscardVC uploadedPositions];
+    [uploaded addObject:key];
+    while ([uploaded count] > MAX_UPLOADED) { [uploaded removeObjectAtIndex:0]; }
+    [[NSUserDefaults standardUserDefaults] setObject:[uploaded array] forKey:@"uploaded_positions"];
+} // markUploaded()
+
 // Upload image and sgf to S3
 //------------------------------------
 + (void) uploadToS3:(NSString*)fname
 {
     if (![g_app.settingsVC uploadEnabled]) return;
+    NSString *sgf = [NSString stringWithContentsOfFile:changeExtension( fname, @".sgf")
+                                              encoding:NSUTF8StringEncoding error:NULL];
+    NSString *key = [SaveDiscardVC uploadKey:sgf];
+    if (key && [[SaveDiscardVC uploadedPositions] containsObject:key]) return;
     
     NSString *uuid = nsprintf( @"%@", [UIDevice currentDevice].identifierForVendor);
     NSArray *parts = [uuid componentsSeparatedByString:@"-"];
     NSString *s3name;
     NSString *tstamp = tstampFname();
+    // The position counts as uploaded once photo and sgf both made it
+    __block int npending = 2;
+    __block bool failed = false;
+    void (^done)(NSError *) = ^(NSError *err) {
+        dispatch_async( dispatch_get_main_queue(), ^{
+            if (err) failed = true;
+            if (--npending == 0 && !failed) { [SaveDiscardVC markUploaded:key]; }
+        });
+    };
     // Photo
     fname = changeExtension( fname, @".png");
     s3name = nsprintf( @"%@/%@-%@.png", @S3_UPLOAD_FOLDER, parts[0], tstamp);
-    S3_upload_file( fname, s3name , ^(NSError *err) {});
+    S3_upload_file( fname, s3name, done);
     // Sgf
     fname = changeExtension( fname, @".sgf");
     s3name = nsprintf( @"%@/%@-%@.sgf", @S3_UPLOAD_FOLDER, parts[0], tstamp);
-    S3_upload_file( fname, s3name , ^(NSError *err) {});
+    S3_upload_file( fname, s3name, done);
 } // uploadToS3()
 
 // Score position and display result.
@@ -246,187 +294,82 @@
     // Store komi and handicap in sgf
     _sgf = replaceStr( @"KM[0]", nsprintf( @"KM[%.1f]", [_tfKomi.text doubleValue]), _sgf);
     _sgf = replaceStr( @"HA[0]", nsprintf( @"HA[%d]", [_tfHandi.text intValue]), _sgf);
-    // Set self.terrmap from remote bot
-    [self askRemoteBotTerr:turn
-                      komi:[_tfKomi.text doubleValue]
-                  handicap:[_tfHandi.text intValue]
-                completion:^{
-        // Get next move and score from remote bot
-        [self askRemoteBotMove:turn
-                          komi:[_tfKomi.text doubleValue]
-                      handicap:[_tfHandi.text intValue]
-                    completion:^{
-            NSString *tstr = nsprintf( @"P(B wins)=%.2f", self.winprob);
-            if (self.score > 0) {
-                tstr = nsprintf( @" %@ B+%.1f", tstr, fabs(self.score));
-            } else {
-                tstr = nsprintf( @" %@ W+%.1f", tstr, fabs(self.score));
-            }
-            _lbInfo.text = tstr;
-            _lbTurn.text = @"Black to Move";
-            _lbHandiKomi.text = nsprintf( @"Handicap:%d Komi:%.1f",
-                                         [_tfHandi.text intValue], [_tfKomi.text doubleValue]);
-            if (turn == WWHITE) { _lbTurn.text = @"White to Move"; }
-            double *terrmap = cterrmap( self.terrmap);
-            _scoreImg = [CppInterface nextmove2img:_sgf
-                                            coords:self.best_ten_moves
-                                             color:turn
-                                           terrmap:terrmap
-                         ];
-            [_sgfView setImage:_scoreImg];
-        }]; // askRemoteBotMove
-    }]; // askRemoteBotTerr
+    // Local estimate first. It stays up if Katago does not answer.
+    static double local_terrmap[19 * 19];
+    double local_score = [CppInterface estimate_score:_sgf komi:[_tfKomi.text doubleValue]
+                                              terrmap:local_terrmap];
+    _scoreImg = [CppInterface scoreimg:_sgf terrmap:local_terrmap];
+    [_sgfView setImage:_scoreImg];
+    _lbHandiKomi.text = nsprintf( @"Estimate %@+%.1f", local_score > 0 ? @"B" : @"W", fabs( local_score));
+    // Set self.terrmap, score, next moves from remote bot
+    [self askRemoteBot:turn
+                  komi:[_tfKomi.text doubleValue]
+              handicap:[_tfHandi.text intValue]
+            completion:^{
+        NSString *tstr = nsprintf( @"P(B wins)=%.2f", self.winprob);
+        if (self.score > 0) {
+            tstr = nsprintf( @" %@ B+%.1f", tstr, fabs(self.score));
+        } else {
+            tstr = nsprintf( @" %@ W+%.1f", tstr, fabs(self.score));
+        }
+        _lbInfo.text = tstr;
+        _lbTurn.text = @"Black to Move";
+        _lbHandiKomi.text = nsprintf( @"Handicap:%d Komi:%.1f",
+                                     [_tfHandi.text intValue], [_tfKomi.text doubleValue]);
+        if (turn == WWHITE) { _lbTurn.text = @"White to Move"; }
+        double *terrmap = cterrmap( self.terrmap);
+        _scoreImg = [CppInterface nextmove2img:_sgf
+                                        coords:self.best_ten_moves
+                                         color:turn
+                                       terrmap:terrmap
+                     ];
+        [_sgfView setImage:_scoreImg];
+    }]; // askRemoteBot
 } // displayResult()
 
-// Ask remote bot for territory map. 
+// Ask remote bot for territory map, move, score and winprob.
+// Territory and move queries go out together. Positions we asked about before
+// come from the cache without network.
 //--------------------------------------------------------------------
-- (void) askRemoteBotTerr:(int)turn komi:(double)komi
-                 handicap:(int)handicap
-               completion:(SDCompletionHandler)completion {
-    _lbInfo.text = @"Katago is counting ...";
-    const int timeout = 15;
-    static NSTimer* timer = nil;
-    timer = [NSTimer scheduledTimerWithTimeInterval:timeout
-                                            repeats:false
-                                              block:^(NSTimer * _Nonnull timer) {
-        _lbInfo.text = @"Katago timed out";
-    }];
-    
-    NSString *urlstr = @"https://katagui.baduk.club/score/katago_gtp_bot";
-    NSString *uniq = nsprintf( @"%d", rand());
-    urlstr = nsprintf( @"%@?tt=%@",urlstr,uniq);
-    NSArray *botMoves = [g_app.mainVC.cppInterface get_bot_moves:turn
-                                                        handicap:[_tfHandi.text intValue]];
-    NSDictionary *parms =
-    @{@"board_size":@(19), @"moves":botMoves,
-      @"config":@{@"komi": @(komi), @"client":@"kifucam"}};
-    NSError *err;
-    NSData *jsonBodyData = [NSJSONSerialization dataWithJSONObject:parms options:kNilOptions error:&err];
-    NSMutableURLRequest *request = [NSMutableURLRequest new];
-    request.HTTPMethod = @"POST";
-    
-    [request setURL:[NSURL URLWithString:urlstr]];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Accept"];
-    [request setHTTPBody:jsonBodyData];
-    
-    NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
-    config.requestCachePolicy = NSURLRequestReloadIgnoringLocalAndRemoteCacheData;
-    config.timeoutIntervalForRequest = timeout+1;
-                      
-    NSURLSession *session = [NSURLSession sessionWithConfiguration:config
-                                                          delegate:nil
-                                                     delegateQueue:[NSOperationQueue mainQueue]];
-    NSURLSessionDataTask *task =
-    [session dataTaskWithRequest:request
-               completionHandler:^(NSData * _Nullable data,
-                                   NSURLResponse * _Nullable response,
-                                   NSError * _Nullable error) {
-        [timer invalidate];
-        // The endpoint comes back with resp
-        NSHTTPURLResponse *resp = (NSHTTPURLResponse *) response;
-        if (resp.statusCode == 200) {
-            //NSLog(@"The response is:\n%@", resp);
-            NSDictionary *json = [NSJSONSerialization JSONObjectWithData:data
-                                                                 options:kNilOptions
-                                                                   error:nil];
-            self.botmove = json[@"diagnostics"][@"bot_move"];
-            NSArray *probs = json[@"probs"];
-            self.terrmap = [NSMutableArray new];
-            ILOOP (BOARD_SZ * BOARD_SZ) {
-                [self.terrmap addObject: @([(NSString *)(probs[i]) doubleValue])];
-            } // ILOOP
-            _lbInfo.text = @"";
-            completion();
-        }
-        else {
-            if ([_lbInfo.text containsString:@"timed out"]) {
-                _lbInfo.text = @"Katago scoring timed out";
-            } else {
-                _lbInfo.text = @"Error contacting Katago";
-            }
-        }
-    }]; // [session ...
-    [task resume];
-} // askRemoteBotTerr()
-
-// Ask remote bot for move and winprob
-//-------------------------------------------------------------
-- (void) askRemoteBotMove:(int)turn komi:(double)komi
-                 handicap:(int)handicap
-               completion:(SDCompletionHandler)completion {
-    _lbInfo.text = @"Katago is thinking ...";
-    const int timeout = 15;
-    static NSTimer* timer = nil;
-    timer = [NSTimer scheduledTimerWithTimeInterval:timeout
-                                            repeats:false
-                                              block:^(NSTimer * _Nonnull timer) {
-        _lbInfo.text = @"Katago timed out";
-    }];
-    
-    NSString *urlstr = @"https://katagui.baduk.club/select-move-x/katago_gtp_bot";
-    NSString *uniq = nsprintf( @"%d", rand());
-    urlstr = nsprintf( @"%@?tt=%@",urlstr,uniq);
-    NSArray *botMoves = [g_app.mainVC.cppInterface get_bot_moves:turn
-                                                        handicap:[_tfHandi.text intValue]];
-    NSDictionary *parms =
-    @{@"board_size":@(19), @"moves":botMoves,
-      @"config":@{@"komi": @(komi), @"client":@"kifucam"}};
-    NSError *err;
-    NSData *jsonBodyData = [NSJSONSerialization dataWithJSONObject:parms options:kNilOptions error:&err];
-    NSMutableURLRequest *request = [NSMutableURLRequest new];
-    request.HTTPMethod = @"POST";
-    
-    [request setURL:[NSURL URLWithString:urlstr]];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Accept"];
-    [request setHTTPBody:jsonBodyData];
-    
-    NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
-    config.requestCachePolicy = NSURLRequestReloadIgnoringLocalAndRemoteCacheData;
-    config.timeoutIntervalForRequest = timeout+1;
-                      
-    NSURLSession *session = [NSURLSession sessionWithConfiguration:config
-                                                          delegate:nil
-                                                     delegateQueue:[NSOperationQueue mainQueue]];
-    NSURLSessionDataTask *task =
-    [session dataTaskWithRequest:request
-               completionHandler:^(NSData * _Nullable data,
-                                   NSURLResponse * _Nullable response,
-                                   NSError * _Nullable error) {
-        [timer invalidate];
-        // The endpoint comes back with resp
-        NSHTTPURLResponse *resp = (NSHTTPURLResponse *) response;
-        if (resp.statusCode == 200) {
-            // NSLog(@"The response is:\n%@", resp);
-            NSDictionary *json = [NSJSONSerialization JSONObjectWithData:data
-                                                                 options:kNilOptions
-                                                                   error:nil];
-            self.botmove = json[@"diagnostics"][@"bot_move"];
-            self.best_ten_moves = json[@"diagnostics"][@"best_ten"];
-            NSLog(@"Score:\n%@", json[@"diagnostics"][@"score"]);
-            self.score = [(NSNumber *)(json[@"diagnostics"][@"score"]) doubleValue];
-            
-            if (komi == floor(komi)) { // whole number komi
-                self.score = sign(self.score) * ((int)(fabs(self.score) + 0.5)); // 2.1 -> 2.0,  2.9 -> 3.0
-            } else { // x.5 komi
-                self.score = sign(self.score) * ((int)(fabs(self.score)) + 0.5);  // 2.1 -> 2.5 2.9 -> 2.5
-            }
-            //self.score = sign(self.score) * (int)(2 * fabs(self.score) + 0.5) / 2.0; // round to 0.5
-            self.winprob = [(NSNumber *)(json[@"diagnostics"][@"winprob"]) doubleValue];
-            _lbInfo.text = @"";
-            completion();
-        }
-        else {
-            if ([_lbInfo.text containsString:@"timed out"]) {
+- (void) askRemoteBot:(int)turn komi:(double)komi
+             handicap:(int)handicap
+           completion:(SDCompletionHandler)completion {
+    CppInterface *cppi = g_app.mainVC.cppInterface;
+    int boardsz = cppi.boardSize;
+    NSString *key = [AnalysisCache keyForHash:[cppi diagram_hash] boardSize:boardsz turn:turn
+                                         komi:komi handicap:handicap];
+    AnalysisCache *cache = [AnalysisCache sharedCache];
+    if (![cache lookup:key]) { _lbInfo.text = @"Katago is thinking ..."; }
+    NSArray *botMoves = [cppi get_bot_moves:turn handicap:handicap];
+    [cache analyze:key moves:botMoves boardSize:boardsz komi:komi
+        completion:^(NSDictionary *result, NSError *err) {
+        if (!result) {
+            if (err.code == NSURLErrorTimedOut) {
                 _lbInfo.text = @"Katago timed out";
             } else {
                 _lbInfo.text = @"Error contacting Katago";
             }
+            return;
+        }
+        NSArray *probs = result[@"probs"];
+        NSDictionary *diag = result[@"diagnostics"];
+        self.terrmap = [NSMutableArray new];
+        ILOOP (boardsz * boardsz) {
+            [self.terrmap addObject: @([(NSString *)(probs[i]) doubleValue])];
+        } // ILOOP
+        self.botmove = diag[@"bot_move"];
+        self.best_ten_moves = diag[@"best_ten"];
+        self.score = [(NSNumber *)(diag[@"score"]) doubleValue];
+        if (komi == floor(komi)) { // whole number komi
+            self.score = sign(self.score) * ((int)(fabs(self.score) + 0.5)); // 2.1 -> 2.0,  2.9 -> 3.0
+        } else { // x.5 komi
+            self.score = sign(self.score) * ((int)(fabs(self.score)) + 0.5);  // 2.1 -> 2.5 2.9 -> 2.5
         }
-    }]; // [session ...
-    [task resume];
-} // askRemoteBotMove()
+        self.winprob = [(NSNumber *)(diag[@"winprob"]) doubleValue];
+        _lbInfo.text = @"";
+        completion();
+    }];
+} // askRemoteBot()
 
 
 // Button Callbacks
@@ -43,6 +43,10 @@
 @property UISwitch *btnShowDetectedBoard;
 @property UILabel *lbShowDetectedBoard;
 
+// Board size 9, 13, 19
+@property UISegmentedControl *scBoardSize;
+@property UILabel *lbBoardSize;
+
 // Overwrite sgf switch
 @property UISwitch *btnOverwriteSgf;
 @property UILabel *lbOverwriteSgf;
@@ -84,6 +88,9 @@
     _btnShowDetectedBoard = [UISwitch new];
     _lbShowDetectedBoard = [UILabel new];
     //
+    _scBoardSize = [[UISegmentedControl alloc] initWithItems:@[@"9x9", @"13x13", @"19x19"]];
+    _lbBoardSize = [UILabel new];
+    //
     _btnOverwriteSgf = [UISwitch new];
     _lbOverwriteSgf = [UILabel new];
 
@@ -102,6 +109,9 @@
     [_btnShowDetectedBoard addTarget:self action:@selector(btnShowDetectedBoard:) forControlEvents:UIControlEventValueChanged];
     _lbShowDetectedBoard.text = @"Show detected board";
     
+    [_scBoardSize addTarget:self action:@selector(scBoardSize:) forControlEvents:UIControlEventValueChanged];
+    _lbBoardSize.text = @"Board size";
+    
     [_btnOverwriteSgf addTarget:self action:@selector(btnOverwriteSgf:) forControlEvents:UIControlEventValueChanged];
     _lbOverwriteSgf.text = @"Overwrite Sgf";
     
@@ -113,6 +123,8 @@
     //
     [v addSubview: _btnShowDetectedBoard];
     [v addSubview: _lbShowDetectedBoard];
+    [v addSubview: _scBoardSize];
+    [v addSubview: _lbBoardSize];
     [v addSubview: _btnOverwriteSgf];
     [v addSubview: _lbOverwriteSgf];
 } // loadView
@@ -164,6 +176,10 @@
         _btnUploadYes.selected = NO;
         _btnUploadNo.selected = YES;
     }
+    NSString *optBoardSize = getProp( @"opt_board_size", @"19");
+    if ([optBoardSize isEqualToString:@"9"]) { _scBoardSize.selectedSegmentIndex = 0; }
+    else if ([optBoardSize isEqualToString:@"13"]) { _scBoardSize.selectedSegmentIndex = 1; }
+    else { _scBoardSize.selectedSegmentIndex = 2; }
     [_btnOverwriteSgf setOn:NO];
     if ([getProp(@"opt_overwrite_sgf", @"off") isEqualToString:@"on"]) {
         [_btnOverwriteSgf setOn:YES];
@@ -194,6 +210,11 @@
     _btnShowDetectedBoard.frame = CGRectMake( lmarg, y, checkBoxSize, checkBoxSize);
     _lbShowDetectedBoard.frame = CGRectMake( lmarg + checkBoxSize*2.3, y, W - lmarg, checkBoxSize);
 
+    // Board size
+    y += checkBoxSize * 3;
+    _scBoardSize.frame = CGRectMake( lmarg, y, checkBoxSize * 6, checkBoxSize);
+    _lbBoardSize.frame = CGRectMake( lmarg + checkBoxSize*6.5, y, W - lmarg, checkBoxSize);
+
     // Overwrite sgf or not
     y += checkBoxSize * 3;
     _btnOverwriteSgf.frame = CGRectMake( lmarg, y, checkBoxSize, checkBoxSize);
@@ -241,6 +262,15 @@
     }
 } // btnShowDetectedBoard()
 
+//---------------------------------
+- (void) scBoardSize:(id)sender
+{
+    NSArray *sizes = @[@"9", @"13", @"19"];
+    NSString *boardSize = sizes[_scBoardSize.selectedSegmentIndex];
+    setProp( @"opt_board_size", boardSize);
+    g_app.mainVC.cppInterface.boardSize = [boardSize intValue];
+} // scBoardSize()
+
 //------------------------------------
 - (void) btnOverwriteSgf:(id)sender
 {
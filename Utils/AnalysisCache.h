@@ -0,0 +1,62 @@
+//
+//  AnalysisCache.h
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Remember what the katagui bot said about a position.
+// Keyed by position hash, side to move, komi and handicap.
+// Identical requests in flight share one answer, and the territory and move
+// queries go out at the same time. The most recent entries are kept on disk.
+
+#import <Foundation/Foundation.h>
+
+// result has "probs" from the score endpoint and "diagnostics" from the move endpoint
+typedef void (^AnalysisCompletion)(NSDictionary *result, NSError *err);
+
+@interface AnalysisCache : NSObject
+// Server root. katagui unless the user default "katagui_url" says otherwise,
+// e.g. http://localhost:8000 for scripts/fake_katagui.py
+@property NSString *baseURL;
+@property double timeout; // seconds per request
+
++ (instancetype) sharedCache;
+- (instancetype) initWithFile:(NSString *)fname capacity:(int)capacity;
+
+// Cache key for a position
++ (NSString *) keyForHash:(uint64_t)hash boardSize:(int)boardsz turn:(int)turn
+                     komi:(double)komi handicap:(int)handicap;
+// Cached result or nil
+- (NSDictionary *) lookup:(NSString *)key;
+// Cached result right away, else ask the bot. Completion runs on the main queue.
+- (void) analyze:(NSString *)key moves:(NSArray *)moves boardSize:(int)boardsz komi:(double)komi
+      completion:(AnalysisCompletion)completion;
+// Forget everything, on disk too
+- (void) clear;
+// Check the cache hit and coalescing against scripts/fake_katagui.py, at the
+// user default katagui_url or http://localhost:8000. Completion gets the number
+// of failures on the main queue.
++ (void) testWithCompletion:(void(^)(int nfails))completion;
+@end
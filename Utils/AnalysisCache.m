@@ -0,0 +1,312 @@
+//
+//  AnalysisCache.m
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Remember what the katagui bot said about a position
+
+#import "AnalysisCache.h"
+#import "Common.h"
+
+#define KATAGUI_URL @"https://katagui.baduk.club"
+#define CACHE_FILE @"analysis_cache.json"
+#define CACHE_CAPACITY 200
+
+@interface AnalysisCache()
+@property NSString *fname;
+@property int capacity;
+@property NSMutableDictionary *entries; // key -> result
+@property NSMutableArray *lru; // keys, most recent last
+@property NSMutableDictionary *inflight; // key -> array of completions
+@property dispatch_queue_t ioQueue; // disk writes, in order
+@property NSURLSession *session;
+@end
+
+@implementation AnalysisCache
+
+//------------------------------
++ (instancetype) sharedCache
+{
+    static AnalysisCache *cache = nil;
+    static dispatch_once_t once;
+    dispatch_once( &once, ^{
+        cache = [[AnalysisCache alloc] initWithFile:CACHE_FILE capacity:CACHE_CAPACITY];
+    });
+    return cache;
+} // sharedCache()
+
+//----------------------------------------------------------------------
+- (instancetype) initWithFile:(NSString *)fname capacity:(int)capacity
+{
+    self = [super init];
+    if (self) {
+        NSString *url = [[NSUserDefaults standardUserDefaults] stringForKey:@"katagui_url"];
+        _baseURL = url.length ? url : KATAGUI_URL;
+        _timeout = 15;
+        _fname = fname;
+        _capacity = capacity;
+        _entries = [NSMutableDictionary new];
+        _lru = [NSMutableArray new];
+        _inflight = [NSMutableDictionary new];
+        _ioQueue = dispatch_queue_create( "analysis_cache_io", DISPATCH_QUEUE_SERIAL);
+        NSURLSessionConfiguration *config = [NSURLSessionConfiguration defaultSessionConfiguration];
+        config.requestCachePolicy = NSURLRequestReloadIgnoringLocalAndRemoteCacheData;
+        config.timeoutIntervalForRequest = _timeout + 1;
+        _session = [NSURLSession sessionWithConfiguration:config
+                                                 delegate:nil
+                                            delegateQueue:[NSOperationQueue mainQueue]];
+        [self load];
+    }
+    return self;
+} // initWithFile()
+
+//---------------------------------------------------------------------------------------
++ (NSString *) keyForHash:(uint64_t)hash boardSize:(int)boardsz turn:(int)turn
+                     komi:(double)komi handicap:(int)handicap
+{
+    return nsprintf( @"%016llx-%d-%d-%.1f-%d", (unsigned long long)hash, boardsz, turn, komi, handicap);
+} // keyForHash()
+
+// Cached result, and mark it as recently used
+//---------------------------------------------------
+- (NSDictionary *) lookup:(NSString *)key
+{
+    NSDictionary *res = _entries[key];
+    if (res) {
+        [_lru removeObject:key];
+        [_lru addObject:key];
+    }
+    return res;
+} // lookup()
+
+//---------------------------------------------------------------------------------------------
+- (void) analyze:(NSString *)key moves:(NSArray *)moves boardSize:(int)boardsz komi:(double)komi
+      completion:(AnalysisCompletion)completion
+{
+    NSDictionary *cached = [self lookup:key];
+    if (cached) {
+        completion( cached, nil);
+        return;
+    }
+    // Somebody asked already. Wait for that answer.
+    NSMutableArray *waiting = _inflight[key];
+    if (waiting) {
+        [waiting addObject:completion];
+        return;
+    }
+    _inflight[key] = [NSMutableArray arrayWithObject:completion];
+    
+    NSDictionary *parms =
+    @{@"board_size":@(boardsz), @"moves":moves,
+      @"config":@{@"komi": @(komi), @"client":@"kifucam"}};
+    __block NSDictionary *terr = nil;
+    __block NSDictionary *move = nil;
+    __block NSError *error = nil;
+    // Both queries at once
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_enter( group);
+    [self post:@"/score/katago_gtp_bot" parms:parms completion:^(NSDictionary *json, NSError *err) {
+        terr = json; if (err) error = err;
+        dispatch_group_leave( group);
+    }];
+    dispatch_group_enter( group);
+    [self post:@"/select-move-x/katago_gtp_bot" parms:parms completion:^(NSDictionary *json, NSError *err) {
+        move = json; if (err) error = err;
+        dispatch_group_leave( group);
+    }];
+    dispatch_group_notify( group, dispatch_get_main_queue(), ^{
+        NSDictionary *res = nil;
+        if (!error && terr[@"probs"] && move[@"diagnostics"]) {
+            res = @{@"probs":terr[@"probs"], @"diagnostics":move[@"diagnostics"]};
+            [self insert:key result:res];
+        }
+        else if (!error) {
+            error = [NSError errorWithDomain:@"AnalysisCache" code:1
+                                    userInfo:@{NSLocalizedDescriptionKey:@"Bad response from bot"}];
+        }
+        NSArray *completions = self.inflight[key];
+        [self.inflight removeObjectForKey:key];
+        for (AnalysisCompletion c in completions) { c( res, error); }
+    });
+} // analyze()
+
+//---------------------
+- (void) clear
+{
+    [_entries removeAllObjects];
+    [_lru removeAllObjects];
+    [self save];
+} // clear()
+
+// Ask the same position twice at once, then once more. The fake server
+// must see one score and one move request in all.
+//-----------------------------------------------------------------------------
++ (void) testWithCompletion:(void(^)(int nfails))completion
+{
+    NSString *url = [[NSUserDefaults standardUserDefaults] stringForKey:@"katagui_url"];
+    AnalysisCache *cache = [[AnalysisCache alloc] initWithFile:@"analysis_cache_test.json" capacity:10];
+    cache.baseURL = url.length ? url : @"http://localhost:8000";
+    [cache clear];
+    __block int nfails = 0;
+    void (^check)(bool, NSString *) = ^(bool ok, NSString *what) {
+        if (!ok) { NSLog( @"AnalysisCache test: %@", what); nfails++; }
+    };
+    NSString *key = [AnalysisCache keyForHash:42 boardSize:19 turn:0 komi:7.5 handicap:0];
+    NSArray *moves = @[@"D4", @"Q16"];
+    
+    [cache get:@"/reset" completion:^(NSDictionary *json, NSError *err) {
+        if (err) {
+            check( false, nsprintf( @"no fake_katagui at %@", cache.baseURL));
+            completion( nfails);
+            return;
+        }
+        __block int nanswers = 0;
+        AnalysisCompletion answered = ^(NSDictionary *res, NSError *err) {
+            check( res && !err, @"no result");
+            if (++nanswers < 2) return;
+            // Both are in. Now it comes from the cache.
+            [cache analyze:key moves:moves boardSize:19 komi:7.5
+                completion:^(NSDictionary *res, NSError *err) {
+                check( res != nil, @"cache miss");
+                [cache get:@"/counts" completion:^(NSDictionary *counts, NSError *err) {
+                    check( [counts[@"/score/katago_gtp_bot"] intValue] == 1, @"score requests");
+                    check( [counts[@"/select-move-x/katago_gtp_bot"] intValue] == 1, @"move requests");
+                    [cache clear];
+                    completion( nfails);
+                }];
+            }];
+        };
+        [cache analyze:key moves:moves boardSize:19 komi:7.5 completion:answered];
+        [cache analyze:key moves:moves boardSize:19 komi:7.5 completion:answered];
+    }];
+} // testWithCompletion()
+
+//=== Private ===
+//===============
+
+// GET json from an endpoint
+//----------------------------------------------------------------------------
+- (void) get:(NSString *)endpoint completion:(void(^)(NSDictionary *json, NSError *err))completion
+{
+    NSURL *url = [NSURL URLWithString:nscat( _baseURL, endpoint)];
+    NSURLSessionDataTask *task =
+    [_session dataTaskWithURL:url
+            completionHandler:^(NSData * _Nullable data,
+                                NSURLResponse * _Nullable response,
+                                NSError * _Nullable error) {
+        NSHTTPURLResponse *resp = (NSHTTPURLResponse *) response;
+        if (error || resp.statusCode != 200) {
+            if (!error) {
+                error = [NSError errorWithDomain:@"AnalysisCache" code:resp.statusCode userInfo:nil];
+            }
+            completion( nil, error);
+            return;
+        }
+        completion( [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil], nil);
+    }];
+    [task resume];
+} // get()
+
+// POST json to one endpoint, get json back
+//------------------------------------------------------------------------------------------
+- (void) post:(NSString *)endpoint parms:(NSDictionary *)parms
+   completion:(void(^)(NSDictionary *json, NSError *err))completion
+{
+    NSString *uniq = nsprintf( @"%d", rand());
+    NSString *urlstr = nsprintf( @"%@%@?tt=%@", _baseURL, endpoint, uniq);
+    NSError *err;
+    NSData *jsonBodyData = [NSJSONSerialization dataWithJSONObject:parms options:kNilOptions error:&err];
+    NSMutableURLRequest *request = [NSMutableURLRequest new];
+    request.HTTPMethod = @"POST";
+    request.timeoutInterval = _timeout;
+    [request setURL:[NSURL URLWithString:urlstr]];
+    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    [request setValue:@"application/json" forHTTPHeaderField:@"Accept"];
+    [request setHTTPBody:jsonBodyData];
+    
+    NSURLSessionDataTask *task =
+    [_session dataTaskWithRequest:request
+                completionHandler:^(NSData * _Nullable data,
+                                    NSURLResponse * _Nullable response,
+                                    NSError * _Nullable error) {
+        NSHTTPURLResponse *resp = (NSHTTPURLResponse *) response;
+        if (error || resp.statusCode != 200) {
+            if (!error) {
+                error = [NSError errorWithDomain:@"AnalysisCache" code:resp.statusCode userInfo:nil];
+            }
+            completion( nil, error);
+            return;
+        }
+        NSDictionary *json = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+        completion( json, nil);
+    }]; // [session ...
+    [task resume];
+} // post()
+
+// Add a result, drop the least recently used beyond capacity
+//-------------------------------------------------------------------
+- (void) insert:(NSString *)key result:(NSDictionary *)res
+{
+    _entries[key] = res;
+    [_lru removeObject:key];
+    [_lru addObject:key];
+    while ((int)_lru.count > _capacity) {
+        [_entries removeObjectForKey:_lru[0]];
+        [_lru removeObjectAtIndex:0];
+    }
+    [self save];
+} // insert()
+
+// Entries in LRU order, as json, written off the main thread
+//---------------------------------------------------------------
+- (void) save
+{
+    NSMutableArray *list = [NSMutableArray new];
+    for (NSString *key in _lru) {
+        [list addObject:@{@"key":key, @"result":_entries[key]}];
+    }
+    NSString *fullfname = getFullPath( _fname);
+    dispatch_async( _ioQueue, ^{
+        NSData *data = [NSJSONSerialization dataWithJSONObject:list options:kNilOptions error:nil];
+        [data writeToFile:fullfname atomically:YES];
+    });
+} // save()
+
+//-------------------
+- (void) load
+{
+    NSData *data = [NSData dataWithContentsOfFile:getFullPath( _fname)];
+    if (!data) return;
+    NSArray *list = [NSJSONSerialization JSONObjectWithData:data options:kNilOptions error:nil];
+    if (![list isKindOfClass:[NSArray class]]) return;
+    for (NSDictionary *e in list) {
+        if (![e isKindOfClass:[NSDictionary class]] || !e[@"key"] || !e[@"result"]) continue;
+        _entries[e[@"key"]] = e[@"result"];
+        [_lru addObject:e[@"key"]];
+    }
+} // load()
+
+@end
@@ -0,0 +1,221 @@
+//
+//  Clahe.cpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// CLAHE with state, one per engine.
+
+#include <iostream>
+#include "Common.hpp"
+#include "Clahe.hpp"
+
+// Equalize one 8 bit channel
+//-------------------------------------------------------------------------
+void Clahe::apply_gray( const cv::Mat &src, cv::Mat &dst, bool reuse)
+{
+    equalize( src, dst, m_gray, reuse);
+} // apply_gray()
+
+// Equalize L in Lab. Two color conversions, so only when we need color.
+//-------------------------------------------------------------------------
+void Clahe::apply_color( const cv::Mat &rgb, cv::Mat &dst, bool reuse)
+{
+    cv::cvtColor( rgb, m_lab, cv::COLOR_RGB2Lab);
+    cv::extractChannel( m_lab, m_l, 0);
+    equalize( m_l, m_l, m_color, reuse);
+    cv::insertChannel( m_l, m_lab, 0);
+    cv::cvtColor( m_lab, dst, cv::COLOR_Lab2RGB);
+} // apply_color()
+
+// Rebuild the tables unless we may and can reuse them, then apply
+//-------------------------------------------------------------------------------------
+void Clahe::equalize( const cv::Mat &src, cv::Mat &dst, Tables &t, bool reuse)
+{
+    bool rebuild = true;
+    do {
+        if (!reuse) break;
+        if (t.age < 0 || t.age >= MAX_AGE) break;
+        if (t.img_size != src.size()) break;
+        // Compare with the mean the tables were built from, so slow drift adds up
+        if (fabs( cv::mean( src)[0] - t.mean) > MAX_MEAN_DRIFT) break;
+        rebuild = false;
+    } while(0);
+    if (rebuild) {
+        build( src, t);
+    }
+    else {
+        t.age++;
+    }
+    interpolate( src, t, dst);
+} // equalize()
+
+// Clipped histogram and lookup table per tile. Follows cv::CLAHE step by step,
+// including the padding when the image does not divide into tiles.
+//-------------------------------------------------------------------------------------
+void Clahe::build( const cv::Mat &src, Tables &t)
+{
+    const int HSZ = 256;
+    const int tx = m_tiles.width, ty = m_tiles.height;
+    const cv::Mat *lutsrc = &src;
+    if (src.cols % tx || src.rows % ty) {
+        cv::copyMakeBorder( src, m_ext, 0, ty - src.rows % ty, 0, tx - src.cols % tx, cv::BORDER_REFLECT_101);
+        lutsrc = &m_ext;
+    }
+    t.tile_size = cv::Size( lutsrc->cols / tx, lutsrc->rows / ty);
+    t.img_size = src.size();
+    t.mean = cv::mean( src)[0];
+    t.age = 0;
+    t.luts.resize( tx * ty * HSZ);
+    m_nbuilds++;
+    
+    const int area = t.tile_size.area();
+    const float lut_scale = 255.0f / area;
+    int clip = 0;
+    if (m_limit > 0) {
+        clip = std::max( int( m_limit * area / HSZ), 1);
+    }
+    const cv::Mat &img = *lutsrc;
+    const cv::Size tsz = t.tile_size;
+    cv::parallel_for_( cv::Range( 0, tx * ty), [&](const cv::Range &range) {
+        int hist[HSZ];
+        for (int k = range.start; k < range.end; k++) {
+            const int x0 = (k % tx) * tsz.width, y0 = (k / tx) * tsz.height;
+            std::fill( hist, hist + HSZ, 0);
+            for (int r = y0; r < y0 + tsz.height; r++) {
+                const uchar *p = img.ptr<uchar>(r);
+                for (int c = x0; c < x0 + tsz.width; c++) { hist[p[c]]++; }
+            }
+            if (clip > 0) {
+                // Clip and spread the excess evenly, remainder in steps from the left
+                int clipped = 0;
+                ILOOP (HSZ) {
+                    if (hist[i] > clip) { clipped += hist[i] - clip; hist[i] = clip; }
+                }
+                const int batch = clipped / HSZ;
+                int residual = clipped - batch * HSZ;
+                ILOOP (HSZ) { hist[i] += batch; }
+                if (residual) {
+                    const int step = std::max( HSZ / residual, 1);
+                    for (int i = 0; i < HSZ && residual > 0; i += step, residual--) { hist[i]++; }
+                }
+            }
+            uchar *lut = &t.luts[k * HSZ];
+            int sum = 0;
+            ILOOP (HSZ) {
+                sum += hist[i];
+                lut[i] = cv::saturate_cast<uchar>( sum * lut_scale);
+            }
+        } // for k
+    });
+} // build()
+
+// Bilinear blend of the four nearest tile tables, per pixel
+//----------------------------------------------------------------------------------------
+void Clahe::interpolate( const cv::Mat &src, const Tables &t, cv::Mat &dst) const
+{
+    const int HSZ = 256;
+    const int tx = m_tiles.width, ty = m_tiles.height;
+    const float inv_tw = 1.0f / t.tile_size.width;
+    const float inv_th = 1.0f / t.tile_size.height;
+    // Per column: left and right table, and weight
+    std::vector<int> ind1( src.cols), ind2( src.cols);
+    std::vector<float> xa( src.cols), xa1( src.cols);
+    CLOOP (src.cols) {
+        const float txf = c * inv_tw - 0.5f;
+        int tx1 = cvFloor( txf);
+        int tx2 = tx1 + 1;
+        xa[c] = txf - tx1;
+        xa1[c] = 1.0f - xa[c];
+        tx1 = std::max( tx1, 0);
+        tx2 = std::min( tx2, tx - 1);
+        ind1[c] = tx1 * HSZ;
+        ind2[c] = tx2 * HSZ;
+    }
+    dst.create( src.size(), CV_8UC1);
+    cv::parallel_for_( cv::Range( 0, src.rows), [&](const cv::Range &range) {
+        for (int r = range.start; r < range.end; r++) {
+            const float tyf = r * inv_th - 0.5f;
+            int ty1 = cvFloor( tyf);
+            int ty2 = ty1 + 1;
+            const float ya = tyf - ty1, ya1 = 1.0f - ya;
+            ty1 = std::max( ty1, 0);
+            ty2 = std::min( ty2, ty - 1);
+            const uchar *lut1 = &t.luts[ty1 * tx * HSZ];
+            const uchar *lut2 = &t.luts[ty2 * tx * HSZ];
+            const uchar *p = src.ptr<uchar>(r);
+            uchar *q = dst.ptr<uchar>(r);
+            CLOOP (src.cols) {
+                const int i1 = ind1[c] + p[c], i2 = ind2[c] + p[c];
+                const float res = (lut1[i1] * xa1[c] + lut1[i2] * xa[c]) * ya1 +
+                (lut2[i1] * xa1[c] + lut2[i2] * xa[c]) * ya;
+                q[c] = cv::saturate_cast<uchar>( res);
+            }
+        }
+    });
+} // interpolate()
+
+// Compare with cv::CLAHE on synthetic images, with and without padding,
+// and check that tables survive a small change in light but not a big one.
+// Returns the number of failures.
+//-----------------------------------------------------------------------------
+int test_clahe()
+{
+    const int MAX_ERR = 1;
+    int nfails = 0;
+    const cv::Size sizes[] = { cv::Size( 350, 466), cv::Size( 352, 472) };
+    for (auto sz : sizes) {
+        cv::Mat gray( sz, CV_8UC1);
+        RLOOP (gray.rows) { CLOOP (gray.cols) {
+            gray.at<uchar>(r,c) = 30 + r / 4 + ((r * 7 + c * 13) % 31);
+        }}
+        for (double limit : { 0.5, 2.0, 40.0 }) {
+            cv::Ptr<cv::CLAHE> ref = cv::createCLAHE( limit, cv::Size(8,8));
+            cv::Mat expected, res;
+            ref->apply( gray, expected);
+            Clahe clahe( limit);
+            clahe.apply_gray( gray, res);
+            double maxerr = cv::norm( res, expected, cv::NORM_INF);
+            if (maxerr > MAX_ERR) {
+                std::cerr << "test_clahe: " << sz << " limit " << limit << " maxerr " << maxerr << "\n";
+                nfails++;
+            }
+        }
+        // Reuse
+        Clahe clahe;
+        cv::Mat res, brighter = gray + 1, much_brighter = gray + 20;
+        clahe.apply_gray( gray, res, true);
+        clahe.apply_gray( brighter, res, true);
+        if (clahe.nbuilds() != 1) {
+            std::cerr << "test_clahe: small change rebuilt the tables\n";
+            nfails++;
+        }
+        clahe.apply_gray( much_brighter, res, true);
+        if (clahe.nbuilds() != 2) {
+            std::cerr << "test_clahe: big change kept the tables\n";
+            nfails++;
+        }
+    } // for sz
+    return nfails;
+} // test_clahe()
@@ -0,0 +1,84 @@
+//
+//  Clahe.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// CLAHE with state, one per engine.
+// Same algorithm as cv::CLAHE, but the tile lookup tables are ours, so we can
+// keep them between video frames while the light does not change.
+// Gray only for the geometry stages, or on the L channel of a color image.
+
+#ifndef Clahe_hpp
+#define Clahe_hpp
+
+#include <vector>
+#include "Ocv.hpp"
+
+class Clahe
+//=============
+{
+public:
+    static constexpr double MAX_MEAN_DRIFT = 2.0; // gray levels before we rebuild the tables
+    static constexpr int MAX_AGE = 30; // frames before we rebuild anyway
+    
+    Clahe( double limit = 0.5, cv::Size tiles = cv::Size(8,8)) :
+    m_limit(limit), m_tiles(tiles) {}
+    
+    // Equalize one 8 bit channel. dst may be src.
+    // With reuse, keep the tables from an earlier frame if the mean is about the same.
+    void apply_gray( const cv::Mat &src, cv::Mat &dst, bool reuse=false);
+    // Equalize L in Lab, like clahe() in Ocv.cpp. dst may be src.
+    void apply_color( const cv::Mat &rgb, cv::Mat &dst, bool reuse=false);
+    // Forget the tables
+    void reset() { m_gray.age = m_color.age = -1; }
+    // How often we built tables, for tests and stats
+    long nbuilds() const { return m_nbuilds; }
+    
+private:
+    // Lookup tables, one per tile, and what they were made from
+    struct Tables {
+        std::vector<uchar> luts; // tiles.area() x 256
+        cv::Size img_size;
+        cv::Size tile_size;
+        double mean = 0;
+        int age = -1; // frames since built. -1 means none.
+    };
+    void equalize( const cv::Mat &src, cv::Mat &dst, Tables &t, bool reuse);
+    void build( const cv::Mat &src, Tables &t);
+    void interpolate( const cv::Mat &src, const Tables &t, cv::Mat &dst) const;
+    
+    // Data
+    double m_limit;
+    cv::Size m_tiles;
+    Tables m_gray, m_color;
+    long m_nbuilds = 0;
+    // Scratch
+    cv::Mat m_ext, m_lab, m_l;
+}; // class Clahe
+
+// Compare with cv::CLAHE and check the table reuse. Returns the number of failures.
+int test_clahe();
+
+#endif /* Clahe_hpp */
@@ -27,6 +27,7 @@
 
 // Generally useful convenience funcs
 
+#include <chrono>
 #include "Common.hpp"
 
 cplx I(0.0, 1.0);
@@ -35,29 +36,127 @@ cplx I(0.0, 1.0);
 // Math
 //======
 
-//---------------------------------------------------
-void _fft(cplx buf[], cplx out[], int n, int step)
+// In place iterative radix-2 FFT. n must be a power of 2.
+//-----------------------------------------------------------
+void fft( cplx buf[], int n)
 {
-    if (step < n) {
-        _fft( out, buf, n, step * 2);
-        _fft( out + step, buf + step, n, step * 2);
-        
-        for (int i = 0; i < n; i += 2 * step) {
-            cplx t = exp( -I * PI * (cplx(i) / cplx(n))) * out[ i + step];
-            buf[ i / 2]     = out[i] + t;
-            buf[ (i + n)/2] = out[i] - t;
+    // Bit reversal permutation
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) { j ^= bit; }
+        j ^= bit;
+        if (i < j) { std::swap( buf[i], buf[j]); }
+    }
+    // Butterflies
+    for (int len = 2; len <= n; len <<= 1) {
+        const cplx wlen = std::polar( 1.0, -2 * PI / len);
+        for (int i = 0; i < n; i += len) {
+            cplx w( 1.0, 0.0);
+            for (int k = 0; k < len / 2; k++) {
+                cplx u = buf[i + k];
+                cplx v = buf[i + k + len/2] * w;
+                buf[i + k]         = u + v;
+                buf[i + k + len/2] = u - v;
+                w *= wlen;
+            }
         }
     }
-}
+} // fft()
 
-//---------------------------
-void fft(cplx buf[], int n)
+// FFT of n real values, n a power of 2 and at least 4. Packs the input into
+// n/2 complex values, runs fft() on those, then untangles the halves.
+// out gets the n/2+1 non negative frequencies. The rest is conj symmetric.
+//-------------------------------------------------------------------------------
+void rfft( const double in[], cplx out[], int n)
 {
-    cplx out[n];
-    for (int i = 0; i < n; i++) out[i] = buf[i];
-    
-    _fft( buf, out, n, 1);
-}
+    const int h = n / 2;
+    for (int k = 0; k < h; k++) { out[k] = cplx( in[2*k], in[2*k+1]); }
+    fft( out, h);
+    const cplx z0 = out[0];
+    out[0] = cplx( z0.real() + z0.imag(), 0);
+    out[h] = cplx( z0.real() - z0.imag(), 0);
+    const cplx half_i( 0, 0.5);
+    for (int k = 1; k <= h/2; k++) {
+        const cplx a = out[k];
+        const cplx b = out[h - k];
+        const cplx wk = std::polar( 1.0, -2 * PI * k / n);
+        const cplx wh = std::polar( 1.0, -2 * PI * (h - k) / n);
+        out[k]     = 0.5 * (a + conj(b)) - half_i * wk * (a - conj(b));
+        out[h - k] = 0.5 * (b + conj(a)) - half_i * wh * (b - conj(a));
+    }
+} // rfft()
+
+// Tests
+//==========
+
+// Compare fft() and rfft() with a plain DFT on random input.
+// Returns the number of failures.
+//-------------------------------------------------------------
+int test_fft()
+{
+    int nfails = 0;
+    std::mt19937 gen( 42);
+    std::uniform_real_distribution<double> dist( -1.0, 1.0);
+    for (int n = 4; n <= 1024; n *= 2) {
+        std::vector<double> x( n);
+        std::vector<cplx> c( n), dft( n), r( n/2 + 1);
+        ILOOP (n) { x[i] = dist( gen); c[i] = cplx( x[i], 0); }
+        ILOOP (n) {
+            dft[i] = 0;
+            JLOOP (n) { dft[i] += x[j] * std::polar( 1.0, -2 * PI * i * j / n); }
+        }
+        fft( c.data(), n);
+        rfft( x.data(), r.data(), n);
+        double maxerr = 0;
+        ILOOP (n) { maxerr = std::max( maxerr, abs( c[i] - dft[i])); }
+        ILOOP (n/2 + 1) { maxerr = std::max( maxerr, abs( r[i] - dft[i])); }
+        if (maxerr > 1E-9 * n) {
+            std::cerr << "test_fft: n=" << n << " maxerr " << maxerr << "\n";
+            nfails++;
+        }
+    } // for
+    return nfails;
+} // test_fft()
+
+// Benchmarks
+//==============
+
+// Time order_stats() against full sorts of a copy, like the old vec_q1/vec_q3.
+// Sizes are typical line counts. Prints microseconds per call.
+//----------------------------------------------------------------------------------
+void bench_order_stats()
+{
+    const int sizes[] = { 19, 40, 100, 400 };
+    const int reps = 2000;
+    std::mt19937 gen( 42);
+    std::uniform_real_distribution<double> dist( 0.0, PI);
+    for (int n : sizes) {
+        std::vector<double> vals( n);
+        ISLOOP (vals) { vals[i] = dist( gen); }
+        double sink = 0;
+        
+        auto t0 = std::chrono::steady_clock::now();
+        ILOOP (reps) {
+            std::vector<double> v1 = vals;
+            std::sort( v1.begin(), v1.end());
+            std::vector<double> v3 = vals;
+            std::sort( v3.begin(), v3.end());
+            sink += v3[(3*n)/4] - v1[n/4];
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double q1, med, q3;
+        ILOOP (reps) {
+            quartiles( vals.data(), n, q1, med, q3);
+            sink -= q3 - q1;
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        
+        if (fabs( sink) > 1E-6) { std::cerr << "bench_order_stats: results differ for n=" << n << "\n"; }
+        double us_sort = std::chrono::duration<double, std::micro>( t1 - t0).count() / reps;
+        double us_sel  = std::chrono::duration<double, std::micro>( t2 - t1).count() / reps;
+        PLOG( "n=%4d  sort:%8.2fus  select:%8.2fus\n", n, us_sort, us_sel);
+    } // for
+} // bench_order_stats()
 
 // Debugger Helpers
 //======================
@@ -103,7 +103,9 @@ r = int(rr * 255); g = int(gg * 255); b = int(bb * 255); \
 typedef std::complex<double> cplx;
 extern cplx I;
 
-void fft(cplx buf[], int n);
+void fft( cplx buf[], int n);
+void rfft( const double in[], cplx out[], int n);
+int test_fft();
 
 
 //===================
@@ -295,45 +297,96 @@ std::vector<T> vconc( const std::vector<T> &v1, const std::vector<T> &v2)
     return res;
 } // vconc()
 
+// Order statistics
+//===================
+// Selection with nth_element instead of a full sort. Values are copied into
+// a scratch buffer that keeps its capacity, so steady state does not allocate.
+
+// Values at sorted positions ks[0] <= ks[1] <= ... of vals[0..n-1], into out[0..nk-1].
+// Each selection only looks at the part right of the previous one.
+//----------------------------------------------------------------------------------------------
+template <typename T>
+void order_stats( const T *vals, int n, const int *ks, int nk, T *out, std::vector<T> &scratch)
+{
+    scratch.assign( vals, vals + n);
+    auto first = scratch.begin();
+    KLOOP (nk) {
+        if (k && ks[k] == ks[k-1]) { out[k] = out[k-1]; continue; }
+        auto nth = scratch.begin() + ks[k];
+        std::nth_element( first, nth, scratch.end());
+        out[k] = *nth;
+        first = nth + 1;
+    }
+} // order_stats()
+
+// One scratch buffer per thread and type
+//-------------------------------------------
+template <typename T>
+std::vector<T> &order_scratch()
+{
+    static thread_local std::vector<T> scratch;
+    return scratch;
+}
+
+// Element at sorted position k
+//----------------------------------------------------
+template <typename T>
+T select_kth( const T *vals, int n, int k)
+{
+    T res;
+    order_stats( vals, n, &k, 1, &res, order_scratch<T>());
+    return res;
+}
+
+// Bottom quartile, median, top quartile in one go.
+// Same positions as vec_q1(), vec_median(), vec_q3().
+//-------------------------------------------------------------------
+template <typename T>
+void quartiles( const T *vals, int n, T &q1, T &med, T &q3)
+{
+    if (!n) { q1 = med = q3 = T(0); return; }
+    const int ks[3] = { n / 4, n / 2, (3 * n) / 4 };
+    T out[3];
+    order_stats( vals, n, ks, 3, out, order_scratch<T>());
+    q1 = out[0]; med = out[1]; q3 = out[2];
+}
+
 // Median value of a vector, with access func
 //----------------------------------------------
 template <typename T, typename Func>
 T vec_median( std::vector<T> vec, Func at)
 {
     if (!vec.size()) return T();
-    std::sort( vec.begin(), vec.end(),
-              [at](T a, T b) { return at(a) < at(b); });
+    std::nth_element( vec.begin(), vec.begin() + vec.size() / 2, vec.end(),
+                     [at](const T &a, const T &b) { return at(a) < at(b); });
     return vec[vec.size() / 2];
 }
 
 // Median value of a vector
 //---------------------------------
 template <typename T>
-T vec_median( std::vector<T> vec)
+T vec_median( const std::vector<T> &vec)
 {
     if (!vec.size()) return T(0);
-    std::sort( vec.begin(), vec.end(), [](T a, T b) { return a < b; });
-    return vec[vec.size() / 2];
+    return select_kth( vec.data(), SZ(vec), SZ(vec) / 2);
 }
 
 // Bottom quartile
 //---------------------------------
 template <typename T>
-T vec_q1( std::vector<T> vec)
+T vec_q1( const std::vector<T> &vec)
 {
     if (!vec.size()) return T(0);
-    std::sort( vec.begin(), vec.end(), [](T a, T b) { return a < b; });
-    return vec[vec.size() / 4];
+    return select_kth( vec.data(), SZ(vec), SZ(vec) / 4);
 }
 
 // Top quartile
 //---------------------------------
 template <typename T>
-T vec_q3( std::vector<T> vec)
+T vec_q3( const std::vector<T> &vec)
 {
     if (!vec.size()) return T(0);
-    std::sort( vec.begin(), vec.end(), [](T a, T b) { return a < b; });
-    return vec[(3 * vec.size()) / 4];
+    return select_kth( vec.data(), SZ(vec), (3 * SZ(vec)) / 4);
 }
 
 // Top quartile, with access func
@@ -342,8 +395,8 @@ template <typename T, typename Func>
 T vec_q3( std::vector<T> vec, Func at)
 {
     if (!vec.size()) return T();
-    std::sort( vec.begin(), vec.end(),
-              [at](T a, T b) { return at(a) < at(b); });
+    std::nth_element( vec.begin(), vec.begin() + (3 * vec.size()) / 4, vec.end(),
+                     [at](const T &a, const T &b) { return at(a) < at(b); });
     return vec[(3 * vec.size()) / 4];
 }
 
@@ -351,7 +404,7 @@ T vec_q3( std::vector<T> vec, Func at)
 // Welford's algorithm.
 //----------------------------------
 template <typename T>
-T vec_var( std::vector<T> samples)
+T vec_var( const std::vector<T> &samples)
 {
     double M = 0;
     double oldM = 0;
@@ -370,7 +423,7 @@ T vec_var( std::vector<T> samples)
 // Variance (sigma**2) of a vector.
 //-------------------------------------
 template <typename T>
-T vec_var_ref( std::vector<T> samples)
+T vec_var_ref( const std::vector<T> &samples)
 {
     double mean = 0;
     double sqmean = 0;
@@ -386,7 +439,7 @@ T vec_var_ref( std::vector<T> samples)
 // Sum of square dist from median
 //-------------------------------------
 template <typename T>
-T vec_var_med( std::vector<T> samples)
+T vec_var_med( const std::vector<T> &samples)
 {
     double med = vec_median( samples);
     double sqmean = 0;
@@ -401,7 +454,7 @@ T vec_var_med( std::vector<T> samples)
 // Sum a vector
 //------------------------------
 template <typename T>
-T vec_sum( std::vector<T> vec)
+T vec_sum( const std::vector<T> &vec)
 {
     if (!vec.size()) return T(0);
     double ssum = 0;
@@ -412,7 +465,7 @@ T vec_sum( std::vector<T> vec)
 // Avg value of a vector
 //------------------------------
 template <typename T>
-T vec_avg( std::vector<T> vec)
+T vec_avg( const std::vector<T> &vec)
 {
     if (!vec.size()) return T(0);
     double ssum = 0;
@@ -423,7 +476,7 @@ T vec_avg( std::vector<T> vec)
 // Avg value of a vector, with access func
 //---------------------------------------------
 template <typename T, typename Func>
-double vec_avg( std::vector<T> vec, Func at)
+double vec_avg( const std::vector<T> &vec, Func at)
 {
     if (!vec.size()) return 0;
     double ssum = 0;
@@ -434,7 +487,7 @@ double vec_avg( std::vector<T> vec, Func at)
 // Get the min value of a vector
 //----------------------------------------------
 template <typename T>
-T vec_min( std::vector<T> vec )
+T vec_min( const std::vector<T> &vec)
 {
     T res = *(std::min_element(vec.begin(), vec.end()));
     return res;
@@ -443,7 +496,7 @@ T vec_min( std::vector<T> vec )
 // Gets the max value of a vector
 //----------------------------------------------
 template <typename T>
-T vec_max( std::vector<T> vec )
+T vec_max( const std::vector<T> &vec)
 {
     T res = *(std::max_element(vec.begin(), vec.end()));
     return res;
@@ -617,6 +670,27 @@ partition( std::vector<T> elts, int nof_classes, Func getClass)
 // Print a vector
 void print_vecf( std::vector<double> v);
 void print_veci( std::vector<int> v);
+// Time order_stats() against full sorts
+void bench_order_stats();
+
+// Test Helpers
+//================
+
+// Counts failed checks in a unit test and says what failed.
+// TestCheck check( "Foo::test"); check( x == 1, "x"); return check.nfails();
+//--------------------------------------------------------------------------------
+class TestCheck
+{
+public:
+    TestCheck( const char *name) : m_name( name) {}
+    void operator()( bool ok, const char *what) {
+        if (!ok) { std::cerr << m_name << ": " << what << "\n"; m_nfails++; }
+    }
+    int nfails() const { return m_nfails; }
+private:
+    const char *m_name;
+    int m_nfails = 0;
+}; // class TestCheck
 
 
 #endif /* __cplusplus */
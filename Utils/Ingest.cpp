@@ -0,0 +1,254 @@
+//
+//  Ingest.cpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Turn raw camera planes into the small RGB and gray working images in one pass.
+
+#include <vector>
+#include <iostream>
+#include "Common.hpp"
+#include "Ingest.hpp"
+
+// Output size, same rule as resize() in Ocv.cpp: min(width,height) == sz
+//-------------------------------------------------------------------------------
+void ingest_size( int width, int height, int sz, int &dst_width, int &dst_height)
+{
+    double scale;
+    if (width < height) scale = sz / (double) width;
+    else scale = sz / (double) height;
+    dst_width = int(width * scale);
+    dst_height = int(height * scale);
+} // ingest_size()
+
+// Source range [lo[i], hi[i]) for each of n output pixels
+//----------------------------------------------------------------------------------
+static void box_bounds( int src_n, int n, std::vector<int> &lo, std::vector<int> &hi)
+{
+    lo.resize( n); hi.resize( n);
+    ILOOP (n) {
+        lo[i] = int( int64_t(i) * src_n / n);
+        hi[i] = std::max( lo[i] + 1, int( int64_t(i+1) * src_n / n));
+        hi[i] = std::min( hi[i], src_n);
+    }
+} // box_bounds()
+
+inline uint8_t clamp8( int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+// BT.601 in 10 bit fixed point
+//----------------------------------------------------------------------------------
+inline void yuv2rgb( int y, int u, int v, bool video_range, uint8_t *rgb)
+{
+    u -= 128; v -= 128;
+    int c, r, g, b;
+    if (video_range) {
+        c = (y - 16) * 1192;
+        r = c + 1634 * v;
+        g = c - 401 * u - 832 * v;
+        b = c + 2066 * u;
+    }
+    else {
+        c = y * 1024;
+        r = c + 1436 * v;
+        g = c - 352 * u - 731 * v;
+        b = c + 1815 * u;
+    }
+    rgb[0] = clamp8( (r + 512) >> 10);
+    rgb[1] = clamp8( (g + 512) >> 10);
+    rgb[2] = clamp8( (b + 512) >> 10);
+} // yuv2rgb()
+
+// Same integer weights as cv::COLOR_RGB2GRAY
+//----------------------------------------------------
+inline uint8_t rgb2gray( const uint8_t *rgb)
+{
+    return (rgb[0] * 4899 + rgb[1] * 9617 + rgb[2] * 1868 + 8192) >> 14;
+} // rgb2gray()
+
+// Area downsample, color convert to RGB, and compute gray in a single pass over src.
+// For NV12 we average Y, Cb, Cr over the box and convert once per output pixel.
+//------------------------------------------------------------------------------------------
+void ingest_frame( const IngestPlanes &src, int dst_width, int dst_height,
+                  uint8_t *rgb, size_t rgb_stride, uint8_t *gray, size_t gray_stride)
+{
+    const bool nv12 = (src.fmt != INGEST_BGRA);
+    const bool video_range = (src.fmt == INGEST_NV12_VIDEO);
+    std::vector<int> xlo, xhi, ylo, yhi;
+    box_bounds( src.width, dst_width, xlo, xhi);
+    box_bounds( src.height, dst_height, ylo, yhi);
+    // Chroma boxes, NV12 has one CbCr pair per 2x2 pixels
+    std::vector<int> cxlo( dst_width), cxhi( dst_width);
+    ILOOP (dst_width) { cxlo[i] = xlo[i] / 2; cxhi[i] = (xhi[i] - 1) / 2 + 1; }
+
+    // Column sums for one output row: 3 channels, plus count
+    std::vector<int> acc( 3 * dst_width);
+
+    RLOOP (dst_height) {
+        std::fill( acc.begin(), acc.end(), 0);
+        const int nrows = yhi[r] - ylo[r];
+        for (int sy = ylo[r]; sy < yhi[r]; sy++) {
+            const uint8_t *row = src.plane0 + sy * src.stride0;
+            if (nv12) {
+                CLOOP (dst_width) {
+                    int s = 0;
+                    for (int sx = xlo[c]; sx < xhi[c]; sx++) { s += row[sx]; }
+                    acc[3*c] += s;
+                }
+            }
+            else {
+                CLOOP (dst_width) {
+                    int sb = 0, sg = 0, sr = 0;
+                    const uint8_t *p = row + 4 * xlo[c];
+                    for (int sx = xlo[c]; sx < xhi[c]; sx++, p += 4) {
+                        sb += p[0]; sg += p[1]; sr += p[2];
+                    }
+                    acc[3*c] += sr; acc[3*c+1] += sg; acc[3*c+2] += sb;
+                }
+            }
+        } // for sy
+        if (nv12) {
+            const int cylo = ylo[r] / 2;
+            const int cyhi = (yhi[r] - 1) / 2 + 1;
+            for (int cy = cylo; cy < cyhi; cy++) {
+                const uint8_t *row = src.plane1 + cy * src.stride1;
+                CLOOP (dst_width) {
+                    int su = 0, sv = 0;
+                    for (int cx = cxlo[c]; cx < cxhi[c]; cx++) { su += row[2*cx]; sv += row[2*cx+1]; }
+                    acc[3*c+1] += su; acc[3*c+2] += sv;
+                }
+            }
+        } // if (nv12)
+
+        // Averages to output pixels
+        uint8_t *orow = rgb + r * rgb_stride;
+        uint8_t *grow = gray + r * gray_stride;
+        CLOOP (dst_width) {
+            const int n = nrows * (xhi[c] - xlo[c]);
+            uint8_t *o = orow + 3*c;
+            if (nv12) {
+                const int cn = (((yhi[r] - 1) / 2 + 1) - ylo[r] / 2) * (cxhi[c] - cxlo[c]);
+                yuv2rgb( (acc[3*c] + n/2) / n, (acc[3*c+1] + cn/2) / cn, (acc[3*c+2] + cn/2) / cn,
+                        video_range, o);
+            }
+            else {
+                o[0] = (acc[3*c] + n/2) / n;
+                o[1] = (acc[3*c+1] + n/2) / n;
+                o[2] = (acc[3*c+2] + n/2) / n;
+            }
+            grow[c] = rgb2gray( o);
+        } // CLOOP
+    } // RLOOP
+} // ingest_frame()
+
+// Slow reference: convert every pixel, then average in double
+//-----------------------------------------------------------------------------------------
+static void ingest_reference( const IngestPlanes &src, int dst_width, int dst_height,
+                             std::vector<uint8_t> &rgb)
+{
+    std::vector<int> xlo, xhi, ylo, yhi;
+    box_bounds( src.width, dst_width, xlo, xhi);
+    box_bounds( src.height, dst_height, ylo, yhi);
+    rgb.assign( 3 * dst_width * dst_height, 0);
+    RLOOP (dst_height) {
+        CLOOP (dst_width) {
+            double s[3] = {0,0,0}, su = 0, sv = 0, sy_ = 0; int n = 0;
+            for (int y = ylo[r]; y < yhi[r]; y++) {
+                for (int x = xlo[c]; x < xhi[c]; x++) {
+                    n++;
+                    if (src.fmt == INGEST_BGRA) {
+                        const uint8_t *p = src.plane0 + y * src.stride0 + 4*x;
+                        s[0] += p[2]; s[1] += p[1]; s[2] += p[0];
+                    }
+                    else {
+                        sy_ += src.plane0[y * src.stride0 + x];
+                        su += src.plane1[(y/2) * src.stride1 + 2*(x/2)];
+                        sv += src.plane1[(y/2) * src.stride1 + 2*(x/2) + 1];
+                    }
+                }
+            }
+            uint8_t *o = &rgb[3 * (r * dst_width + c)];
+            if (src.fmt == INGEST_BGRA) {
+                ILOOP (3) { o[i] = ROUND( s[i] / n); }
+            }
+            else {
+                yuv2rgb( ROUND( sy_ / n), ROUND( su / n), ROUND( sv / n), src.fmt == INGEST_NV12_VIDEO, o);
+            }
+        } // CLOOP
+    } // RLOOP
+} // ingest_reference()
+
+// Compare ingest_frame() against a slow reference on synthetic frames.
+// Box averaging of chroma differs slightly at odd box borders, so allow a small error.
+// Returns the number of failures.
+//-----------------------------------------------------------------------------------------
+int test_ingest()
+{
+    const int MAX_ERR = 3;
+    int nfails = 0;
+    const IngestFormat fmts[] = { INGEST_BGRA, INGEST_NV12_VIDEO, INGEST_NV12_FULL };
+    for (IngestFormat fmt : fmts) {
+        // Portrait 480x640 with padded rows, like the camera gives us
+        const int w = 480, h = 640, pad = 32;
+        std::vector<uint8_t> p0, p1;
+        size_t stride0, stride1 = w + pad;
+        if (fmt == INGEST_BGRA) {
+            stride0 = 4 * w + pad;
+            p0.resize( stride0 * h);
+            RLOOP (h) { CLOOP (w) {
+                uint8_t *p = &p0[r * stride0 + 4*c];
+                p[0] = (c * 7 + r) & 0xff; p[1] = (r * 3) & 0xff; p[2] = (c ^ r) & 0xff; p[3] = 255;
+            }}
+        }
+        else {
+            stride0 = w + pad;
+            p0.resize( stride0 * h);
+            p1.resize( stride1 * h / 2);
+            RLOOP (h) { CLOOP (w) { p0[r * stride0 + c] = 16 + (c * 7 + r) % 220; }}
+            RLOOP (h/2) { CLOOP (w/2) {
+                p1[r * stride1 + 2*c] = 128 + (c % 64) - 32;
+                p1[r * stride1 + 2*c+1] = 128 + (r % 48) - 24;
+            }}
+        }
+        IngestPlanes src = { fmt, w, h, p0.data(), stride0, p1.data(), stride1 };
+        int dw, dh;
+        ingest_size( w, h, 350, dw, dh);
+        if (dw != 350 || dh != 466) {
+            std::cerr << "test_ingest: bad size " << dw << "x" << dh << "\n";
+            nfails++;
+        }
+        std::vector<uint8_t> rgb( 3 * dw * dh), gray( dw * dh), ref;
+        ingest_frame( src, dw, dh, rgb.data(), 3 * dw, gray.data(), dw);
+        ingest_reference( src, dw, dh, ref);
+        int maxerr = 0, graymismatch = 0;
+        ISLOOP (rgb) { maxerr = std::max( maxerr, std::abs( rgb[i] - ref[i])); }
+        ISLOOP (gray) { if (gray[i] != rgb2gray( &rgb[3*i])) graymismatch++; }
+        if (maxerr > MAX_ERR || graymismatch) {
+            std::cerr << "test_ingest: format " << fmt << " maxerr " << maxerr
+            << " gray mismatches " << graymismatch << "\n";
+            nfails++;
+        }
+    } // for fmt
+    return nfails;
+} // test_ingest()
@@ -0,0 +1,64 @@
+//
+//  Ingest.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Turn raw camera planes into the small RGB and gray working images in one pass.
+// Pure C++, no OpenCV, so it can be tested anywhere with synthetic buffers.
+
+#ifndef Ingest_hpp
+#define Ingest_hpp
+
+#include <cstdint>
+#include <cstddef>
+
+enum IngestFormat {
+    INGEST_BGRA,        // one plane, 4 bytes per pixel
+    INGEST_NV12_VIDEO,  // Y plane + interleaved CbCr plane, Y in 16..235
+    INGEST_NV12_FULL    // same, Y in 0..255
+};
+
+// Where the camera pixels are. Strides in bytes.
+struct IngestPlanes
+{
+    IngestFormat fmt;
+    int width, height;
+    const uint8_t *plane0; size_t stride0; // BGRA pixels or Y
+    const uint8_t *plane1; size_t stride1; // CbCr, NV12 only
+};
+
+// Output size, same rule as resize() in Ocv.cpp: min(width,height) == sz
+void ingest_size( int width, int height, int sz, int &dst_width, int &dst_height);
+
+// Area downsample, color convert to RGB, and compute gray in a single pass over src.
+// Gray uses the same weights as cv::COLOR_RGB2GRAY.
+void ingest_frame( const IngestPlanes &src, int dst_width, int dst_height,
+                  uint8_t *rgb, size_t rgb_stride, uint8_t *gray, size_t gray_stride);
+
+// Compare ingest_frame() against a slow reference on synthetic frames.
+// Returns the number of failures.
+int test_ingest();
+
+#endif /* Ingest_hpp */
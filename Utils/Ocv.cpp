@@ -32,8 +32,6 @@
 #include "Ocv.hpp"
 #include "Common.hpp"
 
-cv::RNG rng(12345); // random number generator
-
 // Point
 //========
 
@@ -198,8 +196,8 @@ Points approx_poly( Points cont, int n)
 }
 
 // Draw contour in random colors
-//-------------------------------------------------------
-void draw_contours( const Contours cont, cv::Mat &dst)
+//-----------------------------------------------------------------------
+void draw_contours( const Contours cont, cv::Mat &dst, cv::RNG &rng)
 {
     // Draw contours
     for( int i = 0; i< cont.size(); i++ )
@@ -653,14 +651,16 @@ void rot_img( const cv::Mat &img, double angle, cv::Mat &dst)
 void rough_houghlines (const cv::Mat &img, const Points &ps,
                  std::vector<cv::Vec2f> &vert_lines,
                  std::vector<cv::Vec2f> &horiz_lines,
-                 int votes)
+                 int votes, cv::Mat *scratch)
 {
     vert_lines.clear();
     horiz_lines.clear();
     if (!SZ(ps)) return;
-    cv::Mat canvas;
-    // Draw the points
-    canvas = cv::Mat::zeros( cv::Size(img.cols, img.rows), CV_8UC1 );
+    // Draw the points. Reuse the caller's buffer if there is one.
+    cv::Mat local;
+    cv::Mat &canvas = scratch ? *scratch : local;
+    canvas.create( img.size(), CV_8UC1);
+    canvas = 0;
     ISLOOP (ps) {
         draw_point( ps[i], canvas,1, cv::Scalar(255));
     }
@@ -714,14 +714,16 @@ void rough_houghlines (const cv::Mat &img, const Points &ps,
 void perp_houghlines (const cv::Mat &img, const Points &ps,
                  std::vector<cv::Vec2f> &vert_lines,
                  std::vector<cv::Vec2f> &horiz_lines,
-                 int votes)
+                 int votes, cv::Mat *scratch)
 {
     vert_lines.clear();
     horiz_lines.clear();
     if (!SZ(ps)) return;
-    cv::Mat canvas;
-    // Draw the points
-    canvas = cv::Mat::zeros( cv::Size(img.cols, img.rows), CV_8UC1 );
+    // Draw the points. Reuse the caller's buffer if there is one.
+    cv::Mat local;
+    cv::Mat &canvas = scratch ? *scratch : local;
+    canvas.create( img.size(), CV_8UC1);
+    canvas = 0;
     ISLOOP (ps) {
         draw_point( ps[i], canvas,2, cv::Scalar(255));
     }
@@ -804,6 +806,78 @@ double direction (const cv::Mat &img, const Points &ps)
 } // direction()
 
 
+// Fused adaptive threshold and dilate on raw rows. See adaptive_thresh_dilate().
+//------------------------------------------------------------------------------------------
+static void thresh_dilate_rows( const uchar *src, size_t sstep, uchar *dst, size_t dstep,
+                               int rows, int cols, int thresh)
+{
+    // round(sum/25) the way cv::boxFilter does it for 8 bit
+    const int SHIFT = 23, DSCALE = 335544, DDELTA = 13;
+    thread_local std::vector<ushort> colsum, ext;
+    thread_local std::vector<uchar> bin, hmax;
+    colsum.assign( cols, 0);
+    ext.resize( cols + 4);
+    bin.resize( cols);
+    hmax.resize( 3 * cols); // ring of three dilated rows
+    auto srow = [src, sstep, rows](int r) {
+        return src + std::min( std::max( r, 0), rows - 1) * sstep;
+    };
+    // Vertical 5 sums for row 0, replicated border
+    for (int k = -2; k <= 2; k++) {
+        const uchar *p = srow( k);
+        CLOOP (cols) { colsum[c] += p[c]; }
+    }
+    for (int r = 0; r <= rows; r++) {
+        if (r < rows) {
+            // Horizontal 5 sums, mean, threshold
+            ushort *e = ext.data();
+            CLOOP (cols) { e[c+2] = colsum[c]; }
+            e[0] = e[1] = colsum[0];
+            e[cols+2] = e[cols+3] = colsum[cols-1];
+            const uchar *p = srow( r);
+            CLOOP (cols) {
+                const unsigned s = e[c] + e[c+1] + e[c+2] + e[c+3] + e[c+4];
+                const int mean = ((s + DDELTA) * DSCALE) >> SHIFT;
+                bin[c] = (p[c] + thresh <= mean) ? 255 : 0;
+            }
+            // 3 wide max, clipped at the edges
+            uchar *h = &hmax[(r % 3) * cols];
+            if (cols == 1) { h[0] = bin[0]; }
+            else {
+                h[0] = std::max( bin[0], bin[1]);
+                for (int c = 1; c < cols-1; c++) {
+                    h[c] = std::max( std::max( bin[c-1], bin[c]), bin[c+1]);
+                }
+                h[cols-1] = std::max( bin[cols-2], bin[cols-1]);
+            }
+            // Slide the vertical sums down
+            const uchar *add = srow( r + 3), *sub = srow( r - 2);
+            CLOOP (cols) { colsum[c] += add[c] - sub[c]; }
+        }
+        // Row r-1 is done once we have r
+        if (r >= 1) {
+            const int o = r - 1;
+            const uchar *h0 = &hmax[(o % 3) * cols];
+            const uchar *hu = (o > 0) ? &hmax[((o-1) % 3) * cols] : h0;
+            const uchar *hd = (o < rows-1) ? &hmax[((o+1) % 3) * cols] : h0;
+            uchar *q = dst + o * dstep;
+            CLOOP (cols) { q[c] = std::max( std::max( hu[c], h0[c]), hd[c]); }
+        }
+    } // for r
+} // thresh_dilate_rows()
+
+// cv::adaptiveThreshold( MEAN_C, BINARY_INV, block 5) followed by cv::dilate with a 3x3 rect,
+// in one sweep over the image. Bit exact with the two calls.
+// Keeps running column sums, and the last three thresholded rows. dst must not be gray.
+//------------------------------------------------------------------------------------------------
+void adaptive_thresh_dilate( const cv::Mat &gray, cv::Mat &dst, int thresh)
+{
+    dst.create( gray.size(), CV_8UC1);
+    if (gray.empty()) return;
+    thresh_dilate_rows( gray.ptr<uchar>(0), gray.step, dst.ptr<uchar>(0), dst.step,
+                       gray.rows, gray.cols, thresh);
+} // adaptive_thresh_dilate()
+
 // Inverse threshold at median
 //-----------------------------------------------------------
 void inv_thresh_median( const cv::Mat &gray, cv::Mat &dst)
@@ -955,8 +1029,8 @@ double center_avg( const cv::Mat &img, double frac)
     return ssum / area;
 }
 
-// Normalize mean and variance, per channel
-//--------------------------------------------------------
+// Normalize mean and variance, per channel. Result is CV_32FC3.
+//------------------------------------------------------------------
 void normalize_image( const cv::Mat &src, cv::Mat &dst)
 {
     cv::Mat planes[4];
@@ -964,33 +1038,40 @@ void normalize_image( const cv::Mat &src, cv::Mat &dst)
     cv::Scalar mmean, sstddev;
     
     cv::meanStdDev( planes[0], mmean, sstddev);
-    planes[0].convertTo( planes[0], CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
+    planes[0].convertTo( planes[0], CV_32FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
     
     cv::meanStdDev( planes[1], mmean, sstddev);
-    planes[1].convertTo( planes[1], CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
+    planes[1].convertTo( planes[1], CV_32FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
     
     cv::meanStdDev( planes[2], mmean, sstddev);
-    planes[2].convertTo( planes[2], CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
+    planes[2].convertTo( planes[2], CV_32FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
     
     // ignore channel 4, that's alpha
     cv::merge( planes, 3, dst);
 }
 
 // Normalize mean and variance for one uint channel,
-// scale back to 0..255
-//--------------------------------------------------------
+// scale back to 0..255.
+// The normalization is linear, so after the stretch to 0..255 only min and max
+// of src matter. No need for a float copy.
+//-----------------------------------------------------------------------------------
 void normalize_plane( const cv::Mat &src, cv::Mat &dst)
 {
-    cv::Mat normed;
-    cv::Scalar mmean, sstddev;
-    cv::meanStdDev( src, mmean, sstddev);
-    src.convertTo( normed, CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
     double mmin, mmax;
-    cv::minMaxLoc( normed, &mmin, &mmax);
+    cv::minMaxLoc( src, &mmin, &mmax);
     double delta = mmax - mmin;
     double scale = 255.0 / delta;
     double trans = -mmin * scale;
-    normed.convertTo( dst, CV_8UC1, scale , trans);
+    src.convertTo( dst, CV_8UC1, scale , trans);
+}
+
+// 8 bit RGB to float (x - 128) / 128, interleaved rows*cols*3, for the networks.
+// Writes straight into dst, no temporaries. Exact in float32.
+//-------------------------------------------------------------------------------------
+void to_nn_input( const cv::Mat &rgb, float *dst)
+{
+    cv::Mat wrap( rgb.rows, rgb.cols, CV_32FC3, dst);
+    rgb.convertTo( wrap, CV_32FC3, 1.0 / 128.0, -1.0);
 }
 
 // Make sure rect does not extend beyond img
@@ -1009,39 +1090,128 @@ void clip_rect( cv::Rect &rect, const cv::Mat &img)
     }
 }
 
+// Mean and 1/sigma over the rect x0 <= x < x1, y0 <= y < y1, from integral images
+//-----------------------------------------------------------------------------------
+static inline void rect_stats( const cv::Mat &sum, const cv::Mat &sqsum,
+                              int x0, int y0, int x1, int y1,
+                              double &mean, double &inv_sigma)
+{
+    const double n = (x1 - x0) * (y1 - y0);
+    const int *s0 = sum.ptr<int>(y0), *s1 = sum.ptr<int>(y1);
+    const double *q0 = sqsum.ptr<double>(y0), *q1 = sqsum.ptr<double>(y1);
+    const double ssum  = s1[x1] - s1[x0] - s0[x1] + s0[x0];
+    const double sqssum = q1[x1] - q1[x0] - q0[x1] + q0[x0];
+    mean = ssum / n;
+    const double var = sqssum / n - mean * mean;
+    inv_sigma = 1.0 / sqrt( std::max( var, 1E-6));
+} // rect_stats()
+
 // Normalize nxn submatrices, with mean and var from larger submatrix.
-//------------------------------------------------------------------------
-void normalize_plane_local( const cv::Mat &src, cv::Mat &dst, int radius)
+// Tiled: tiles of 2*radius+1, stats from a window of 8*radius+1 at the tile center.
+// Sliding: every pixel gets the stats of the 8*radius+1 window around it.
+// Window sums come from integral images, so a window costs four lookups whatever its size.
+// Two passes over the rows, in parallel. The first finds the range of the normalized
+// values, the second writes uint8 directly. No float image in between.
+//------------------------------------------------------------------------------------------------
+void normalize_plane_local( const cv::Mat &src, cv::Mat &dst, int radius, bool sliding)
 {
-    cv::Mat normed;
-    cv::Scalar mmean, sstddev;
-    cv::Mat fltmat( src.rows, src.cols, CV_64FC1);
     const int FAC = 4;
+    const int rows = src.rows, cols = src.cols;
+    const int tile = 2*radius + 1;
+    const int wrad = FAC*radius;
+    cv::Mat sum, sqsum;
+    cv::integral( src, sum, sqsum, CV_32S, CV_64F);
     
-    int r = 0;
-    while (r < src.rows) {
-        int c = 0;
-        while (c < src.cols) {
-            cv::Rect inner_rect( c-radius, r-radius, 2*radius+1, 2*radius+1);
-            clip_rect( inner_rect, src);
-            cv::Rect outer_rect( c - FAC*radius, r - FAC*radius, 2*FAC*radius+1, 2*FAC*radius+1);
-            clip_rect( outer_rect, src);
-            cv::meanStdDev( src( outer_rect), mmean, sstddev);
-            src(inner_rect).convertTo( normed, CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
-            //PLOG(">>>>>>>>>> mean %f sigma %f\n", mmean.val[0], sstddev.val[0]);
-            normed.copyTo( fltmat( inner_rect) );
-            c += 2*radius+1;
+    // The window for pixel (or tile center) c in [0,n), as [lo,hi).
+    // Tiled mode keeps the old clip_rect() behavior: windows at the border
+    // are shifted inside, not shrunk.
+    auto window = [wrad, sliding](int c, int n, int &lo, int &hi) {
+        lo = c - wrad;
+        hi = c + wrad + 1;
+        if (sliding) {
+            lo = std::max( lo, 0);
         }
-        r += 2*radius + 1;
-    }
-    double mmin, mmax;
-    cv::minMaxLoc( fltmat, &mmin, &mmax);
-    double delta = mmax - mmin;
-    double scale = 255.0 / delta;
-    double trans = -mmin * scale;
-    fltmat.convertTo( dst, CV_8UC1, scale , trans);
-}
-
+        else {
+            lo = std::min( std::max( lo, 0), n - 1);
+            hi = lo + 2*wrad + 1;
+        }
+        hi = std::min( hi, n);
+    };
+    // Which tile center a pixel belongs to. Pixels past the last center use the last tile.
+    auto center = [tile, radius](int c, int n) {
+        int k = std::min( (c + radius) / tile, (n - 1) / tile);
+        return k * tile;
+    };
+    // Coefficients a,b per column for one row. Normalized value is a*x + b.
+    auto row_coeffs = [&](int r, std::vector<double> &a, std::vector<double> &b) {
+        int y0, y1;
+        window( sliding ? r : center( r, rows), rows, y0, y1);
+        double mean, inv_sigma;
+        if (sliding) {
+            CLOOP (cols) {
+                int x0, x1;
+                window( c, cols, x0, x1);
+                rect_stats( sum, sqsum, x0, y0, x1, y1, mean, inv_sigma);
+                a[c] = inv_sigma; b[c] = -mean * inv_sigma;
+            }
+        }
+        else {
+            for (int c0 = 0; c0 < cols; c0 += tile) {
+                int x0, x1;
+                window( c0, cols, x0, x1);
+                rect_stats( sum, sqsum, x0, y0, x1, y1, mean, inv_sigma);
+                // Columns of this tile
+                int lo = std::max( c0 - radius, 0);
+                int hi = (c0 + tile >= cols) ? cols : c0 + radius + 1;
+                for (int c = lo; c < hi; c++) { a[c] = inv_sigma; b[c] = -mean * inv_sigma; }
+            }
+        }
+    };
+    
+    // Row stripes, one min and max per stripe
+    const int nstripes = std::min( rows, 4 * std::max( cv::getNumThreads(), 1));
+    auto stripe_rows = [rows, nstripes](int s, int &r0, int &r1) {
+        r0 = s * rows / nstripes;
+        r1 = (s+1) * rows / nstripes;
+    };
+    std::vector<double> mins( nstripes, 1E100), maxes( nstripes, -1E100);
+    cv::parallel_for_( cv::Range( 0, nstripes), [&](const cv::Range &range) {
+        std::vector<double> a( cols), b( cols);
+        for (int s = range.start; s < range.end; s++) {
+            int r0, r1;
+            stripe_rows( s, r0, r1);
+            for (int r = r0; r < r1; r++) {
+                row_coeffs( r, a, b);
+                const uchar *p = src.ptr<uchar>(r);
+                CLOOP (cols) {
+                    double v = a[c] * p[c] + b[c];
+                    mins[s] = std::min( mins[s], v);
+                    maxes[s] = std::max( maxes[s], v);
+                }
+            }
+        }
+    });
+    const double mmin = *std::min_element( mins.begin(), mins.end());
+    const double mmax = *std::max_element( maxes.begin(), maxes.end());
+    const double scale = 255.0 / std::max( mmax - mmin, 1E-9);
+    
+    dst.create( rows, cols, CV_8UC1);
+    cv::parallel_for_( cv::Range( 0, nstripes), [&](const cv::Range &range) {
+        std::vector<double> a( cols), b( cols);
+        for (int s = range.start; s < range.end; s++) {
+            int r0, r1;
+            stripe_rows( s, r0, r1);
+            for (int r = r0; r < r1; r++) {
+                row_coeffs( r, a, b);
+                const uchar *p = src.ptr<uchar>(r);
+                uchar *q = dst.ptr<uchar>(r);
+                CLOOP (cols) {
+                    q[c] = cv::saturate_cast<uchar>( (a[c] * p[c] + b[c] - mmin) * scale);
+                }
+            }
+        }
+    });
+} // normalize_plane_local()
 
 // Drawing
 //==========
@@ -1253,6 +1423,159 @@ void test_segment2polar()
     }
 }
 
+// The normalizations as they were, in double. For test_normalize().
+//----------------------------------------------------------------------
+static void normalize_plane_reference( const cv::Mat &src, cv::Mat &dst)
+{
+    cv::Mat normed;
+    cv::Scalar mmean, sstddev;
+    cv::meanStdDev( src, mmean, sstddev);
+    src.convertTo( normed, CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
+    double mmin, mmax;
+    cv::minMaxLoc( normed, &mmin, &mmax);
+    double scale = 255.0 / (mmax - mmin);
+    normed.convertTo( dst, CV_8UC1, scale , -mmin * scale);
+} // normalize_plane_reference()
+
+//-----------------------------------------------------------------------------------------
+static void normalize_plane_local_reference( const cv::Mat &src, cv::Mat &dst, int radius)
+{
+    cv::Mat normed;
+    cv::Scalar mmean, sstddev;
+    cv::Mat fltmat( src.rows, src.cols, CV_64FC1);
+    const int FAC = 4;
+    for (int r = 0; r < src.rows; r += 2*radius + 1) {
+        for (int c = 0; c < src.cols; c += 2*radius + 1) {
+            cv::Rect inner_rect( c-radius, r-radius, 2*radius+1, 2*radius+1);
+            clip_rect( inner_rect, src);
+            cv::Rect outer_rect( c - FAC*radius, r - FAC*radius, 2*FAC*radius+1, 2*FAC*radius+1);
+            clip_rect( outer_rect, src);
+            cv::meanStdDev( src( outer_rect), mmean, sstddev);
+            src(inner_rect).convertTo( normed, CV_64FC1, 1 / sstddev.val[0] , -mmean.val[0] / sstddev.val[0]);
+            normed.copyTo( fltmat( inner_rect) );
+        }
+    }
+    double mmin, mmax;
+    cv::minMaxLoc( fltmat, &mmin, &mmax);
+    double scale = 255.0 / (mmax - mmin);
+    fltmat.convertTo( dst, CV_8UC1, scale , -mmin * scale);
+} // normalize_plane_local_reference()
+
+// Compare the float32 normalizations against the double ones on a synthetic image.
+// Outputs are 8 bit, so allow one gray level. The network input has to be exact.
+// Returns the number of failures.
+//--------------------------------------------------------------------------------------
+int test_normalize()
+{
+    const int MAX_ERR = 1;
+    int nfails = 0;
+    // A gradient with texture and a dark blob, like a board under uneven light.
+    // The old tiled code leaves the right columns unwritten unless
+    // (cols-1) % (2*radius+1) <= radius, so pick a width where it covers everything.
+    cv::Mat gray( 466, 342, CV_8UC1);
+    RLOOP (gray.rows) { CLOOP (gray.cols) {
+        int v = 40 + r / 3 + ((r * 7 + c * 13) % 23);
+        if (SQR(r - 200) + SQR(c - 150) < 900) v /= 3;
+        gray.at<uchar>(r,c) = v;
+    }}
+    cv::Mat res, ref;
+    
+    normalize_plane( gray, res);
+    normalize_plane_reference( gray, ref);
+    double maxerr = cv::norm( res, ref, cv::NORM_INF);
+    if (maxerr > MAX_ERR) {
+        std::cerr << "test_normalize: normalize_plane maxerr " << maxerr << "\n";
+        nfails++;
+    }
+    
+    normalize_plane_local( gray, res, 5);
+    normalize_plane_local_reference( gray, ref, 5);
+    maxerr = cv::norm( res, ref, cv::NORM_INF);
+    if (maxerr > MAX_ERR) {
+        std::cerr << "test_normalize: normalize_plane_local maxerr " << maxerr << "\n";
+        nfails++;
+    }
+    
+    // Sliding window against meanStdDev per pixel. Check every 97th pixel.
+    normalize_plane_local( gray, res, 5, true);
+    const int wrad = 4 * 5;
+    std::vector<double> vals;
+    ILOOP (gray.rows * gray.cols) {
+        int r = i / gray.cols, c = i % gray.cols;
+        cv::Rect rect( c - wrad, r - wrad, 2*wrad+1, 2*wrad+1);
+        rect &= cv::Rect( 0, 0, gray.cols, gray.rows);
+        cv::Scalar mmean, sstddev;
+        cv::meanStdDev( gray( rect), mmean, sstddev);
+        vals.push_back( (gray.at<uchar>(r,c) - mmean.val[0]) / sstddev.val[0]);
+    }
+    double vmin = vec_min( vals), vmax = vec_max( vals);
+    maxerr = 0;
+    for (int i = 0; i < SZ(vals); i += 97) {
+        double expected = (vals[i] - vmin) * 255.0 / (vmax - vmin);
+        maxerr = std::max( maxerr, fabs( res.data[i] - expected));
+    }
+    if (maxerr > MAX_ERR) {
+        std::cerr << "test_normalize: sliding normalize_plane_local maxerr " << maxerr << "\n";
+        nfails++;
+    }
+    
+    // Network input, from a crop like in nn_classify_intersections
+    cv::Mat rgb;
+    cv::Mat planes[3] = { gray, 255 - gray, gray / 2 };
+    cv::merge( planes, 3, rgb);
+    cv::Mat crop = rgb( cv::Rect( 100, 100, 23, 23));
+    std::vector<float> buf( 3 * crop.rows * crop.cols);
+    to_nn_input( crop, buf.data());
+    int nbad = 0;
+    RLOOP (crop.rows) { CLOOP (crop.cols) { ILOOP (3) {
+        double expected = (crop.at<cv::Vec3b>(r,c)[i] - 128.0) / 128.0;
+        if (buf[r*crop.cols*3 + c*3 + i] != (float)expected) nbad++;
+    }}}
+    if (nbad) {
+        std::cerr << "test_normalize: to_nn_input " << nbad << " mismatches\n";
+        nfails++;
+    }
+    return nfails;
+} // test_normalize()
+
+// adaptive_thresh_dilate() against the two OpenCV calls it replaces.
+// Returns the number of failures.
+//-------------------------------------------------------------------------
+int test_thresh_dilate()
+{
+    int nfails = 0;
+    static const cv::Mat element = cv::getStructuringElement( cv::MORPH_RECT, cv::Size(3,3));
+    cv::RNG rng( 42);
+    const cv::Size sizes[] = { cv::Size( 350, 466), cv::Size( 17, 31), cv::Size( 1, 7), cv::Size( 3, 2) };
+    for (auto sz : sizes) {
+        // Texture, noise, and a bright part to hit the top of the mean range
+        cv::Mat img( sz, CV_8UC1);
+        RLOOP (img.rows) { CLOOP (img.cols) {
+            int v = (r < img.rows/2) ? 90 + (r * 7 + c * 13) % 40 : 215 + (r * 3 + c * 11) % 40;
+            img.at<uchar>(r,c) = cv::saturate_cast<uchar>( v + rng.uniform( -6, 7));
+        }}
+        // Also a view into a bigger image, like the workspace hands out
+        cv::Mat big( sz.height + 4, sz.width + 4, CV_8UC1, cv::Scalar(255));
+        img.copyTo( big( cv::Rect( 2, 2, sz.width, sz.height)));
+        const cv::Mat inputs[] = { img, big( cv::Rect( 2, 2, sz.width, sz.height)) };
+        for (const cv::Mat &src : inputs) {
+            for (int thresh : { 3, 8, 10 }) {
+                cv::Mat expected, res;
+                cv::adaptiveThreshold( src, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV, 5, thresh);
+                cv::dilate( expected, expected, element);
+                adaptive_thresh_dilate( src, res, thresh);
+                int ndiff = cv::countNonZero( res != expected);
+                if (ndiff) {
+                    std::cerr << "test_thresh_dilate: " << sz << " thresh " << thresh
+                    << " " << ndiff << " pixels differ\n";
+                    nfails++;
+                }
+            }
+        }
+    } // for sz
+    return nfails;
+} // test_thresh_dilate()
+
 // Debuggging
 //=============
 
@@ -49,8 +49,6 @@ typedef std::vector<cv::Point2f> Points2f;
 typedef struct { Point2f p; double feat; } PFeat;
 typedef cv::Point3_<uint8_t> Pixel;
 
-extern cv::RNG rng;
-
 
 // Point
 //=========
@@ -106,8 +104,8 @@ inline cv::Mat mat_sumscale( const cv::Mat &m1, const cv::Mat &m2, double w1 = 1
 //=========
 // Enclose a contour with an n edge polygon
 Points approx_poly( Points cont, int n);
-// Draw contour in random colors
-void draw_contours( const Contours cont, cv::Mat &dst);
+// Draw contour in random colors. Caller owns the RNG.
+void draw_contours( const Contours cont, cv::Mat &dst, cv::RNG &rng);
 
 // Line
 //=======
@@ -198,23 +196,29 @@ void get_hue_from_rgb( const cv::Mat &img, cv::Mat &dst);
 void clahe( const cv::Mat &img, cv::Mat &dst, double limit);
 // Average over a center crop of img
 double center_avg( const cv::Mat &img, double frac=4);
-// Normalize mean and variance, per channel
+// Normalize mean and variance, per channel. Result is CV_32FC3.
 void normalize_image( const cv::Mat &src, cv::Mat &dst);
 // Normalize mean and variance for one uint channel, scale back to 0..255
 void normalize_plane( const cv::Mat &src, cv::Mat &dst);
 // Normalize nxn submatrices, with mean and var from larger submatrix.
-void normalize_plane_local( const cv::Mat &src, cv::Mat &dst, int radius);
+// With sliding, every pixel gets its own window.
+void normalize_plane_local( const cv::Mat &src, cv::Mat &dst, int radius, bool sliding=false);
+// 8 bit RGB to float (x - 128) / 128, interleaved rows*cols*3, for the networks
+void to_nn_input( const cv::Mat &rgb, float *dst);
 // Get main horizontal direction of a grid of points (in rad)
 double direction( const cv::Mat &img, const Points &ps);
-// Find verticals and horizontals using hough lines
+// Find verticals and horizontals using hough lines.
+// Pass scratch to draw the points into a buffer you keep.
 void rough_houghlines (const cv::Mat &img, const Points &ps,
                        std::vector<cv::Vec2f> &vert_lines,
                        std::vector<cv::Vec2f> &horiz_lines,
-                       int votes=10);
+                       int votes=10, cv::Mat *scratch=nullptr);
 void perp_houghlines (const cv::Mat &img, const Points &ps,
                       std::vector<cv::Vec2f> &vert_lines,
                       std::vector<cv::Vec2f> &horiz_lines,
-                      int votes=10);
+                      int votes=10, cv::Mat *scratch=nullptr);
+// adaptiveThreshold (MEAN_C, BINARY_INV, block 5) plus 3x3 dilate, fused
+void adaptive_thresh_dilate( const cv::Mat &gray, cv::Mat &dst, int thresh);
 // Inverse threshold at median
 void inv_thresh_median( const cv::Mat &gray, cv::Mat &dst);
 // Inverse threshold at q1
@@ -278,6 +282,8 @@ cv::Rect make_hood( Point2f center, int dx, int dy);
 std::string opencvVersion();
 void test_mcluster();
 void test_segment2polar();
+int test_normalize();
+int test_thresh_dilate();
 
 //===================
 // Templates below
@@ -69,16 +69,19 @@ void S3_upload_file( NSString *fname, NSString *target,
                             key:target
                     contentType:content_type
                      expression:nil
-              completionHandler:nil]
+              completionHandler:^(AWSS3TransferUtilityUploadTask *task, NSError *error) {
+        // Upload finished, with or without error
+        if (error) {
+            NSLog(@"Error: %@", error);
+        }
+        completion( error);
+    }]
     continueWithBlock:^id(AWSTask *task) {
+        // Upload could not start. The completion handler never runs.
         if (task.error) {
             NSLog(@"Error: %@", task.error);
+            completion( task.error);
         }
-        if (task.result) {
-            // success
-            //AWSS3TransferUtilityUploadTask *uploadTask = task.result;
-        }
-        completion( task.error);
         return nil;
     }];
 } // S3_upload_file()
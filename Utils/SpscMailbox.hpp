@@ -0,0 +1,128 @@
+//
+//  SpscMailbox.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Lock-free mailbox for exactly one producer and one consumer thread.
+// Used to connect the stages of the video pipeline. It holds only the newest
+// element. A push replaces an element nobody has read yet, so a slow consumer
+// always gets the freshest frame and never works through a backlog.
+// Three buffers: the producer writes one, the consumer reads one, and the
+// middle one changes hands with a single atomic exchange.
+
+#ifndef SpscMailbox_hpp
+#define SpscMailbox_hpp
+
+#include <atomic>
+#include <array>
+#include <thread>
+#include <utility>
+#include <iostream>
+
+#include "Common.hpp"
+
+template <typename T>
+class SpscMailbox
+//===================
+{
+public:
+    // Producer side. Returns true if an unread element got replaced.
+    //------------------------------------------------------------------
+    inline bool push( T &&elt)
+    {
+        m_slots[m_back] = std::move( elt);
+        const int old = m_middle.exchange( m_back | FRESH, std::memory_order_acq_rel);
+        m_back = old & IDX;
+        return old & FRESH;
+    } // push()
+
+    // Consumer side. Returns false if there is nothing new.
+    //---------------------------------------------------------
+    inline bool pop( T &elt)
+    {
+        if (!(m_middle.load( std::memory_order_relaxed) & FRESH)) return false;
+        const int old = m_middle.exchange( m_front, std::memory_order_acq_rel);
+        m_front = old & IDX;
+        elt = std::move( m_slots[m_front]);
+        return true;
+    } // pop()
+
+    // Consumer side
+    //------------------------
+    inline bool empty() const
+    {
+        return !(m_middle.load( std::memory_order_acquire) & FRESH);
+    } // empty()
+
+    static int test();
+
+private:
+    static constexpr int IDX = 3;   // slot index bits of m_middle
+    static constexpr int FRESH = 4; // middle slot has not been read
+    std::array<T, 3> m_slots;
+    int m_back = 0;                 // producer only
+    int m_front = 2;                // consumer only
+    // Away from the slots, else every exchange invalidates their cache line
+    alignas(64) std::atomic<int> m_middle{1};
+}; // class SpscMailbox
+
+// Examples and checks. Returns the number of failures.
+//--------------------------------------------------------------
+template <typename T>
+int SpscMailbox<T>::test()
+{
+    TestCheck check( "SpscMailbox::test");
+    
+    // Past capacity, the oldest go and the newest stays
+    SpscMailbox<int> box;
+    int elt = -1;
+    check( box.empty() && !box.pop( elt), "empty at start");
+    check( !box.push( 1), "first push replaces nothing");
+    check( box.push( 2), "second push replaces 1");
+    check( box.push( 3), "third push replaces 2");
+    check( box.pop( elt) && elt == 3, "pop gets the newest");
+    check( !box.pop( elt) && box.empty(), "empty after pop");
+    check( !box.push( 4) && box.pop( elt) && elt == 4, "push after pop");
+    
+    // Two threads. The consumer sees increasing values and ends with the last one.
+    const int NPUSH = 200000;
+    SpscMailbox<int> box2;
+    bool increasing = true;
+    int last = -1;
+    std::thread consumer( [&]() {
+        int v;
+        while (last < NPUSH - 1) {
+            if (!box2.pop( v)) { std::this_thread::yield(); continue; }
+            if (v <= last) { increasing = false; }
+            last = v;
+        }
+    });
+    for (int i = 0; i < NPUSH; i++) { box2.push( int(i)); }
+    consumer.join();
+    check( increasing && last == NPUSH - 1, "threads");
+    return check.nfails();
+} // test()
+
+#endif /* SpscMailbox_hpp */
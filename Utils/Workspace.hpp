@@ -0,0 +1,166 @@
+//
+//  Workspace.hpp
+//  KifuCam
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2018 Andreas Hauenstein <hauensteina@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Numbered cv::Mat buffers that live as long as the engine.
+// Callers name the slots with an enum, so a lookup is an index, not a string.
+// get() hands out a buffer of the requested shape and only allocates if the
+// shape changed. Write results into these instead of into fresh Mats, and a
+// stream of same sized frames runs without heap allocations for images.
+// The counters show how many buffers got (re)allocated per frame, including the ones
+// OpenCV replaced behind our back because an output had the wrong shape.
+
+#ifndef Workspace_hpp
+#define Workspace_hpp
+
+#include <algorithm>
+#include <deque>
+#include "Ocv.hpp"
+
+class Workspace
+//=================
+{
+public:
+    // A buffer of this shape. Content is whatever the last user left in it.
+    //---------------------------------------------------------------------------
+    inline cv::Mat &get( int id, cv::Size sz, int type)
+    {
+        Slot &slot = at( id);
+        if (slot.mat.size() != sz || slot.mat.type() != type) {
+            slot.mat.create( sz, type);
+        }
+        check( slot);
+        return slot.mat;
+    } // get()
+    
+    //------------------------------------------------------------------------------
+    inline cv::Mat &get( int id, int rows, int cols, int type)
+    {
+        return get( id, cv::Size( cols, rows), type);
+    }
+    
+    // Same shape and type as m
+    //--------------------------------------------------------------------
+    inline cv::Mat &get_like( int id, const cv::Mat &m)
+    {
+        return get( id, m.size(), m.type());
+    }
+    
+    // A buffer the next OpenCV call sizes itself. Counted in end_frame().
+    //---------------------------------------------------------------------------
+    inline cv::Mat &get( int id)
+    {
+        return at( id).mat;
+    }
+    
+    // For images whose size changes from frame to frame, like after scaling.
+    // The buffer only grows; you get the top left sz part of it.
+    // The result is not continuous. Don't index it as one flat array.
+    //---------------------------------------------------------------------------
+    inline cv::Mat get_view( int id, cv::Size sz, int type)
+    {
+        Slot &slot = at( id);
+        cv::Mat &m = slot.mat;
+        if (m.type() != type || m.cols < sz.width || m.rows < sz.height) {
+            m.create( cv::Size( std::max( m.cols, sz.width), std::max( m.rows, sz.height)), type);
+        }
+        check( slot);
+        return m( cv::Rect( 0, 0, sz.width, sz.height));
+    } // get_view()
+    
+    // Start counting allocations for a new frame
+    //----------------------------------------------
+    inline void begin_frame()
+    {
+        m_frame_allocs = 0;
+    }
+    
+    // Catch buffers that were reallocated after get(), and close the frame
+    //-------------------------------------------------------------------------
+    inline void end_frame()
+    {
+        for (auto &slot : m_slots) { check( slot); }
+        m_last_frame_allocs = m_frame_allocs;
+        m_nframes++;
+    } // end_frame()
+    
+    // Allocations in the last finished frame. 0 in steady state.
+    inline int frame_allocs() const { return m_last_frame_allocs; }
+    inline long total_allocs() const { return m_total_allocs; }
+    inline long nframes() const { return m_nframes; }
+    
+    // Bytes held by all buffers
+    //------------------------------
+    inline size_t bytes() const
+    {
+        size_t res = 0;
+        for (const auto &slot : m_slots) { res += slot.mat.total() * slot.mat.elemSize(); }
+        return res;
+    } // bytes()
+    
+    // Give all memory back
+    //------------------------
+    inline void clear()
+    {
+        m_slots.clear();
+    }
+    
+private:
+    struct Slot {
+        cv::Mat mat;
+        const uchar *data = nullptr; // where mat pointed last time we looked
+    };
+    
+    // The slot for id. Grows the table the first time an id shows up.
+    //----------------------------------------------------------------------
+    inline Slot &at( int id)
+    {
+        if (id >= SZ(m_slots)) { m_slots.resize( id + 1); }
+        return m_slots[id];
+    } // at()
+    
+    // Count an allocation if the slot points to new memory
+    //----------------------------------------------------------
+    inline void check( Slot &slot)
+    {
+        if (slot.mat.datastart != slot.data) {
+            slot.data = slot.mat.datastart;
+            if (slot.data) {
+                m_frame_allocs++;
+                m_total_allocs++;
+            }
+        }
+    } // check()
+    
+    // Data
+    std::deque<Slot> m_slots; // grows at the end, so references from get() stay valid
+    int m_frame_allocs = 0;
+    int m_last_frame_allocs = 0;
+    long m_total_allocs = 0;
+    long m_nframes = 0;
+}; // class Workspace
+
+#endif /* Workspace_hpp */
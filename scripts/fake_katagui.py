@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+# /********************************************************************
+# Filename: fake_katagui.py
+# Author: AHN
+# Creation Date: Oct, 2026
+# **********************************************************************/
+#
+# Local stand-in for the two katagui endpoints the app uses, to test
+# the analysis cache without network. Point the app at it with
+#   defaults write <bundle id> katagui_url http://<this host>:8000
+# or set the user default katagui_url in the simulator.
+# Counts requests per endpoint and prints them, so you can see that
+# repeated positions are served from the cache and that identical
+# requests are coalesced.
+# GET /counts returns the counts as json, GET /reset zeroes them.
+# Run Test Cases in the app's debug menu uses both to check the cache.
+#
+
+from __future__ import division, print_function
+import sys, json, time, argparse, threading
+from collections import Counter
+from http.server import HTTPServer, BaseHTTPRequestHandler
+from socketserver import ThreadingMixIn
+
+COUNTS = Counter()
+COUNTS_LOCK = threading.Lock()
+
+#---------------------------
+def usage( printmsg=False):
+    name = sys.argv[0].split('/')[-1]
+    msg = '''
+    Name:
+      %s --  Fake katagui server for testing the analysis cache
+    Synopsis:
+      %s [--port <port>] [--delay <seconds>]
+    Description:
+      Answers POST /score/katago_gtp_bot and /select-move-x/katago_gtp_bot
+      with made up but well formed results. --delay slows each answer down,
+      to make coalescing and concurrency visible.
+      GET /counts returns the requests per endpoint, GET /reset zeroes them.
+    Example:
+      %s --port 8000 --delay 2
+    ''' % (name,name,name)
+    if printmsg:
+        print(msg)
+        exit(1)
+    else:
+        return msg
+
+#-------------------------------------------
+def fake_probs( board_size, moves):
+    ''' Black owns the points of its moves, white the rest of the board '''
+    cols = 'ABCDEFGHJKLMNOPQRST'
+    probs = [-0.5] * (board_size * board_size)
+    for i,m in enumerate( moves):
+        if m == 'pass': continue
+        col = cols.index( m[0])
+        row = board_size - int( m[1:])
+        probs[row * board_size + col] = 1.0 if i % 2 == 0 else -1.0
+    return ['%.2f' % p for p in probs]
+
+#======================================================
+class Handler( BaseHTTPRequestHandler):
+    delay = 0.0
+
+    #--------------------
+    def do_POST( self):
+        path = self.path.split('?')[0]
+        length = int( self.headers.get( 'Content-Length', 0))
+        parms = json.loads( self.rfile.read( length) or b'{}')
+        board_size = int( parms.get( 'board_size', 19))
+        moves = parms.get( 'moves', [])
+        with COUNTS_LOCK:
+            COUNTS[path] += 1
+            counts = dict( COUNTS)
+        print( '%s moves:%d counts:%s' % (path, len(moves), counts))
+        time.sleep( self.delay)
+        if path == '/score/katago_gtp_bot':
+            res = { 'probs': fake_probs( board_size, moves),
+                    'diagnostics': { 'bot_move':'pass' } }
+        elif path == '/select-move-x/katago_gtp_bot':
+            res = { 'bot_move':'D4',
+                    'diagnostics': { 'bot_move':'D4', 'score':3.4, 'winprob':0.61,
+                                     'best_ten':[ {'move':'D4', 'psv':100}, {'move':'Q16', 'psv':90} ] } }
+        else:
+            self.send_response( 404)
+            self.end_headers()
+            return
+        self.send_json( res)
+
+    #--------------------
+    def do_GET( self):
+        path = self.path.split('?')[0]
+        with COUNTS_LOCK:
+            if path == '/reset':
+                COUNTS.clear()
+            elif path != '/counts':
+                self.send_response( 404)
+                self.end_headers()
+                return
+            counts = dict( COUNTS)
+        self.send_json( counts)
+
+    #--------------------------
+    def send_json( self, res):
+        body = json.dumps( res).encode()
+        self.send_response( 200)
+        self.send_header( 'Content-Type', 'application/json')
+        self.send_header( 'Content-Length', str( len( body)))
+        self.end_headers()
+        self.wfile.write( body)
+
+    # Quiet, we print our own line
+    def log_message( self, format, *args): pass
+
+# Concurrent requests must be served concurrently, like katagui does
+class ThreadingServer( ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+#-----------
+def main():
+    if len(sys.argv) > 1 and sys.argv[1] in ('-h', '--help'):
+        usage( True)
+    parser = argparse.ArgumentParser( usage=usage())
+    parser.add_argument( '--port', type=int, default=8000)
+    parser.add_argument( '--delay', type=float, default=0.0)
+    args = parser.parse_args()
+    Handler.delay = args.delay
+    print( 'Fake katagui on port %d' % args.port)
+    ThreadingServer( ('', args.port), Handler).serve_forever()
+
+if __name__ == '__main__':
+    main()